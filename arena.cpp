@@ -0,0 +1,62 @@
+/**
+ * @file arena.cpp - implementation of statement-scoped memory.
+ * Arena
+ * StatementArena
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "arena.h"
+#include <cstdlib>
+using namespace std;
+
+thread_local Arena* Arena::current_arena = nullptr;
+size_t StatementArena::last_peak = 0;
+u_int64_t StatementArena::last_allocations = 0;
+size_t StatementArena::max_peak = 0;
+
+
+/**************************Arena Implementation*********************/
+
+Arena::~Arena() {
+	release();
+	for (auto const& chunk : this->chunks)
+		free(chunk.first);
+}
+
+//Next chunk: twice the last one (up to MAX_CHUNK), or just big enough for an outsized request
+void* Arena::grow(size_t size, size_t alignment) {
+	size_t need = size + alignment;
+	size_t chunk_size = this->chunks.empty() ? this->chunk_size : this->chunks.back().second * 2;
+	if (chunk_size > MAX_CHUNK)
+		chunk_size = MAX_CHUNK;
+	if (chunk_size < need)
+		chunk_size = need;
+	char* chunk = (char*)malloc(chunk_size);
+	if (chunk == nullptr)
+		throw bad_alloc();
+	this->chunks.push_back(make_pair(chunk, chunk_size));
+	this->end = chunk + chunk_size;
+	return (void*)(((size_t)chunk + alignment - 1) & ~(alignment - 1));
+}
+
+void Arena::release() {
+	for (auto it = this->cleanups.rbegin(); it != this->cleanups.rend(); ++it)
+		it->second(it->first);
+	this->cleanups.clear();
+	for (FreeBlock* &free : this->free_lists)
+		free = nullptr;
+	while (this->chunks.size() > 1) {
+		free(this->chunks.back().first);
+		this->chunks.pop_back();
+	}
+	this->next = this->chunks.empty() ? nullptr : this->chunks[0].first;
+	this->end = this->chunks.empty() ? nullptr : this->chunks[0].first + this->chunks[0].second;
+	this->used = 0;
+}
+
+size_t Arena::get_reserved() const {
+	size_t reserved = 0;
+	for (auto const& chunk : this->chunks)
+		reserved += chunk.second;
+	return reserved;
+}
@@ -0,0 +1,213 @@
+/**
+ * @file arena.h - Statement-scoped memory.
+ * Arena
+ * ArenaAllocator
+ * StatementArena
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @class Arena - monotonic allocator: hands out memory by bumping a pointer, frees it all at once
+ *
+ * Memory comes from chunks that start at FIRST_CHUNK bytes and double (a request too big for
+ * a chunk gets one of its own). Nothing goes back to the system until release(), which runs
+ * the destructors of the objects made with make() (newest first) and keeps the first chunk for
+ * next time, so an Arena reused statement after statement settles down to no system allocations
+ * at all. Small blocks given back with deallocate() are kept on a free list per size and handed
+ * out again, so a statement that churns through short-lived objects (a map per row, say) reuses
+ * the same warm memory instead of marching through fresh chunks.
+ */
+class Arena {
+public:
+	static const size_t FIRST_CHUNK = 64 * 1024;
+	static const size_t MAX_CHUNK = 1024 * 1024;
+	static const size_t GRAIN = 16;                   // free-list size classes are multiples of this
+	static const size_t MAX_RECYCLED = 16 * GRAIN;    // larger blocks aren't recycled
+
+	Arena() : chunks(), next(nullptr), end(nullptr), chunk_size(FIRST_CHUNK), cleanups(), free_lists(), used(0),
+		peak(0), allocations(0) {}
+	virtual ~Arena();
+	Arena(const Arena& other) = delete;
+	Arena(Arena&& temp) = delete;
+	Arena& operator=(const Arena& other) = delete;
+	Arena& operator=(Arena&& temp) = delete;
+
+	/**
+	 * @param size       bytes wanted
+	 * @param alignment  a power of two
+	 * @returns          memory good until release()
+	 */
+	void* allocate(size_t size, size_t alignment=alignof(std::max_align_t)) {
+		char* p;
+		if (size <= MAX_RECYCLED && alignment <= GRAIN) {
+			size = (size + GRAIN - 1) & ~(GRAIN - 1);
+			alignment = GRAIN;
+			FreeBlock* &free = free_lists[size / GRAIN - 1];
+			if (free != nullptr) {
+				p = (char*)free;
+				free = free->next;
+				return track(p, size);
+			}
+		}
+		p = next == nullptr ? nullptr : (char*)(((size_t)next + alignment - 1) & ~(alignment - 1));
+		if (p == nullptr || size > (size_t)(end - p))
+			p = (char*)grow(size, alignment);
+		next = p + size;
+		return track(p, size);
+	}
+
+	/**
+	 * Give back a block from allocate() before release(), so it can be handed out again.
+	 * @param p     the block
+	 * @param size  the size it was allocated with
+	 */
+	void deallocate(void* p, size_t size) {
+		if (size > MAX_RECYCLED || size == 0)
+			return;
+		size = (size + GRAIN - 1) & ~(GRAIN - 1);
+		FreeBlock* block = (FreeBlock*)p;
+		block->next = free_lists[size / GRAIN - 1];
+		free_lists[size / GRAIN - 1] = block;
+		used -= size;
+	}
+
+	/**
+	 * Construct an object in the arena; its destructor runs at release().
+	 * @returns  the object (not to be deleted)
+	 */
+	template <typename T, typename... Args>
+	T* make(Args&&... args) {
+		T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		cleanups.push_back(Cleanup(object, [](void* p) {((T*)p)->~T();}));
+		return object;
+	}
+
+	/**
+	 * Destroy what make() made and forget everything allocated, keeping the first chunk.
+	 * get_peak() is kept until reset_peak().
+	 */
+	void release();
+
+	size_t get_used() const {return used;}          // bytes handed out and not given back
+	size_t get_peak() const {return peak;}          // most bytes in use at once
+	u_int64_t get_allocations() const {return allocations;}
+	size_t get_reserved() const;                    // bytes of chunks held
+	void reset_peak() {peak = used; allocations = 0;}
+
+	/**
+	 * @returns  the arena of the innermost StatementArena on this thread, or nullptr outside of one
+	 */
+	static Arena* current() {return current_arena;}
+
+protected:
+	typedef std::pair<void*, void (*)(void*)> Cleanup;
+	std::vector<std::pair<char*, size_t>> chunks;
+	char* next;
+	char* end;
+	size_t chunk_size;
+	std::vector<Cleanup> cleanups;
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+	FreeBlock* free_lists[MAX_RECYCLED / GRAIN];
+	size_t used;
+	size_t peak;
+	u_int64_t allocations;
+	static thread_local Arena* current_arena;
+	friend class StatementArena;
+
+	void* grow(size_t size, size_t alignment);
+
+	void* track(char* p, size_t size) {
+		used += size;
+		allocations++;
+		if (used > peak)
+			peak = used;
+		return p;
+	}
+};
+
+/**
+ * @class ArenaAllocator - std allocator that uses the statement's Arena when there is one
+ *
+ * Picks up Arena::current() when it is made, so a container made during a statement gets its
+ * memory from that statement's arena (and what it frees is recycled there); one made outside
+ * any statement uses the heap as usual. A container made during a statement must not outlive it.
+ */
+template <typename T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	ArenaAllocator() : arena(Arena::current()) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t n) {
+		if (arena != nullptr)
+			return (T*)arena->allocate(n * sizeof(T), alignof(T));
+		return (T*)::operator new(n * sizeof(T));
+	}
+
+	void deallocate(T* p, size_t n) {
+		if (arena == nullptr)
+			::operator delete(p);
+		else
+			arena->deallocate(p, n * sizeof(T));
+	}
+
+	ArenaAllocator select_on_container_copy_construction() const {return ArenaAllocator();}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const {return arena == other.arena;}
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const {return arena != other.arena;}
+
+	Arena* arena;
+};
+
+/**
+ * @class StatementArena - the Arena for one statement, current on this thread while it is in scope
+ *
+ * Everything allocated from it is released when it goes out of scope. Nested statements stack,
+ * each with its own Arena. The peak and allocation count of the most recent statement are kept
+ * for reports.
+ */
+class StatementArena {
+public:
+	StatementArena(Arena& arena) : arena(arena), outer(Arena::current_arena) {
+		arena.reset_peak();
+		Arena::current_arena = &arena;
+	}
+	virtual ~StatementArena() {
+		last_peak = arena.get_peak();
+		last_allocations = arena.get_allocations();
+		if (last_peak > max_peak)
+			max_peak = last_peak;
+		Arena::current_arena = outer;
+		arena.release();
+	}
+	StatementArena(const StatementArena& other) = delete;
+	StatementArena(StatementArena&& temp) = delete;
+	StatementArena& operator=(const StatementArena& other) = delete;
+	StatementArena& operator=(StatementArena&& temp) = delete;
+
+	static size_t last_peak;             // bytes, most recent statement
+	static u_int64_t last_allocations;   // allocations, most recent statement
+	static size_t max_peak;              // bytes, any statement so far
+
+protected:
+	Arena& arena;
+	Arena* outer;
+};
@@ -0,0 +1,205 @@
+/**
+ * @file buffer_pool.cpp - implementation of the engine-wide block cache.
+ * BufferFrame
+ * BufferPool
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "buffer_pool.h"
+#include <cstring>
+using namespace std;
+
+
+/**************************BufferFrame Implementation*********************/
+
+BufferFrame::BufferFrame()
+	: file(nullptr), block_id(0), buffer(new char[DbBlock::BLOCK_SZ]), capacity(DbBlock::BLOCK_SZ),
+	  data(buffer, DbBlock::BLOCK_SZ), page(data, 0, true), pin_count(0), dirty(false), referenced(false),
+	  loading(false) {}
+
+BufferFrame::~BufferFrame() {
+	delete[] buffer;
+}
+
+//Make sure the buffer can hold a block of the given size (files can have different block sizes)
+void BufferFrame::fit(u_int32_t block_sz) {
+	if (this->capacity < block_sz) {
+		delete[] this->buffer;
+		this->buffer = new char[block_sz];
+		this->capacity = block_sz;
+	}
+	this->data.set_data(this->buffer);
+	this->data.set_size(block_sz);
+}
+
+
+/**************************BufferPool Implementation*********************/
+
+//The engine's pool, created on first use
+BufferPool& BufferPool::instance() {
+	static BufferPool pool;
+	return pool;
+}
+
+BufferPool::BufferPool(u_int32_t num_frames)
+	: write_back_on_unpin(true), frames(), table(), latch(), loaded(), hand(0), hits(0), misses(0), evictions(0),
+	  writes(0) {
+	for (u_int32_t i = 0; i < num_frames; i++)
+		this->frames.push_back(new BufferFrame());
+}
+
+BufferPool::~BufferPool() {
+	for (BufferFrame* frame : this->frames)
+		delete frame;
+}
+
+//Pin a block, reading it in on a miss. The read happens with the latch let go; our pin keeps
+//the frame from being taken, and loading keeps anyone else from using it before it's ready.
+BufferFrame* BufferPool::pin(HeapFile* file, BlockID block_id) {
+	std::unique_lock<std::mutex> lock(this->latch);
+	BufferFrame* frame = find(file, block_id);
+	while (frame != nullptr && frame->loading) {
+		this->loaded.wait(lock);
+		frame = find(file, block_id);  // it may have failed to load and been given up
+	}
+	if (frame != nullptr) {
+		this->hits++;
+		frame->pin_count++;
+		frame->referenced = true;
+		return frame;
+	}
+	this->misses++;
+	frame = claim(file, block_id);
+	frame->fit(file->get_block_size());
+	frame->pin_count++;
+	frame->referenced = true;
+	frame->loading = true;
+	lock.unlock();
+	try {
+		file->read(block_id, frame->data);
+		frame->page.load(frame->data, block_id);
+	}
+	catch (...) {
+		lock.lock();
+		this->table.erase(FrameKey(file, block_id));
+		frame->file = nullptr;
+		frame->pin_count--;
+		frame->loading = false;
+		this->loaded.notify_all();
+		throw;
+	}
+	lock.lock();
+	frame->loading = false;
+	this->loaded.notify_all();
+	return frame;
+}
+
+//Pin an empty page for a block that hasn't been written yet
+BufferFrame* BufferPool::pin_new(HeapFile* file, BlockID block_id) {
+	std::lock_guard<std::mutex> lock(this->latch);
+	BufferFrame* frame = find(file, block_id);
+	if (frame == nullptr)
+		frame = claim(file, block_id);
+	frame->fit(file->get_block_size());
+	memset(frame->buffer, 0, file->get_block_size());
+	frame->page.load(frame->data, block_id);
+	frame->page.initialize_new();
+	frame->dirty = false;  // not part of the file until someone put()s it
+	frame->pin_count++;
+	frame->referenced = true;
+	return frame;
+}
+
+//Last pin out writes back a dirty frame if we're doing that
+void BufferPool::unpin(BufferFrame* frame) {
+	std::lock_guard<std::mutex> lock(this->latch);
+	if (frame->pin_count > 0)
+		frame->pin_count--;
+	if (frame->pin_count == 0 && frame->dirty && this->write_back_on_unpin)
+		write(frame);
+}
+
+void BufferPool::mark_dirty(BufferFrame* frame) {
+	std::lock_guard<std::mutex> lock(this->latch);
+	frame->dirty = true;
+}
+
+BufferFrame* BufferPool::lookup(HeapFile* file, BlockID block_id) {
+	std::lock_guard<std::mutex> lock(this->latch);
+	return find(file, block_id);
+}
+
+void BufferPool::flush(HeapFile* file, BlockID block_id) {
+	std::lock_guard<std::mutex> lock(this->latch);
+	BufferFrame* frame = find(file, block_id);
+	if (frame != nullptr && frame->dirty)
+		write(frame);
+}
+
+//Flush and forget all of a file's frames (it is closing)
+void BufferPool::release(HeapFile* file) {
+	std::lock_guard<std::mutex> lock(this->latch);
+	for (BufferFrame* frame : this->frames) {
+		if (frame->file != file)
+			continue;
+		if (frame->dirty)
+			write(frame);
+		this->table.erase(FrameKey(file, frame->block_id));
+		frame->file = nullptr;
+		frame->referenced = false;
+	}
+}
+
+void BufferPool::checkpoint() {
+	std::lock_guard<std::mutex> lock(this->latch);
+	for (BufferFrame* frame : this->frames)
+		if (frame->file != nullptr && frame->dirty)
+			write(frame);
+}
+
+//Cached frame for the block, if any (latch held)
+BufferFrame* BufferPool::find(HeapFile* file, BlockID block_id) {
+	auto it = this->table.find(FrameKey(file, block_id));
+	return it == this->table.end() ? nullptr : it->second;
+}
+
+//CLOCK: sweep past pinned frames, clearing reference bits, until an unpinned, unreferenced
+//frame comes up. Two full turns without finding one means everything is pinned.
+BufferFrame* BufferPool::victim() {
+	u_int32_t n = (u_int32_t)this->frames.size();
+	for (u_int32_t i = 0; i < 2 * n; i++) {
+		BufferFrame* frame = this->frames[this->hand];
+		this->hand = (this->hand + 1) % n;
+		if (frame->pin_count > 0)
+			continue;
+		if (frame->referenced) {
+			frame->referenced = false;
+			continue;
+		}
+		return frame;
+	}
+	throw BufferPoolError("all buffer pool frames are pinned");
+}
+
+//Take over a frame for a block, writing back and evicting whatever it held
+BufferFrame* BufferPool::claim(HeapFile* file, BlockID block_id) {
+	BufferFrame* frame = victim();
+	if (frame->file != nullptr) {
+		if (frame->dirty)
+			write(frame);
+		this->table.erase(FrameKey(frame->file, frame->block_id));
+		this->evictions++;
+	}
+	frame->file = file;
+	frame->block_id = block_id;
+	frame->dirty = false;
+	this->table[FrameKey(file, block_id)] = frame;
+	return frame;
+}
+
+void BufferPool::write(BufferFrame* frame) {
+	if (frame->file != nullptr)
+		frame->file->write(&frame->page);
+	frame->dirty = false;
+	this->writes++;
+}
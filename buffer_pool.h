@@ -0,0 +1,185 @@
+/**
+ * @file buffer_pool.h - Engine-wide cache of HeapFile blocks.
+ * BufferFrame
+ * BufferPool
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "db_cxx.h"
+#include "heap_storage.h"
+
+/**
+ * @class BufferPoolError - thrown when every frame is pinned and a block still has to come in
+ */
+class BufferPoolError : public std::runtime_error {
+public:
+	explicit BufferPoolError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class BufferFrame - one slot of the BufferPool, holding one block of one HeapFile
+ *
+ * The frame owns its block memory and a SlottedPage over it that every pinner shares,
+ * so changes made through one PinnedPage are seen by all the others.
+ */
+class BufferFrame {
+public:
+	BufferFrame();
+	~BufferFrame();
+	BufferFrame(const BufferFrame& other) = delete;
+	BufferFrame(BufferFrame&& temp) = delete;
+	BufferFrame& operator=(const BufferFrame& other) = delete;
+	BufferFrame& operator=(BufferFrame&& temp) = delete;
+
+	SlottedPage* get_page() {return &page;}
+	BlockID get_block_id() {return block_id;}
+	HeapFile* get_file() {return file;}
+
+protected:
+	friend class BufferPool;
+	HeapFile* file;      // nullptr when the frame is free (or its file was closed under a pin)
+	BlockID block_id;
+	char* buffer;
+	u_int32_t capacity;
+	Dbt data;
+	SlottedPage page;
+	u_int32_t pin_count;
+	bool dirty;
+	bool referenced;     // CLOCK's second-chance bit
+	bool loading;        // claimed for a block that is still being read in
+	void fit(u_int32_t block_sz);
+};
+
+/**
+ * @class BufferPool - fixed set of frames caching HeapFile blocks, with CLOCK replacement
+ *
+ * A block stays put in its frame while anyone has it pinned. Unpinned frames are
+ * recycled in CLOCK order: the hand sweeps the frames, giving each recently used one
+ * a second chance before evicting it. Dirty frames are written back when their last
+ * pin is released (write_back_on_unpin, the default) or otherwise when they are
+ * evicted, flushed, or at checkpoint().
+ *
+ * There is one pool for the whole engine, instance(). HeapFile goes through it for
+ * pin(), pin_new() and put() of pinned pages, and flushes and forgets its frames on close().
+ *
+ * Every method may be called from any thread; one latch guards the frames and the table.
+ * A miss reads its block without holding the latch (the frame is pinned and marked
+ * loading), so threads scanning different blocks read them in at the same time, while a
+ * thread wanting a block that is on its way in waits for it rather than reading it again.
+ */
+class BufferPool {
+public:
+	static const u_int32_t DEFAULT_FRAMES = 256;
+
+	/**
+	 * @returns  the engine's buffer pool
+	 */
+	static BufferPool& instance();
+
+	BufferPool(u_int32_t num_frames=DEFAULT_FRAMES);
+	virtual ~BufferPool();
+	BufferPool(const BufferPool& other) = delete;
+	BufferPool(BufferPool&& temp) = delete;
+	BufferPool& operator=(const BufferPool& other) = delete;
+	BufferPool& operator=(BufferPool&& temp) = delete;
+
+	/**
+	 * Pin a block, reading it in if it isn't already here.
+	 * @param file      file the block belongs to
+	 * @param block_id  which block
+	 * @returns         the frame holding the block (unpin when done)
+	 * @throws          BufferPoolError if every frame is pinned
+	 */
+	virtual BufferFrame* pin(HeapFile* file, BlockID block_id);
+
+	/**
+	 * Pin a frame for a block that isn't in the file yet, as an empty page (no read).
+	 * @param file      file the block will belong to
+	 * @param block_id  which block
+	 * @returns         the frame holding the new block (unpin when done)
+	 * @throws          BufferPoolError if every frame is pinned
+	 */
+	virtual BufferFrame* pin_new(HeapFile* file, BlockID block_id);
+
+	/**
+	 * Release one pin on a frame.
+	 * @param frame  as returned by pin() or pin_new()
+	 */
+	virtual void unpin(BufferFrame* frame);
+
+	/**
+	 * Note that a pinned frame's block has changed and must be written back.
+	 * @param frame  as returned by pin() or pin_new()
+	 */
+	virtual void mark_dirty(BufferFrame* frame);
+
+	/**
+	 * @param file      file the block belongs to
+	 * @param block_id  which block
+	 * @returns         the frame holding the block, or nullptr if it isn't cached
+	 */
+	virtual BufferFrame* lookup(HeapFile* file, BlockID block_id);
+
+	/**
+	 * Write back one block if it is cached and dirty.
+	 * @param file      file the block belongs to
+	 * @param block_id  which block
+	 */
+	virtual void flush(HeapFile* file, BlockID block_id);
+
+	/**
+	 * Write back every dirty block of a file, then forget all its frames.
+	 * Frames still pinned are detached from the file and freed on their last unpin.
+	 * @param file  the file being closed
+	 */
+	virtual void release(HeapFile* file);
+
+	/**
+	 * Write back every dirty frame in the pool.
+	 */
+	virtual void checkpoint();
+
+	/**
+	 * When true (the default), a dirty frame is written as soon as its last pin is released;
+	 * when false, writes wait for eviction, flush or checkpoint.
+	 */
+	bool write_back_on_unpin;
+
+	// counters
+	u_int32_t get_num_frames() {return (u_int32_t)frames.size();}
+	u_int64_t get_hits() {return hits;}
+	u_int64_t get_misses() {return misses;}
+	u_int64_t get_evictions() {return evictions;}
+	u_int64_t get_writes() {return writes;}
+
+protected:
+	typedef std::pair<HeapFile*, BlockID> FrameKey;
+	struct FrameKeyHash {
+		size_t operator()(const FrameKey& key) const {
+			return std::hash<void*>()(key.first) ^ (std::hash<BlockID>()(key.second) * 0x9e3779b1u);
+		}
+	};
+
+	std::vector<BufferFrame*> frames;
+	std::unordered_map<FrameKey, BufferFrame*, FrameKeyHash> table;
+	std::mutex latch;
+	std::condition_variable loaded;  // some frame's read finished
+	u_int32_t hand;
+	u_int64_t hits;
+	u_int64_t misses;
+	u_int64_t evictions;
+	u_int64_t writes;
+
+	virtual BufferFrame* find(HeapFile* file, BlockID block_id);
+	virtual BufferFrame* victim();
+	virtual BufferFrame* claim(HeapFile* file, BlockID block_id);
+	virtual void write(BufferFrame* frame);
+};
@@ -0,0 +1,162 @@
+/**
+ * @file catalog.cpp - implementation of the table catalog.
+ * Catalog
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "catalog.h"
+#include <algorithm>
+#include <set>
+using namespace std;
+
+const Identifier Catalog::COLUMNS_TABLE = "_columns";
+
+static ColumnNames columns_column_names() {
+	return ColumnNames{"table_name", "column_name", "position", "data_type"};
+}
+
+static ColumnAttributes columns_column_attributes() {
+	return ColumnAttributes{ColumnAttribute(ColumnAttribute::TEXT), ColumnAttribute(ColumnAttribute::TEXT),
+		ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+}
+
+
+/**************************Catalog Implementation*********************/
+
+Catalog::~Catalog() {
+	close();
+}
+
+void Catalog::open() {
+	if (this->columns != nullptr)
+		return;
+	this->columns = new HeapTable(this->columns_table, columns_column_names(), columns_column_attributes());
+	this->columns->create_if_not_exists();
+}
+
+void Catalog::close() {
+	for (auto const& table : this->tables) {
+		table.second->close();
+		delete table.second;
+	}
+	this->tables.clear();
+	if (this->columns != nullptr) {
+		this->columns->close();
+		delete this->columns;
+		this->columns = nullptr;
+	}
+}
+
+//The table's file first, so a failed create leaves no schema behind
+DbRelation& Catalog::create_table(const Identifier& name, const ColumnNames& column_names,
+		const ColumnAttributes& column_attributes, bool if_not_exists) {
+	if (has_table(name)) {
+		if (if_not_exists)
+			return get_table(name);
+		throw DbRelationError("table " + name + " already exists");
+	}
+	if (column_names.empty() || column_names.size() != column_attributes.size())
+		throw DbRelationError("table " + name + " needs a type for each of its columns");
+	set<Identifier> seen;
+	for (auto const& column_name : column_names)
+		if (!seen.insert(column_name).second)
+			throw DbRelationError("column " + column_name + " is named twice");
+
+	HeapTable* table = new HeapTable(name, column_names, column_attributes);
+	try {
+		table->create();
+	}
+	catch (...) {
+		delete table;
+		throw;
+	}
+	Row row(4);
+	for (u_int32_t i = 0; i < column_names.size(); i++) {
+		row.set_text(0, name);
+		row.set_text(1, column_names[i]);
+		row.set_int(2, (int32_t)i);
+		row.set_text(3, column_attributes[i].get_data_type() == ColumnAttribute::INT ? "INT" : "TEXT");
+		this->columns->insert(&row);
+		row.clear();
+	}
+	this->tables[name] = table;
+	return *table;
+}
+
+DbRelation& Catalog::get_table(const Identifier& name) {
+	auto it = this->tables.find(name);
+	if (it != this->tables.end())
+		return *it->second;
+	ColumnNames column_names;
+	ColumnAttributes column_attributes;
+	if (!read_schema(name, column_names, column_attributes))
+		throw DbRelationError("table " + name + " does not exist");
+	HeapTable* table = new HeapTable(name, column_names, column_attributes);
+	try {
+		table->open();
+	}
+	catch (...) {
+		delete table;
+		throw;
+	}
+	this->tables[name] = table;
+	return *table;
+}
+
+bool Catalog::has_table(const Identifier& name) {
+	if (this->tables.count(name) > 0)
+		return true;
+	ColumnNames column_names;
+	ColumnAttributes column_attributes;
+	return read_schema(name, column_names, column_attributes);
+}
+
+void Catalog::drop() {
+	open();
+	set<Identifier> names;
+	ColumnNames table_name{"table_name"};
+	Handles* handles = this->columns->select();
+	for (auto const& handle : *handles) {
+		ValueDict* row = this->columns->project(handle, &table_name);
+		names.insert((*row)["table_name"].s);
+		delete row;
+	}
+	delete handles;
+	for (auto const& name : names) {
+		get_table(name).drop();
+		delete this->tables[name];
+		this->tables.erase(name);
+	}
+	this->columns->drop();
+	delete this->columns;
+	this->columns = nullptr;
+}
+
+//The rows can be in any order in the file, so they're put back in column order by position
+bool Catalog::read_schema(const Identifier& name, ColumnNames& column_names, ColumnAttributes& column_attributes) {
+	open();
+	ValueDict where;
+	where["table_name"] = Value(name);
+	vector<pair<int32_t, Handle>> positions;
+	ColumnNames position{"position"};
+	HandleCursor* cursor = this->columns->select_cursor(&where);
+	Handle handle;
+	while (cursor->next(handle)) {
+		ValueDict* row = this->columns->project(handle, &position);
+		positions.push_back(make_pair((*row)["position"].n, handle));
+		delete row;
+	}
+	delete cursor;
+	sort(positions.begin(), positions.end());
+
+	column_names.clear();
+	column_attributes.clear();
+	for (auto const& column : positions) {
+		ValueDict* row = this->columns->project(column.second);
+		column_names.push_back((*row)["column_name"].s);
+		column_attributes.push_back(ColumnAttribute((*row)["data_type"].s == "INT" ? ColumnAttribute::INT
+			: ColumnAttribute::TEXT));
+		delete row;
+	}
+	return !column_names.empty();
+}
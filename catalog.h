@@ -0,0 +1,80 @@
+/**
+ * @file catalog.h - Where the shell's tables and their columns are recorded.
+ * Catalog
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <map>
+#include <string>
+#include "heap_storage.h"
+
+/**
+ * @class Catalog - the tables made with CREATE TABLE, by name
+ *
+ * Each table's columns are rows of a HeapTable of its own (COLUMNS_TABLE): table_name,
+ * column_name, position and data_type ("INT" or "TEXT"). A table is opened the first time
+ * it is asked for and kept open until the catalog is closed, so a statement gets an open
+ * HeapTable without reading the schema again.
+ */
+class Catalog {
+public:
+	static const Identifier COLUMNS_TABLE;  // "_columns"
+
+	/**
+	 * @param columns_table  name of the table the schemas are kept in
+	 */
+	Catalog(Identifier columns_table=COLUMNS_TABLE) : columns_table(columns_table), columns(nullptr), tables() {}
+	virtual ~Catalog();
+	Catalog(const Catalog& other) = delete;
+	Catalog(Catalog&& temp) = delete;
+	Catalog& operator=(const Catalog& other) = delete;
+	Catalog& operator=(Catalog&& temp) = delete;
+
+	/**
+	 * Open the schemas table, creating it the first time.
+	 */
+	virtual void open();
+
+	/**
+	 * Close every open table and the schemas table.
+	 */
+	virtual void close();
+
+	/**
+	 * Execute: CREATE TABLE [IF NOT EXISTS] <name> ( <columns> )
+	 * @param name               new table's name
+	 * @param column_names       its columns
+	 * @param column_attributes  their types
+	 * @param if_not_exists      hand back the existing table instead of throwing if there is one
+	 * @returns                  the open table
+	 * @throws                   DbRelationError if the table exists or a column is named twice
+	 */
+	virtual DbRelation& create_table(const Identifier& name, const ColumnNames& column_names,
+		const ColumnAttributes& column_attributes, bool if_not_exists=false);
+
+	/**
+	 * @param name  a table's name
+	 * @returns     the table, open
+	 * @throws      DbRelationError if there is no such table
+	 */
+	virtual DbRelation& get_table(const Identifier& name);
+
+	/**
+	 * @param name  a table's name
+	 * @returns     true if it was created
+	 */
+	virtual bool has_table(const Identifier& name);
+
+	/**
+	 * Drop every table in the catalog, and the schemas table itself.
+	 */
+	virtual void drop();
+
+protected:
+	Identifier columns_table;
+	HeapTable* columns;
+	std::map<Identifier, HeapTable*> tables;  // the ones opened so far
+	virtual bool read_schema(const Identifier& name, ColumnNames& column_names, ColumnAttributes& column_attributes);
+};
@@ -0,0 +1,2320 @@
+/**
+ * @file executor.cpp - implementation of the query operators.
+ * Expression
+ * TableScan: Operator
+ * ParallelScan: TableScan
+ * Filter: Operator
+ * Project: Operator
+ * Limit: Operator
+ * HashJoin: Operator
+ * Sort: Operator
+ * HashAggregate: Operator
+ * TableCount: Operator
+ * PreparedStatement
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "executor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unistd.h>
+#include "catalog.h"
+using namespace std;
+
+static inline bool compared(Expression::Op op, int order) {
+	switch (op) {
+	case Expression::EQ:
+		return order == 0;
+	case Expression::NE:
+		return order != 0;
+	case Expression::LT:
+		return order < 0;
+	case Expression::LE:
+		return order <= 0;
+	case Expression::GT:
+		return order > 0;
+	default:
+		return order >= 0;
+	}
+}
+
+static inline int order_of(int32_t a, int32_t b) {
+	return a < b ? -1 : a > b ? 1 : 0;
+}
+
+static inline int order_of(const RecordView& a, const RecordView& b) {
+	int order = memcmp(a.data, b.data, min(a.size, b.size));
+	return order != 0 ? order : a.size < b.size ? -1 : a.size > b.size ? 1 : 0;
+}
+
+// the other way around: a < b is b > a
+static Expression::Op flipped(Expression::Op op) {
+	switch (op) {
+	case Expression::LT:
+		return Expression::GT;
+	case Expression::LE:
+		return Expression::GE;
+	case Expression::GT:
+		return Expression::LT;
+	case Expression::GE:
+		return Expression::LE;
+	default:
+		return op;
+	}
+}
+
+class ColumnExpression : public Expression {
+public:
+	ColumnExpression(u_int32_t position, ColumnAttribute::DataType data_type)
+		: Expression(data_type), position(position) {}
+	virtual int32_t eval_int(const Row& row) const {return row.get_int(position);}
+	virtual RecordView eval_text(const Row& row) const {return row.get_text(position);}
+
+	u_int32_t position;
+};
+
+class IntLiteral : public Expression {
+public:
+	IntLiteral(int32_t n) : Expression(ColumnAttribute::INT), n(n) {}
+	virtual int32_t eval_int(const Row& row) const {return n;}
+	virtual RecordView eval_text(const Row& row) const {return RecordView();}
+
+	int32_t n;
+};
+
+class TextLiteral : public Expression {
+public:
+	TextLiteral(const string& s) : Expression(ColumnAttribute::TEXT), s(s) {}
+	virtual int32_t eval_int(const Row& row) const {return 0;}
+	virtual RecordView eval_text(const Row& row) const {return RecordView(s.data(), (u_int32_t)s.length());}
+
+	string s;
+};
+
+class ParameterExpression : public Expression {
+public:
+	ParameterExpression(const Parameters* parameters, u_int32_t index, ColumnAttribute::DataType data_type)
+		: Expression(data_type), parameters(parameters), index(index) {}
+	virtual int32_t eval_int(const Row& row) const {return (*parameters)[index].n;}
+	virtual RecordView eval_text(const Row& row) const {
+		const std::string &s = (*parameters)[index].s;
+		return RecordView(s.data(), (u_int32_t)s.length());
+	}
+
+protected:
+	const Parameters* parameters;
+	u_int32_t index;
+};
+
+// the common case for a WHERE clause, without the two virtual calls for the operands
+class IntColumnComparison : public Expression {
+public:
+	IntColumnComparison(Op op, u_int32_t position, int32_t n) : Expression(ColumnAttribute::INT), op(op),
+		position(position), n(n) {}
+	virtual int32_t eval_int(const Row& row) const {return compared(op, order_of(row.get_int(position), n));}
+	virtual RecordView eval_text(const Row& row) const {return RecordView();}
+
+protected:
+	Op op;
+	u_int32_t position;
+	int32_t n;
+};
+
+class BinaryExpression : public Expression {
+public:
+	BinaryExpression(Op op, Expression* left, Expression* right)
+		: Expression(ColumnAttribute::INT), op(op), left(left), right(right) {}
+	virtual ~BinaryExpression() {
+		delete left;
+		delete right;
+	}
+	virtual RecordView eval_text(const Row& row) const {return RecordView();}
+
+protected:
+	Op op;
+	Expression* left;
+	Expression* right;
+};
+
+class Comparison : public BinaryExpression {
+public:
+	Comparison(Op op, Expression* left, Expression* right) : BinaryExpression(op, left, right) {}
+	virtual int32_t eval_int(const Row& row) const {
+		if (left->get_data_type() == ColumnAttribute::INT)
+			return compared(op, order_of(left->eval_int(row), right->eval_int(row)));
+		return compared(op, order_of(left->eval_text(row), right->eval_text(row)));
+	}
+};
+
+class Logic : public BinaryExpression {
+public:
+	Logic(Op op, Expression* left, Expression* right) : BinaryExpression(op, left, right) {}
+	virtual int32_t eval_int(const Row& row) const {
+		if (op == AND)
+			return left->eval_int(row) != 0 && right->eval_int(row) != 0;
+		return left->eval_int(row) != 0 || right->eval_int(row) != 0;
+	}
+};
+
+// wraps around on overflow (done unsigned, where that's defined)
+class Arithmetic : public BinaryExpression {
+public:
+	Arithmetic(Op op, Expression* left, Expression* right) : BinaryExpression(op, left, right) {}
+	virtual int32_t eval_int(const Row& row) const {
+		u_int32_t a = (u_int32_t)left->eval_int(row);
+		int32_t b = right->eval_int(row);
+		switch (op) {
+		case PLUS:
+			return (int32_t)(a + (u_int32_t)b);
+		case MINUS:
+			return (int32_t)(a - (u_int32_t)b);
+		case TIMES:
+			return (int32_t)(a * (u_int32_t)b);
+		default:
+			if (b == 0)
+				throw DbRelationError("division by zero");
+			if (b == -1)
+				return op == DIVIDE ? (int32_t)(0u - a) : 0;
+			return op == DIVIDE ? (int32_t)a / b : (int32_t)a % b;
+		}
+	}
+};
+
+class UnaryExpression : public Expression {
+public:
+	UnaryExpression(Op op, Expression* operand) : Expression(ColumnAttribute::INT), op(op), operand(operand) {}
+	virtual ~UnaryExpression() {delete operand;}
+	virtual int32_t eval_int(const Row& row) const {
+		int32_t n = operand->eval_int(row);
+		return op == NOT ? n == 0 : (int32_t)(0u - (u_int32_t)n);
+	}
+	virtual RecordView eval_text(const Row& row) const {return RecordView();}
+
+protected:
+	Op op;
+	Expression* operand;
+};
+
+
+/**************************Expression Implementation*********************/
+
+Expression* Expression::column(u_int32_t position, ColumnAttribute::DataType data_type) {
+	return new ColumnExpression(position, data_type);
+}
+
+Expression* Expression::literal(int32_t n) {
+	return new IntLiteral(n);
+}
+
+Expression* Expression::literal(const std::string& s) {
+	return new TextLiteral(s);
+}
+
+Expression* Expression::parameter(const Parameters* parameters, u_int32_t index, ColumnAttribute::DataType data_type) {
+	return new ParameterExpression(parameters, index, data_type);
+}
+
+Expression* Expression::unary(Op op, Expression* operand) {
+	if ((op != NOT && op != NEGATE) || operand->get_data_type() != ColumnAttribute::INT) {
+		delete operand;
+		throw DbRelationError(op == NOT || op == NEGATE ? "TEXT operand for an INT operator" : "not a unary operator");
+	}
+	return new UnaryExpression(op, operand);
+}
+
+//An INT column against an INT literal, either way around, gets a node of its own
+Expression* Expression::binary(Op op, Expression* left, Expression* right) {
+	if (op == NOT || op == NEGATE || (Expression::is_comparison(op) && left->get_data_type() != right->get_data_type())
+			|| (!Expression::is_comparison(op) && (left->get_data_type() != ColumnAttribute::INT
+			|| right->get_data_type() != ColumnAttribute::INT))) {
+		delete left;
+		delete right;
+		throw DbRelationError(op == NOT || op == NEGATE ? "not a binary operator"
+			: Expression::is_comparison(op) ? "can't compare INT with TEXT" : "TEXT operand for an INT operator");
+	}
+	if (!Expression::is_comparison(op))
+		return op == AND || op == OR ? (Expression*)new Logic(op, left, right) : new Arithmetic(op, left, right);
+	if (left->get_data_type() == ColumnAttribute::INT) {
+		ColumnExpression* column = dynamic_cast<ColumnExpression*>(left);
+		IntLiteral* literal = dynamic_cast<IntLiteral*>(right);
+		if (column == nullptr || literal == nullptr) {
+			column = dynamic_cast<ColumnExpression*>(right);
+			literal = dynamic_cast<IntLiteral*>(left);
+			if (column != nullptr && literal != nullptr)
+				op = flipped(op);
+		}
+		if (column != nullptr && literal != nullptr) {
+			Expression* comparison = new IntColumnComparison(op, column->position, literal->n);
+			delete left;
+			delete right;
+			return comparison;
+		}
+	}
+	return new Comparison(op, left, right);
+}
+
+
+/**************************TableScan Implementation*********************/
+
+TableScan::TableScan(DbRelation& table, const ColumnNames* columns, const ValueDict* where)
+: Operator(table.get_column_names(), table.get_column_attributes()), table(table),
+  columns(columns == nullptr ? ColumnNames() : *columns), all_columns(columns == nullptr), where(), cursor(nullptr) {
+	if (!this->all_columns && this->columns == this->column_names)  // decoding the whole record is quicker
+		this->all_columns = true;
+	if (where == nullptr)
+		return;
+	for (auto const& test : *where)
+		add_where(test.first, test.second.data_type == ColumnAttribute::INT ? Expression::literal(test.second.n)
+			: Expression::literal(test.second.s));
+}
+
+TableScan::~TableScan() {
+	delete this->cursor;
+	for (auto const& test : this->where)
+		delete test.second;
+}
+
+void TableScan::add_where(const Identifier& column_name, Expression* value) {
+	this->where.push_back(make_pair(column_name, value));
+}
+
+void TableScan::open() {
+	close();
+	if (this->where.empty()) {
+		this->cursor = this->table.select_cursor();
+	}
+	else {
+		Row none;
+		ValueDict where;
+		for (auto const& test : this->where)
+			where[test.first] = test.second->get(none);
+		this->cursor = this->table.select_cursor(&where);
+	}
+}
+
+//A few columns decoded into a Row that held a longer one would pile up in its overflow, so it's cleared first
+bool TableScan::next(RowBatch& batch) {
+	batch.size = 0;
+	if (this->cursor == nullptr)
+		return false;
+	Handle handle;
+	while (!batch.is_full() && this->cursor->next(handle)) {
+		Row& row = batch.add();
+		if (!this->all_columns)
+			row.clear();
+		this->table.project(handle, this->all_columns ? nullptr : &this->columns, &row);
+	}
+	return batch.size > 0;
+}
+
+void TableScan::close() {
+	delete this->cursor;
+	this->cursor = nullptr;
+}
+
+
+/**************************ParallelScan Implementation*********************/
+
+const u_int32_t ParallelScan::MORSEL_BLOCKS;
+const u_int32_t ParallelScan::QUEUED_BATCHES;
+
+ParallelScan::ParallelScan(DbRelation& table, u_int32_t workers, const ColumnNames* columns, const ValueDict* where)
+: TableScan(table, columns, where), workers(max(workers, 1u)), positions(), morsels(), claimed(0), threads(), latch(),
+  queued(), taken(), full(), spare(), current(nullptr), offset(0), running(0), stopping(false), error() {
+	for (auto const& column_name : this->columns) {
+		auto found = find(this->column_names.begin(), this->column_names.end(), column_name);
+		if (found == this->column_names.end())
+			throw DbRelationError("unknown column " + column_name);
+		this->positions.push_back((u_int32_t)(found - this->column_names.begin()));
+	}
+}
+
+ParallelScan::~ParallelScan() {
+	close();
+	for (RowBatch* batch : this->spare)
+		delete batch;
+}
+
+u_int32_t ParallelScan::default_workers() {
+	return max(thread::hardware_concurrency(), 1u);
+}
+
+//The cursors are all made here, on the caller's thread, so the workers only read blocks
+void ParallelScan::open() {
+	close();
+	Row none;
+	ValueDict where;
+	for (auto const& test : this->where)
+		where[test.first] = test.second->get(none);
+	this->table.open();
+	u_int32_t blocks = this->table.get_block_count();
+	for (BlockID first = 1; first <= blocks; first += MORSEL_BLOCKS)
+		this->morsels.push_back(this->table.select_cursor(this->where.empty() ? nullptr : &where, first,
+			first + MORSEL_BLOCKS - 1));
+	this->claimed = 0;
+	this->stopping = false;
+	lock_guard<mutex> lock(this->latch);  // so no worker finishes before running counts it
+	u_int32_t n = min(this->workers, (u_int32_t)this->morsels.size());
+	for (u_int32_t i = 0; i < n; i++) {
+		this->threads.push_back(thread(&ParallelScan::work, this));
+		this->running++;
+	}
+}
+
+//Rows of the queued batches are swapped into the caller's, so no value is copied. With some
+//rows already in hand, we don't wait for more.
+bool ParallelScan::next(RowBatch& batch) {
+	batch.size = 0;
+	while (!batch.is_full()) {
+		if (this->current == nullptr || this->offset == this->current->size) {
+			unique_lock<mutex> lock(this->latch);
+			if (this->current != nullptr) {
+				this->current->size = 0;
+				this->spare.push_back(this->current);
+				this->current = nullptr;
+			}
+			if (batch.size > 0 && this->full.empty())
+				break;
+			this->queued.wait(lock, [this] {return this->error || !this->full.empty() || this->running == 0;});
+			if (this->error)
+				rethrow_exception(this->error);
+			if (this->full.empty())
+				break;
+			this->current = this->full.front();
+			this->full.pop_front();
+			this->offset = 0;
+			this->taken.notify_one();
+		}
+		swap(batch.add(), this->current->rows[this->offset++]);
+	}
+	return batch.size > 0;
+}
+
+//Batches are kept for the next open(); cursors a worker didn't get to are freed
+void ParallelScan::close() {
+	{
+		lock_guard<mutex> lock(this->latch);
+		this->stopping = true;
+	}
+	this->taken.notify_all();
+	for (auto& worker : this->threads)
+		worker.join();
+	this->threads.clear();
+	for (HandleCursor* cursor : this->morsels)
+		delete cursor;
+	this->morsels.clear();
+	if (this->current != nullptr)
+		this->full.push_back(this->current);
+	this->current = nullptr;
+	for (RowBatch* batch : this->full) {
+		batch->size = 0;
+		this->spare.push_back(batch);
+	}
+	this->full.clear();
+	this->running = 0;
+	this->error = nullptr;
+}
+
+//One worker: runs of blocks until there are none left, the scan is closing, or something fails
+void ParallelScan::work() {
+	RowBatch* batch = nullptr;
+	try {
+		bool going = hand_over(batch);
+		for (u_int32_t i = this->claimed++; going && i < this->morsels.size(); i = this->claimed++) {
+			HandleCursor* cursor = this->morsels[i];
+			Handle handle;
+			while (going && cursor->next(handle)) {
+				Row& row = batch->add();
+				if (!this->all_columns)
+					row.clear();
+				cursor->project(this->all_columns ? nullptr : &this->positions, &row);
+				if (batch->is_full())
+					going = hand_over(batch);
+			}
+			delete cursor;
+			this->morsels[i] = nullptr;
+		}
+		if (going && batch->size > 0)
+			hand_over(batch);
+	}
+	catch (...) {
+		lock_guard<mutex> lock(this->latch);
+		if (!this->error)
+			this->error = current_exception();
+		this->stopping = true;  // the others may as well quit too
+		this->taken.notify_all();
+	}
+	lock_guard<mutex> lock(this->latch);
+	if (batch != nullptr) {
+		batch->size = 0;
+		this->spare.push_back(batch);
+	}
+	this->running--;
+	this->queued.notify_all();
+}
+
+//Queue a worker's full batch, once there's room, and get it an empty one. Returns false
+//(keeping the batch for close() to recycle) if the scan is closing.
+bool ParallelScan::hand_over(RowBatch*& batch) {
+	unique_lock<mutex> lock(this->latch);
+	if (batch != nullptr) {
+		this->taken.wait(lock, [this] {return this->stopping || this->full.size() < QUEUED_BATCHES * this->workers;});
+		if (this->stopping) {
+			batch->size = 0;
+			this->spare.push_back(batch);
+			batch = nullptr;
+			return false;
+		}
+		this->full.push_back(batch);
+		batch = nullptr;
+		this->queued.notify_one();
+	}
+	if (this->stopping) {
+		batch = nullptr;
+		return false;
+	}
+	if (this->spare.empty()) {
+		batch = new RowBatch();
+	}
+	else {
+		batch = this->spare.back();
+		this->spare.pop_back();
+	}
+	return true;
+}
+
+
+/**************************Filter Implementation*********************/
+
+Filter::Filter(Operator* input, Expression* predicate)
+: Operator(input->get_column_names(), input->get_column_attributes()), input(input), predicate(predicate) {
+	if (predicate->get_data_type() != ColumnAttribute::INT) {
+		delete input;
+		delete predicate;
+		throw DbRelationError("a TEXT expression can't be a condition");
+	}
+}
+
+Filter::~Filter() {
+	delete this->input;
+	delete this->predicate;
+}
+
+//The rows that pass are swapped down to the front of the batch, keeping every Row's memory in it
+bool Filter::next(RowBatch& batch) {
+	while (this->input->next(batch)) {
+		u_int32_t kept = 0;
+		for (u_int32_t i = 0; i < batch.size; i++) {
+			if (this->predicate->eval_int(batch.rows[i]) == 0)
+				continue;
+			if (kept != i)
+				swap(batch.rows[kept], batch.rows[i]);
+			kept++;
+		}
+		batch.size = kept;
+		if (kept > 0)
+			return true;
+	}
+	return false;
+}
+
+
+/**************************Project Implementation*********************/
+
+static ColumnAttributes attributes_of(const vector<Expression*>& expressions) {
+	ColumnAttributes column_attributes;
+	for (Expression* expression : expressions)
+		column_attributes.push_back(ColumnAttribute(expression->get_data_type()));
+	return column_attributes;
+}
+
+Project::Project(Operator* input, const vector<Expression*>& expressions, const ColumnNames& column_names)
+: Operator(column_names, attributes_of(expressions)), input(input), expressions(expressions), incoming() {
+	if (expressions.size() != column_names.size()) {
+		delete input;
+		for (Expression* expression : expressions)
+			delete expression;
+		throw DbRelationError("a projection needs a name for each expression");
+	}
+}
+
+Project::~Project() {
+	delete this->input;
+	for (Expression* expression : this->expressions)
+		delete expression;
+}
+
+bool Project::next(RowBatch& batch) {
+	batch.size = 0;
+	if (this->incoming.get_capacity() != batch.get_capacity())
+		this->incoming = RowBatch(batch.get_capacity());
+	if (!this->input->next(this->incoming))
+		return false;
+	u_int32_t num_columns = (u_int32_t)this->expressions.size();
+	for (u_int32_t i = 0; i < this->incoming.size; i++) {
+		Row& row = batch.add();
+		if (row.size() != num_columns)
+			row.resize(num_columns);
+		row.clear();
+		for (u_int32_t column = 0; column < num_columns; column++)
+			this->expressions[column]->eval(this->incoming.rows[i], column, row);
+	}
+	return true;
+}
+
+
+/**************************Limit Implementation*********************/
+
+Limit::Limit(Operator* input, u_int64_t limit, u_int64_t offset)
+: Operator(input->get_column_names(), input->get_column_attributes()), input(input), limit(limit), offset(offset),
+  skipped(0), returned(0) {}
+
+Limit::~Limit() {
+	delete this->input;
+}
+
+void Limit::open() {
+	this->skipped = 0;
+	this->returned = 0;
+	this->input->open();
+}
+
+//Once limit rows are out, next() stops without asking the input for any more
+bool Limit::next(RowBatch& batch) {
+	batch.size = 0;
+	while (this->returned < this->limit && this->input->next(batch)) {
+		u_int32_t start = 0;
+		if (this->skipped < this->offset) {
+			start = (u_int32_t)min<u_int64_t>(this->offset - this->skipped, batch.size);
+			this->skipped += start;
+		}
+		u_int32_t count = (u_int32_t)min<u_int64_t>(this->limit - this->returned, batch.size - start);
+		for (u_int32_t i = 0; i < count && start > 0; i++)
+			swap(batch.rows[i], batch.rows[start + i]);
+		batch.size = count;
+		this->returned += count;
+		if (count > 0)
+			return true;
+	}
+	batch.size = 0;
+	return false;
+}
+
+
+/**************************HashJoin Implementation*********************/
+
+static ColumnNames joined_names(const Operator* left, const Operator* right) {
+	ColumnNames column_names = left->get_column_names();
+	column_names.insert(column_names.end(), right->get_column_names().begin(), right->get_column_names().end());
+	return column_names;
+}
+
+static ColumnAttributes joined_attributes(const Operator* left, const Operator* right) {
+	ColumnAttributes column_attributes = left->get_column_attributes();
+	column_attributes.insert(column_attributes.end(), right->get_column_attributes().begin(),
+		right->get_column_attributes().end());
+	return column_attributes;
+}
+
+// buckets come from a hash's low bits and partitions from its high bits, so all of them have to be mixed
+static inline u_int32_t mix(u_int32_t h) {
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+static inline u_int32_t hash_key(const Row& row, u_int32_t column) {
+	if (row.get_data_type(column) == ColumnAttribute::INT)
+		return mix((u_int32_t)row.get_int(column));
+	RecordView text = row.get_text(column);
+	u_int32_t h = 2166136261u;  // FNV-1a
+	for (u_int32_t i = 0; i < text.size; i++)
+		h = (h ^ (unsigned char)text.data[i]) * 16777619u;
+	return mix(h);
+}
+
+static inline bool same_key(const Row& a, u_int32_t a_column, const Row& b, u_int32_t b_column) {
+	if (a.get_data_type(a_column) == ColumnAttribute::INT)
+		return a.get_int(a_column) == b.get_int(b_column);
+	RecordView x = a.get_text(a_column), y = b.get_text(b_column);
+	return x.size == y.size && memcmp(x.data, y.data, x.size) == 0;
+}
+
+static inline void copy_column(const Row& from, u_int32_t column, Row& to, u_int32_t to_column) {
+	if (from.get_data_type(column) == ColumnAttribute::INT) {
+		to.set_int(to_column, from.get_int(column));
+	}
+	else {
+		RecordView text = from.get_text(column);
+		to.set_text(to_column, text.data, text.size);
+	}
+}
+
+const u_int32_t HashJoin::PARTITIONS;
+const u_int32_t HashJoin::MAX_SPILL_LEVELS;
+const size_t HashJoin::DEFAULT_MEMORY_BUDGET;
+const u_int32_t HashJoin::NONE;
+
+static u_int32_t temporary_tables = 0;  // for naming them
+
+// a table for rows an operator can't hold in memory (with made-up column names, as a join's can repeat)
+static HeapTable* temporary_table(const string& prefix, const ColumnAttributes& column_attributes) {
+	ColumnNames column_names;
+	for (u_int32_t i = 0; i < column_attributes.size(); i++)
+		column_names.push_back("c" + to_string(i));
+	Identifier name = prefix + to_string(getpid()) + "_" + to_string(temporary_tables++);
+	HeapTable* table = new HeapTable(name, column_names, column_attributes);
+	try {
+		table->create();
+	}
+	catch (...) {
+		delete table;
+		throw;
+	}
+	return table;
+}
+
+// a copy of a row that can go into a temporary table: a column the operator below didn't decode is
+// INT 0 whatever its type, so a TEXT one becomes ''
+static void stage_row(const Row& row, const ColumnAttributes& column_attributes, Row& staged) {
+	staged.resize((u_int32_t)column_attributes.size());
+	staged.clear();
+	for (u_int32_t column = 0; column < column_attributes.size(); column++) {
+		if (row.get_data_type(column) == column_attributes[column].get_data_type())
+			copy_column(row, column, staged, column);
+		else if (column_attributes[column].get_data_type() == ColumnAttribute::TEXT)
+			staged.set_text(column, "", 0);
+	}
+}
+
+HashJoin::HashJoin(Operator* left, Operator* right, u_int32_t left_key, u_int32_t right_key, bool build_left,
+		size_t memory_budget)
+: Operator(joined_names(left, right), joined_attributes(left, right)), left(left), right(right), left_key(left_key),
+  right_key(right_key), build_left(build_left), memory_budget(memory_budget), built(), hashes(), chain(), buckets(),
+  memory(0), spilled(false), level(0), partitions(), pending(), joining({nullptr, nullptr, 0}), partitions_written(0),
+  cursor(nullptr), staged(), probe(), probe_row(0), probe_hash(0), match(NONE) {
+	if (left->get_column_attributes()[left_key].get_data_type() != right->get_column_attributes()[right_key].get_data_type()) {
+		delete left;
+		delete right;
+		throw DbRelationError("can't join an INT column with a TEXT one");
+	}
+}
+
+HashJoin::~HashJoin() {
+	close();
+	delete this->left;
+	delete this->right;
+}
+
+//The probe input isn't read at all when the build input has no rows
+void HashJoin::open() {
+	close();
+	this->spilled = false;
+	this->partitions_written = 0;
+	RowBatch batch(this->probe.get_capacity());
+	Operator* input = build_input();
+	input->open();
+	while (input->next(batch))
+		for (u_int32_t i = 0; i < batch.size; i++)
+			add_build_row(batch.rows[i], hash_key(batch.rows[i], build_key()));
+	input->close();
+
+	input = probe_input();
+	if (this->spilled) {
+		input->open();
+		while (input->next(batch))
+			for (u_int32_t i = 0; i < batch.size; i++)
+				spill_row(1, batch.rows[i], hash_key(batch.rows[i], probe_key()));
+		input->close();
+		finish_partitions();
+	}
+	else if (!this->built.empty()) {
+		index_build_rows();
+		input->open();
+	}
+}
+
+//A probe row's bucket is walked a build row at a time, so a batch can end partway along it
+bool HashJoin::next(RowBatch& batch) {
+	batch.size = 0;
+	u_int32_t left_columns = (u_int32_t)this->left->get_column_names().size();
+	u_int32_t right_columns = (u_int32_t)this->right->get_column_names().size();
+	while (!batch.is_full()) {
+		if (this->match == NONE) {
+			if (this->probe_row >= this->probe.size) {
+				if (!next_probe_batch())
+					break;
+				this->probe_row = 0;
+			}
+			this->probe_hash = hash_key(this->probe.rows[this->probe_row], probe_key());
+			this->match = this->buckets[this->probe_hash & (this->buckets.size() - 1)];
+			if (this->match == NONE) {
+				this->probe_row++;
+				continue;
+			}
+		}
+		u_int32_t candidate = this->match;
+		this->match = this->chain[candidate];
+		const Row& probed = this->probe.rows[this->probe_row];
+		const Row& found = this->built[candidate];
+		if (this->hashes[candidate] == this->probe_hash && same_key(found, build_key(), probed, probe_key())) {
+			const Row& left_row = this->build_left ? found : probed;
+			const Row& right_row = this->build_left ? probed : found;
+			Row& row = batch.add();
+			row.resize(left_columns + right_columns);
+			row.clear();
+			for (u_int32_t column = 0; column < left_columns; column++)
+				copy_column(left_row, column, row, column);
+			for (u_int32_t column = 0; column < right_columns; column++)
+				copy_column(right_row, column, row, left_columns + column);
+		}
+		if (this->match == NONE)
+			this->probe_row++;
+	}
+	return batch.size > 0;
+}
+
+void HashJoin::close() {
+	delete this->cursor;
+	this->cursor = nullptr;
+	this->left->close();
+	this->right->close();
+	drop_partitions();
+	this->built.clear();
+	this->hashes.clear();
+	this->chain.clear();
+	this->buckets.clear();
+	this->memory = 0;
+	this->level = 0;
+	this->probe.size = 0;
+	this->probe_row = 0;
+	this->match = NONE;
+}
+
+//Once this level's partitions are being written, the rest of the build rows go straight to them
+void HashJoin::add_build_row(const Row& row, u_int32_t hash) {
+	if (!this->partitions[0].empty()) {
+		spill_row(0, row, hash);
+		return;
+	}
+	this->built.push_back(row);
+	this->hashes.push_back(hash);
+	this->memory += row.memory_size();
+	if (this->memory > this->memory_budget && this->built.size() > 1 && this->level < MAX_SPILL_LEVELS)
+		spill();
+}
+
+//A power of 2 buckets, at least one per row
+void HashJoin::index_build_rows() {
+	size_t size = 1;
+	while (size < this->built.size())
+		size <<= 1;
+	this->buckets.assign(size, NONE);
+	this->chain.assign(this->built.size(), NONE);
+	for (u_int32_t i = 0; i < this->built.size(); i++) {
+		u_int32_t bucket = this->hashes[i] & (u_int32_t)(size - 1);
+		this->chain[i] = this->buckets[bucket];
+		this->buckets[bucket] = i;
+	}
+}
+
+//The build rows so far are the first to go out to the partitions
+void HashJoin::spill() {
+	this->spilled = true;
+	for (u_int32_t side = 0; side < 2; side++) {
+		const ColumnAttributes& column_attributes = (side == 0 ? build_input() : probe_input())->get_column_attributes();
+		for (u_int32_t i = 0; i < PARTITIONS; i++)
+			this->partitions[side].push_back(temporary_table("_join_", column_attributes));
+	}
+	this->partitions_written += PARTITIONS;
+	for (u_int32_t i = 0; i < this->built.size(); i++)
+		spill_row(0, this->built[i], this->hashes[i]);
+	Rows().swap(this->built);
+	this->hashes.clear();
+	this->memory = 0;
+}
+
+void HashJoin::spill_row(u_int32_t side, const Row& row, u_int32_t hash) {
+	stage_row(row, (side == 0 ? build_input() : probe_input())->get_column_attributes(), this->staged);
+	// each level splits on other bits of the hash than the one before
+	hash = mix(hash + this->level * 0x9e3779b9u);
+	u_int32_t partition = (u_int32_t)(((u_int64_t)hash * PARTITIONS) >> 32);
+	this->partitions[side][partition]->insert(&this->staged);
+}
+
+//Both inputs are written out, so this level's partitions are ready to join
+void HashJoin::finish_partitions() {
+	for (u_int32_t i = 0; i < PARTITIONS; i++)
+		this->pending.push_back({this->partitions[0][i], this->partitions[1][i], this->level + 1});
+	this->partitions[0].clear();
+	this->partitions[1].clear();
+}
+
+static void drop_temporary(DbRelation*& table) {
+	if (table == nullptr)
+		return;
+	table->drop();
+	delete table;
+	table = nullptr;
+}
+
+//The next pending build partition is read into the hash table, leaving its probe partition to join; one
+//that's still over the budget is split into the next level's partitions along with its probe partition
+void HashJoin::load_partition() {
+	this->joining = this->pending.back();
+	this->pending.pop_back();
+	this->level = this->joining.level;
+	this->built.clear();
+	this->hashes.clear();
+	this->memory = 0;
+	Row row;
+	Handle handle;
+	this->cursor = this->joining.build->select_cursor();
+	while (this->cursor->next(handle)) {
+		this->joining.build->project(handle, nullptr, &row);
+		add_build_row(row, hash_key(row, build_key()));
+	}
+	delete this->cursor;
+	this->cursor = nullptr;
+	drop_temporary(this->joining.build);
+
+	if (!this->partitions[0].empty()) {
+		this->cursor = this->joining.probe->select_cursor();
+		while (this->cursor->next(handle)) {
+			this->joining.probe->project(handle, nullptr, &row);
+			spill_row(1, row, hash_key(row, probe_key()));
+		}
+		delete this->cursor;
+		this->cursor = nullptr;
+		finish_partitions();
+	}
+	if (this->built.empty())
+		drop_temporary(this->joining.probe);
+}
+
+//Once spilled, probe rows come from one probe partition after another, each once its build partition is loaded
+bool HashJoin::next_probe_batch() {
+	this->probe.size = 0;
+	if (!this->spilled)
+		return !this->built.empty() && probe_input()->next(this->probe);
+	while (true) {
+		if (this->cursor != nullptr) {
+			Handle handle;
+			while (!this->probe.is_full() && this->cursor->next(handle))
+				this->joining.probe->project(handle, nullptr, &this->probe.add());
+			if (this->probe.size > 0)
+				return true;
+			delete this->cursor;
+			this->cursor = nullptr;
+			drop_temporary(this->joining.probe);
+		}
+		if (this->pending.empty())
+			return false;
+		load_partition();
+		if (this->joining.probe != nullptr) {
+			index_build_rows();
+			this->cursor = this->joining.probe->select_cursor();
+		}
+	}
+}
+
+void HashJoin::drop_partitions() {
+	for (u_int32_t side = 0; side < 2; side++) {
+		for (DbRelation* table : this->partitions[side])
+			drop_temporary(table);
+		this->partitions[side].clear();
+	}
+	for (Partition& partition : this->pending) {
+		drop_temporary(partition.build);
+		drop_temporary(partition.probe);
+	}
+	this->pending.clear();
+	drop_temporary(this->joining.build);
+	drop_temporary(this->joining.probe);
+}
+
+
+/**************************Sort Implementation*********************/
+
+const u_int64_t Sort::NO_LIMIT;
+const size_t Sort::DEFAULT_MEMORY_BUDGET;
+const u_int32_t Sort::MERGE_FAN_IN;
+const u_int32_t Sort::NONE;
+
+Sort::Sort(Operator* input, const Keys& keys, u_int64_t limit, size_t memory_budget)
+: Operator(input->get_column_names(), input->get_column_attributes()), input(input), keys(keys), limit(limit),
+  memory_budget(memory_budget), whole_keys(keys.size() <= 4), rows(), entries(), memory(0), has_cutoff(false),
+  cutoff(), cutoff_row(), runs(), runs_written(0), next_entry(0), cursors(), heads(), head_entries(), tree(),
+  returned(0) {
+	for (auto const& key : keys)
+		if (this->column_attributes[key.column].get_data_type() == ColumnAttribute::TEXT)
+			this->whole_keys = false;
+}
+
+Sort::~Sort() {
+	close();
+	delete this->input;
+}
+
+//Runs go out as the rows come in; what is held at the end is sorted in memory, or is the last run
+void Sort::open() {
+	close();
+	this->runs_written = 0;
+	RowBatch batch;
+	this->input->open();
+	while (this->input->next(batch))
+		for (u_int32_t i = 0; i < batch.size; i++)
+			add(batch.rows[i]);
+	this->input->close();
+	if (this->runs.empty()) {
+		sort_entries();
+		return;
+	}
+	if (!this->entries.empty())
+		write_run();
+
+	// too many runs to merge at once: the first MERGE_FAN_IN are merged into one more at the end
+	while (this->runs.size() > MERGE_FAN_IN) {
+		open_runs(MERGE_FAN_IN);
+		HeapTable* merged = temporary_table("_sort_", this->column_attributes);
+		this->runs.push_back(merged);
+		this->runs_written++;
+		Rows sorted;
+		for (u_int64_t count = 0; count < this->limit && this->head_entries[this->tree[0]].row != NONE; count++) {
+			u_int32_t winner = this->tree[0];
+			sorted.emplace_back();
+			swap(sorted.back(), this->heads[winner]);
+			advance(winner);
+			replay(winner);
+			if (sorted.size() == RowBatch::DEFAULT_CAPACITY) {
+				merged->append_rows(sorted);
+				sorted.clear();
+			}
+		}
+		if (!sorted.empty())
+			merged->append_rows(sorted);
+		close_runs(true);
+	}
+	open_runs((u_int32_t)this->runs.size());
+}
+
+bool Sort::next(RowBatch& batch) {
+	batch.size = 0;
+	while (!batch.is_full() && this->returned < this->limit) {
+		if (this->cursors.empty()) {
+			if (this->next_entry >= this->entries.size())
+				break;
+			swap(batch.add(), this->rows[this->entries[this->next_entry++].row]);
+		}
+		else {
+			u_int32_t winner = this->tree[0];
+			if (this->head_entries[winner].row == NONE)
+				break;
+			swap(batch.add(), this->heads[winner]);
+			advance(winner);
+			replay(winner);
+		}
+		this->returned++;
+	}
+	return batch.size > 0;
+}
+
+void Sort::close() {
+	close_runs(false);
+	for (HeapTable* run : this->runs) {
+		run->drop();
+		delete run;
+	}
+	this->runs.clear();
+	Rows().swap(this->rows);
+	this->entries.clear();
+	this->memory = 0;
+	this->has_cutoff = false;
+	this->next_entry = 0;
+	this->returned = 0;
+	this->input->close();
+}
+
+//Each key's bytes go into the prefix while there's room. A TEXT key is the last to go in: where two
+//values' leading bytes are the same, the keys after it would otherwise decide what they don't.
+void Sort::make_entry(const Row& row, u_int32_t position, Entry& entry) const {
+	unsigned char bytes[sizeof(entry.prefix)];
+	memset(bytes, 0, sizeof(bytes));
+	u_int32_t at = 0;
+	for (auto const& key : this->keys) {
+		u_int32_t start = at;
+		bool text = this->column_attributes[key.column].get_data_type() == ColumnAttribute::TEXT;
+		if (text) {
+			RecordView value = row.get_text(key.column);
+			memcpy(bytes + at, value.data, min<u_int32_t>(value.size, sizeof(bytes) - at));
+			at = sizeof(bytes);
+		}
+		else {
+			if (at + 4 > sizeof(bytes))
+				break;
+			u_int32_t n = (u_int32_t)row.get_int(key.column) ^ 0x80000000u;  // so negatives come first
+			for (int shift = 24; shift >= 0; shift -= 8)
+				bytes[at++] = (unsigned char)(n >> shift);
+		}
+		if (key.descending)
+			for (u_int32_t i = start; i < at; i++)
+				bytes[i] = (unsigned char)~bytes[i];
+		if (text)
+			break;
+	}
+	for (u_int32_t word = 0; word < 2; word++) {
+		entry.prefix[word] = 0;
+		for (u_int32_t i = 0; i < 8; i++)
+			entry.prefix[word] = entry.prefix[word] << 8 | bytes[word * 8 + i];
+	}
+	entry.row = position;
+}
+
+int Sort::compare(const Entry& a, const Row& a_row, const Entry& b, const Row& b_row) const {
+	if (a.prefix[0] != b.prefix[0])
+		return a.prefix[0] < b.prefix[0] ? -1 : 1;
+	if (a.prefix[1] != b.prefix[1])
+		return a.prefix[1] < b.prefix[1] ? -1 : 1;
+	if (this->whole_keys)
+		return 0;
+	for (auto const& key : this->keys) {
+		int order;
+		if (this->column_attributes[key.column].get_data_type() == ColumnAttribute::INT) {
+			int32_t x = a_row.get_int(key.column), y = b_row.get_int(key.column);
+			order = x < y ? -1 : x > y ? 1 : 0;
+		}
+		else {
+			RecordView x = a_row.get_text(key.column), y = b_row.get_text(key.column);
+			order = memcmp(x.data, y.data, min(x.size, y.size));
+			if (order == 0)
+				order = x.size < y.size ? -1 : x.size > y.size ? 1 : 0;
+		}
+		if (order != 0)
+			return (order < 0) != key.descending ? -1 : 1;
+	}
+	return 0;
+}
+
+//A row that sorts after the cutoff isn't kept at all, not even copied
+void Sort::add(const Row& row) {
+	if (this->limit == 0)
+		return;
+	Entry entry;
+	make_entry(row, (u_int32_t)this->rows.size(), entry);
+	if (this->has_cutoff && compare(entry, row, this->cutoff, this->cutoff_row) >= 0)
+		return;
+	this->rows.emplace_back();
+	stage_row(row, this->column_attributes, this->rows.back());
+	this->entries.push_back(entry);
+	this->memory += this->rows.back().memory_size() + sizeof(Entry);
+	if (this->entries.size() / 2 >= this->limit)
+		prune();
+	if (this->memory > this->memory_budget)
+		write_run();
+}
+
+//With a limit, only the first limit entries need to be in order
+void Sort::sort_entries() {
+	auto less = [this](const Entry& a, const Entry& b) {return compare(a, this->rows[a.row], b, this->rows[b.row]) < 0;};
+	if (this->limit < this->entries.size())
+		partial_sort(this->entries.begin(), this->entries.begin() + this->limit, this->entries.end(), less);
+	else
+		sort(this->entries.begin(), this->entries.end(), less);
+	this->next_entry = 0;
+}
+
+//Of the rows held, only the first limit can be among the first limit in the end; the last of them is the new cutoff
+void Sort::prune() {
+	auto less = [this](const Entry& a, const Entry& b) {return compare(a, this->rows[a.row], b, this->rows[b.row]) < 0;};
+	nth_element(this->entries.begin(), this->entries.begin() + (this->limit - 1), this->entries.end(), less);
+	this->entries.resize(this->limit);
+	Rows kept;
+	kept.reserve(this->entries.size());
+	this->memory = 0;
+	for (Entry& entry : this->entries) {
+		kept.push_back(std::move(this->rows[entry.row]));
+		entry.row = (u_int32_t)kept.size() - 1;
+		this->memory += kept.back().memory_size() + sizeof(Entry);
+	}
+	this->rows.swap(kept);
+	this->cutoff = this->entries.back();
+	this->cutoff_row = this->rows[this->cutoff.row];
+	this->has_cutoff = true;
+}
+
+//The rows held go out in order (no more than limit of them), and the last of a full limit can be the new cutoff
+void Sort::write_run() {
+	sort_entries();
+	u_int32_t count = (u_int32_t)min<u_int64_t>(this->limit, this->entries.size());
+	const Entry& last = this->entries[count - 1];
+	if (count == this->limit && (!this->has_cutoff || compare(last, this->rows[last.row], this->cutoff,
+			this->cutoff_row) < 0)) {
+		this->cutoff = last;
+		this->cutoff_row = this->rows[last.row];
+		this->has_cutoff = true;
+	}
+	HeapTable* run = temporary_table("_sort_", this->column_attributes);
+	this->runs.push_back(run);
+	this->runs_written++;
+	Rows sorted;
+	for (u_int32_t i = 0; i < count; i++) {
+		sorted.push_back(std::move(this->rows[this->entries[i].row]));
+		if (sorted.size() == RowBatch::DEFAULT_CAPACITY || i + 1 == count) {
+			run->append_rows(sorted);
+			sorted.clear();
+		}
+	}
+	Rows().swap(this->rows);
+	this->entries.clear();
+	this->memory = 0;
+}
+
+//The first count runs, each at its first row, with the loser tree's first games played: node n's
+//children are 2n and 2n + 1, and run i is leaf count + i
+void Sort::open_runs(u_int32_t count) {
+	this->cursors.assign(count, nullptr);
+	this->heads.resize(count);
+	this->head_entries.resize(count);
+	for (u_int32_t i = 0; i < count; i++) {
+		this->cursors[i] = this->runs[i]->select_cursor();
+		advance(i);
+	}
+	vector<u_int32_t> winners(2 * count);
+	for (u_int32_t i = 0; i < count; i++)
+		winners[count + i] = i;
+	this->tree.assign(count, 0);
+	for (u_int32_t n = count - 1; n >= 1; n--) {
+		u_int32_t a = winners[2 * n], b = winners[2 * n + 1];
+		if (beats(b, a))
+			swap(a, b);
+		winners[n] = a;
+		this->tree[n] = b;
+	}
+	this->tree[0] = winners[1];
+}
+
+void Sort::advance(u_int32_t run) {
+	Handle handle;
+	if (this->cursors[run]->next(handle)) {
+		this->runs[run]->project(handle, nullptr, &this->heads[run]);
+		make_entry(this->heads[run], run, this->head_entries[run]);
+	}
+	else {
+		this->head_entries[run].row = NONE;
+	}
+}
+
+//Merged runs are dropped, and gone from runs
+void Sort::close_runs(bool drop) {
+	for (HandleCursor* cursor : this->cursors)
+		delete cursor;
+	if (drop) {
+		for (u_int32_t i = 0; i < this->cursors.size(); i++) {
+			this->runs[i]->drop();
+			delete this->runs[i];
+		}
+		this->runs.erase(this->runs.begin(), this->runs.begin() + this->cursors.size());
+	}
+	this->cursors.clear();
+	this->heads.clear();
+	this->head_entries.clear();
+	this->tree.clear();
+}
+
+// a used up run loses to any other
+bool Sort::beats(u_int32_t a, u_int32_t b) const {
+	if (this->head_entries[a].row == NONE)
+		return false;
+	if (this->head_entries[b].row == NONE)
+		return true;
+	return compare(this->head_entries[a], this->heads[a], this->head_entries[b], this->heads[b]) < 0;
+}
+
+//Run's new head plays its way up from its leaf, leaving the loser of each game at the node
+void Sort::replay(u_int32_t run) {
+	u_int32_t winner = run;
+	for (u_int32_t n = ((u_int32_t)this->cursors.size() + run) / 2; n >= 1; n /= 2)
+		if (beats(this->tree[n], winner))
+			swap(this->tree[n], winner);
+	this->tree[0] = winner;
+}
+
+
+/**************************HashAggregate Implementation*********************/
+
+const u_int32_t HashAggregate::PARTITIONS;
+const u_int32_t HashAggregate::MAX_SPILL_LEVELS;
+const size_t HashAggregate::DEFAULT_MEMORY_BUDGET;
+const u_int32_t HashAggregate::NONE;
+
+static ColumnNames aggregate_names(const Operator* input, const vector<u_int32_t>& group_by,
+		const HashAggregate::Aggregates& aggregates) {
+	ColumnNames column_names;
+	for (u_int32_t column : group_by)
+		column_names.push_back(input->get_column_names()[column]);
+	for (auto const& aggregate : aggregates)
+		column_names.push_back(HashAggregate::function_name(aggregate.function));
+	return column_names;
+}
+
+static ColumnAttributes aggregate_attributes(const Operator* input, const vector<u_int32_t>& group_by,
+		const HashAggregate::Aggregates& aggregates) {
+	ColumnAttributes column_attributes;
+	for (u_int32_t column : group_by)
+		column_attributes.push_back(input->get_column_attributes()[column]);
+	for (auto const& aggregate : aggregates)
+		if (aggregate.function == HashAggregate::MIN || aggregate.function == HashAggregate::MAX)
+			column_attributes.push_back(input->get_column_attributes()[aggregate.column]);
+		else
+			column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+	return column_attributes;
+}
+
+static inline u_int32_t hash_group(const Row& row, const vector<u_int32_t>& columns) {
+	u_int32_t h = 0;
+	for (u_int32_t column : columns)
+		h = mix(h * 31 + hash_key(row, column));
+	return h;
+}
+
+HashAggregate::HashAggregate(Operator* input, const vector<u_int32_t>& group_by, const Aggregates& aggregates,
+		size_t memory_budget)
+: Operator(aggregate_names(input, group_by, aggregates), aggregate_attributes(input, group_by, aggregates)),
+  input(input), group_by(group_by), aggregates(aggregates), memory_budget(memory_budget), groups(), hashes(), states(),
+  slots(), memory(0), batch_hashes(), batch_slots(), batch_groups(), batch_states(), partial_keys(), partial_columns(),
+  partial_attributes(), level(0), spilling(), pending(), partitions_written(0), next_group(0) {
+	for (auto const& aggregate : aggregates) {
+		if (aggregate.function == SUM
+				&& input->get_column_attributes()[aggregate.column].get_data_type() != ColumnAttribute::INT) {
+			delete input;
+			throw DbRelationError("can't SUM a TEXT column");
+		}
+	}
+	// a partition's rows: the group columns, then each aggregate so far
+	for (u_int32_t i = 0; i < group_by.size(); i++) {
+		this->partial_keys.push_back(i);
+		this->partial_attributes.push_back(this->column_attributes[i]);
+	}
+	for (u_int32_t i = 0; i < aggregates.size(); i++) {
+		this->partial_columns.push_back((u_int32_t)this->partial_attributes.size());
+		this->partial_attributes.push_back(this->column_attributes[group_by.size() + i]);
+		if (aggregates[i].function == COUNT || aggregates[i].function == SUM)
+			this->partial_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+	}
+}
+
+HashAggregate::~HashAggregate() {
+	close();
+	delete this->input;
+}
+
+const char* HashAggregate::function_name(Function function) {
+	switch (function) {
+	case COUNT:
+		return "count";
+	case SUM:
+		return "sum";
+	case MIN:
+		return "min";
+	default:
+		return "max";
+	}
+}
+
+//All of the input is aggregated (and perhaps spilled) here; next() hands back groups and aggregates partitions
+void HashAggregate::open() {
+	close();
+	this->partitions_written = 0;
+	this->level = 0;
+	RowBatch batch;
+	this->input->open();
+	while (this->input->next(batch))
+		add_batch(batch, false);
+	this->input->close();
+	finish_source();
+	if (this->group_by.empty() && this->groups.empty() && this->pending.empty()) {
+		this->groups.emplace_back((u_int32_t)this->column_attributes.size());
+		for (u_int32_t i = 0; i < this->column_attributes.size(); i++)
+			if (this->column_attributes[i].get_data_type() == ColumnAttribute::TEXT)
+				this->groups.back().set_text(i, "", 0);
+		this->hashes.push_back(0);
+		this->states.resize(this->aggregates.size(), 0);
+	}
+}
+
+bool HashAggregate::next(RowBatch& batch) {
+	batch.size = 0;
+	while (!batch.is_full()) {
+		if (this->next_group == this->groups.size()) {
+			if (this->pending.empty() || batch.size > 0)
+				break;
+			aggregate_partition();
+			continue;
+		}
+		u_int32_t group = this->next_group++;
+		Row& row = batch.add();
+		swap(row, this->groups[group]);
+		for (u_int32_t i = 0; i < this->aggregates.size(); i++) {
+			if (this->aggregates[i].function != COUNT && this->aggregates[i].function != SUM)
+				continue;
+			int64_t value = this->states[group * this->aggregates.size() + i];
+			if (value < numeric_limits<int32_t>::min() || value > numeric_limits<int32_t>::max())
+				throw DbRelationError(string(function_name(this->aggregates[i].function)) + " " + to_string(value)
+					+ " is too big for an INT");
+			row.set_int((u_int32_t)this->group_by.size() + i, (int32_t)value);
+		}
+	}
+	return batch.size > 0;
+}
+
+void HashAggregate::close() {
+	clear_groups();
+	for (HeapTable* partition : this->spilling) {
+		partition->drop();
+		delete partition;
+	}
+	this->spilling.clear();
+	for (auto const& partition : this->pending) {
+		partition.first->drop();
+		delete partition.first;
+	}
+	this->pending.clear();
+	this->input->close();
+}
+
+//Every row's hash first, in one tight loop, then the batch's groups on their own, then one lookup for each of them
+void HashAggregate::add_batch(const RowBatch& batch, bool partial) {
+	const vector<u_int32_t>& keys = partial ? this->partial_keys : this->group_by;
+	this->batch_hashes.resize(batch.size);
+	for (u_int32_t i = 0; i < batch.size; i++)
+		this->batch_hashes[i] = hash_group(batch.rows[i], keys);
+
+	u_int32_t size = 1;
+	while (size < batch.size * 2)
+		size <<= 1;
+	this->batch_slots.assign(size, NONE);
+	this->batch_groups.clear();
+	this->batch_states.resize(batch.size * this->aggregates.size());
+	for (u_int32_t i = 0; i < batch.size; i++) {
+		u_int32_t slot = this->batch_hashes[i] & (size - 1), first;
+		for (; (first = this->batch_slots[slot]) != NONE; slot = (slot + 1) & (size - 1)) {
+			if (this->batch_hashes[first] != this->batch_hashes[i])
+				continue;
+			u_int32_t key = 0;
+			while (key < keys.size() && same_key(batch.rows[i], keys[key], batch.rows[first], keys[key]))
+				key++;
+			if (key == keys.size())
+				break;
+		}
+		if (first == NONE) {
+			first = this->batch_slots[slot] = i;
+			this->batch_groups.push_back(i);
+			for (u_int32_t a = 0; a < this->aggregates.size(); a++)
+				this->batch_states[i * this->aggregates.size() + a] =
+					this->aggregates[a].function == COUNT || this->aggregates[a].function == SUM ? 0 : i;
+		}
+		accumulate(first, batch, i, partial);
+	}
+
+	for (u_int32_t first : this->batch_groups) {
+		u_int32_t groups = (u_int32_t)this->groups.size();
+		u_int32_t group = find_group(batch.rows[first], this->batch_hashes[first], partial);
+		merge(group, batch, first, partial);
+		if (group == groups && group > 0 && this->memory > this->memory_budget && this->level < MAX_SPILL_LEVELS)
+			spill();
+	}
+}
+
+//Linear probing; a group not there yet is added, its MIN and MAX taken from row
+u_int32_t HashAggregate::find_group(const Row& row, u_int32_t hash, bool partial) {
+	const vector<u_int32_t>& keys = partial ? this->partial_keys : this->group_by;
+	if ((this->groups.size() + 1) * 2 > this->slots.size())
+		grow_slots();
+	u_int32_t mask = (u_int32_t)this->slots.size() - 1;
+	u_int32_t slot = hash & mask;
+	for (; this->slots[slot] != NONE; slot = (slot + 1) & mask) {
+		u_int32_t group = this->slots[slot];
+		if (this->hashes[group] != hash)
+			continue;
+		u_int32_t i = 0;
+		while (i < keys.size() && same_key(row, keys[i], this->groups[group], i))
+			i++;
+		if (i == keys.size())
+			return group;
+	}
+
+	u_int32_t group = (u_int32_t)this->groups.size();
+	this->slots[slot] = group;
+	this->groups.emplace_back((u_int32_t)this->column_attributes.size());
+	Row& values = this->groups.back();
+	for (u_int32_t i = 0; i < keys.size(); i++)
+		copy_column(row, keys[i], values, i);
+	for (u_int32_t i = 0; i < this->aggregates.size(); i++)
+		if (this->aggregates[i].function == MIN || this->aggregates[i].function == MAX)
+			copy_column(row, partial ? this->partial_columns[i] : this->aggregates[i].column, values,
+				(u_int32_t)keys.size() + i);
+	this->hashes.push_back(hash);
+	this->states.resize(this->states.size() + this->aggregates.size(), 0);
+	this->memory += values.memory_size() + sizeof(u_int32_t) * 3 + sizeof(int64_t) * this->aggregates.size();
+	return group;
+}
+
+//Into the batch's group whose first row is first
+void HashAggregate::accumulate(u_int32_t first, const RowBatch& batch, u_int32_t row, bool partial) {
+	int64_t* state = &this->batch_states[first * this->aggregates.size()];
+	const Row& values = batch.rows[row];
+	for (u_int32_t i = 0; i < this->aggregates.size(); i++) {
+		const Aggregate& aggregate = this->aggregates[i];
+		u_int32_t column = partial ? this->partial_columns[i] : aggregate.column;
+		if (partial && (aggregate.function == COUNT || aggregate.function == SUM)) {
+			state[i] += (int64_t)((u_int64_t)(u_int32_t)values.get_int(column) << 32
+				| (u_int32_t)values.get_int(column + 1));
+			continue;
+		}
+		switch (aggregate.function) {
+		case COUNT:
+			state[i]++;
+			break;
+		case SUM:
+			state[i] += values.get_int(column);
+			break;
+		default:
+			const Row& kept = batch.rows[state[i]];
+			int order = values.get_data_type(column) == ColumnAttribute::INT
+				? order_of(values.get_int(column), kept.get_int(column))
+				: order_of(values.get_text(column), kept.get_text(column));
+			if (order != 0 && (order < 0) == (aggregate.function == MIN))
+				state[i] = row;
+		}
+	}
+}
+
+//The batch's group whose first row is first into the table's group
+void HashAggregate::merge(u_int32_t group, const RowBatch& batch, u_int32_t first, bool partial) {
+	int64_t* state = &this->states[group * this->aggregates.size()];
+	const int64_t* batch_state = &this->batch_states[first * this->aggregates.size()];
+	Row& values = this->groups[group];
+	for (u_int32_t i = 0; i < this->aggregates.size(); i++) {
+		const Aggregate& aggregate = this->aggregates[i];
+		if (aggregate.function == COUNT || aggregate.function == SUM) {
+			state[i] += batch_state[i];
+			continue;
+		}
+		const Row& row = batch.rows[batch_state[i]];
+		u_int32_t column = partial ? this->partial_columns[i] : aggregate.column;
+		u_int32_t cell = (u_int32_t)this->group_by.size() + i;
+		int order = values.get_data_type(cell) == ColumnAttribute::INT
+			? order_of(row.get_int(column), values.get_int(cell))
+			: order_of(row.get_text(column), values.get_text(cell));
+		if (order != 0 && (order < 0) == (aggregate.function == MIN)) {
+			size_t before = values.memory_size();
+			copy_column(row, column, values, cell);
+			this->memory += values.memory_size() - before;
+		}
+	}
+}
+
+//The groups so far go out to this level's partitions, and the table starts over
+void HashAggregate::spill() {
+	if (this->spilling.empty()) {
+		for (u_int32_t i = 0; i < PARTITIONS; i++)
+			this->spilling.push_back(temporary_table("_aggregate_", this->partial_attributes));
+		this->partitions_written += PARTITIONS;
+	}
+	Row partial((u_int32_t)this->partial_attributes.size());
+	for (u_int32_t group = 0; group < this->groups.size(); group++) {
+		const Row& values = this->groups[group];
+		partial.clear();
+		for (u_int32_t i = 0; i < this->group_by.size(); i++)
+			copy_column(values, i, partial, i);
+		for (u_int32_t i = 0; i < this->aggregates.size(); i++) {
+			if (this->aggregates[i].function == COUNT || this->aggregates[i].function == SUM) {
+				u_int64_t value = (u_int64_t)this->states[group * this->aggregates.size() + i];
+				partial.set_int(this->partial_columns[i], (int32_t)(u_int32_t)(value >> 32));
+				partial.set_int(this->partial_columns[i] + 1, (int32_t)(u_int32_t)value);
+			}
+			else {
+				copy_column(values, (u_int32_t)this->group_by.size() + i, partial, this->partial_columns[i]);
+			}
+		}
+		// each level splits on other bits of the hash than the one before
+		u_int32_t hash = mix(this->hashes[group] + this->level * 0x9e3779b9u);
+		this->spilling[(u_int32_t)(((u_int64_t)hash * PARTITIONS) >> 32)]->insert(&partial);
+	}
+	clear_groups();
+}
+
+//Once the rows being aggregated are used up, groups that have spilled have to be aggregated again from the partitions
+void HashAggregate::finish_source() {
+	if (this->spilling.empty())
+		return;
+	spill();
+	for (HeapTable* partition : this->spilling)
+		this->pending.push_back(make_pair(partition, this->level + 1));
+	this->spilling.clear();
+}
+
+void HashAggregate::aggregate_partition() {
+	clear_groups();
+	HeapTable* partition = this->pending.back().first;
+	this->level = this->pending.back().second;
+	this->pending.pop_back();
+	HandleCursor* cursor = nullptr;
+	try {
+		RowBatch batch;
+		cursor = partition->select_cursor();
+		Handle handle;
+		while (cursor->next(handle)) {
+			partition->project(handle, nullptr, &batch.add());
+			if (batch.is_full()) {
+				add_batch(batch, true);
+				batch.size = 0;
+			}
+		}
+		delete cursor;
+		cursor = nullptr;
+		add_batch(batch, true);
+		finish_source();
+	}
+	catch (...) {
+		delete cursor;
+		partition->drop();
+		delete partition;
+		throw;
+	}
+	partition->drop();
+	delete partition;
+}
+
+void HashAggregate::clear_groups() {
+	Rows().swap(this->groups);
+	this->hashes.clear();
+	this->states.clear();
+	this->slots.clear();
+	this->memory = 0;
+	this->next_group = 0;
+}
+
+void HashAggregate::grow_slots() {
+	size_t size = max<size_t>(this->slots.size() * 2, 1024);
+	this->slots.assign(size, NONE);
+	u_int32_t mask = (u_int32_t)size - 1;
+	for (u_int32_t group = 0; group < this->groups.size(); group++) {
+		u_int32_t slot = this->hashes[group] & mask;
+		while (this->slots[slot] != NONE)
+			slot = (slot + 1) & mask;
+		this->slots[slot] = group;
+	}
+	this->memory += (size / 2) * sizeof(u_int32_t);
+}
+
+
+/**************************TableCount Implementation*********************/
+
+TableCount::TableCount(DbRelation& table, const Identifier& name)
+: Operator(ColumnNames{name}, ColumnAttributes{ColumnAttribute(ColumnAttribute::INT)}), table(table), done(false) {
+}
+
+bool TableCount::next(RowBatch& batch) {
+	batch.size = 0;
+	if (this->done)
+		return false;
+	this->done = true;
+	u_int64_t count = this->table.count();
+	if (count > (u_int64_t)numeric_limits<int32_t>::max())
+		throw DbRelationError("count " + to_string(count) + " is too big for an INT");
+	Row& row = batch.add();
+	row.resize(1);
+	row.set_int(0, (int32_t)count);
+	return true;
+}
+
+
+/**************************PreparedStatement Implementation*********************/
+
+const u_int32_t PreparedStatement::REPLAN_FACTOR;
+
+PreparedStatement::~PreparedStatement() {
+	delete this->plan;
+	for (Expression* value : this->values)
+		delete value;
+}
+
+void PreparedStatement::bind(const Parameters& parameters) {
+	if (parameters.size() != this->parameter_types.size())
+		throw DbRelationError("statement has " + to_string(this->parameter_types.size()) + " parameters, "
+			+ to_string(parameters.size()) + " given");
+	for (u_int32_t i = 0; i < parameters.size(); i++)
+		if (parameters[i].data_type != this->parameter_types[i])
+			throw DbRelationError("wrong type of value for parameter " + to_string(i + 1));
+	this->parameters = parameters;
+}
+
+//Block counts only ever go up by one at a time, so one that is 0 now or then is stale once it changes at all
+bool PreparedStatement::is_stale() const {
+	for (auto const& planned : this->planned_blocks) {
+		u_int64_t then = planned.second, now = planned.first->get_block_count();
+		if (now > then * REPLAN_FACTOR || then > now * REPLAN_FACTOR)
+			return true;
+	}
+	return false;
+}
+
+//The values can only be literals and parameters, so they're evaluated against a row with no columns
+Handle PreparedStatement::insert() {
+	Row none, row((u_int32_t)this->values.size());
+	for (u_int32_t column = 0; column < this->values.size(); column++)
+		this->values[column]->eval(none, column, row);
+	return this->table->insert(&row);
+}
+
+
+// run a plan to the end: the rows it hands back, and how many batches they came in
+static u_int32_t count_rows(Operator* plan, RowBatch& batch, u_int32_t* batches=nullptr) {
+	u_int32_t rows = 0;
+	plan->open();
+	while (plan->next(batch)) {
+		if (batch.size == 0 || batch.size > batch.get_capacity())
+			return 0xffffffff;
+		rows += batch.size;
+		if (batches != nullptr)
+			(*batches)++;
+	}
+	plan->close();
+	return rows;
+}
+
+// run a sort to the end: the rows it hands back, or 0xffffffff if any of them are out of order
+static u_int32_t count_sorted(Operator* plan, const Sort::Keys& keys, RowBatch& batch) {
+	u_int32_t rows = 0;
+	Row last;
+	plan->open();
+	while (plan->next(batch)) {
+		for (u_int32_t i = 0; i < batch.size; i++) {
+			const Row& row = batch.rows[i];
+			for (auto const& key : keys) {
+				if (rows == 0)
+					break;
+				int order = row.get_data_type(key.column) == ColumnAttribute::INT
+					? order_of(last.get_int(key.column), row.get_int(key.column))
+					: order_of(last.get_text(key.column), row.get_text(key.column));
+				if (order != 0) {
+					if ((order < 0) == key.descending)
+						return 0xffffffff;
+					break;
+				}
+			}
+			last = row;
+			rows++;
+		}
+	}
+	plan->close();
+	return rows;
+}
+
+static string long_text(int i) {
+	return "a TEXT too long to fit in a Row's cell, number " + to_string(i);
+}
+
+// test function -- returns true if all tests pass
+bool test_executor() {
+	Catalog catalog("_test_columns");
+	catalog.open();
+	ColumnNames column_names = {"a", "b", "c", "d"};
+	ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT),
+		ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+	DbRelation& table = catalog.create_table("_test_executor", column_names, column_attributes);
+	try {
+		catalog.create_table("_test_executor", column_names, column_attributes);
+		return false;
+	} catch (DbRelationError &e) {}
+	if (&catalog.create_table("_test_executor", column_names, column_attributes, true) != &table)
+		return false;
+	const int N = 3000;
+	Row row(4);
+	for (int i = 0; i < N; i++) {
+		row.clear();
+		row.set_int(0, i);
+		row.set_text(1, i % 2 == 0 ? "even" : "odd");
+		row.set_int(2, i % 10);
+		row.set_text(3, long_text(i));
+		table.insert(&row);
+	}
+	Catalog reopened("_test_columns");
+	DbRelation& same = reopened.get_table("_test_executor");
+	if (same.get_column_names() != column_names || same.get_column_attributes()[3].get_data_type() != ColumnAttribute::TEXT
+			|| reopened.has_table("_test_no_such_table"))
+		return false;
+	reopened.close();
+	std::cout << "catalog ok" << std::endl;
+
+	// expressions: types checked up front, INT column against a literal either way around
+	try {
+		delete Expression::binary(Expression::EQ, Expression::column(0, ColumnAttribute::INT), Expression::literal("0"));
+		return false;
+	} catch (DbRelationError &e) {}
+	try {
+		delete Expression::binary(Expression::PLUS, Expression::column(1, ColumnAttribute::TEXT), Expression::literal(1));
+		return false;
+	} catch (DbRelationError &e) {}
+	Row values(2);
+	values.set_int(0, 7);
+	values.set_text(1, "odd");
+	Expression* expression = Expression::binary(Expression::LT, Expression::literal(5), Expression::column(0,
+		ColumnAttribute::INT));
+	if (expression->eval_int(values) != 1)
+		return false;
+	delete expression;
+	expression = Expression::binary(Expression::GE, Expression::column(1, ColumnAttribute::TEXT), Expression::literal("odds"));
+	if (expression->eval_int(values) != 0)
+		return false;
+	delete expression;
+	expression = Expression::binary(Expression::DIVIDE, Expression::column(0, ColumnAttribute::INT), Expression::literal(0));
+	try {
+		expression->eval_int(values);
+		return false;
+	} catch (DbRelationError &e) {}
+	delete expression;
+	expression = Expression::unary(Expression::NEGATE, Expression::binary(Expression::MODULO,
+		Expression::column(0, ColumnAttribute::INT), Expression::literal(4)));
+	if (expression->eval_int(values) != -3)
+		return false;
+	delete expression;
+
+	// scan, in full batches but the last
+	for (u_int32_t capacity : {RowBatch::DEFAULT_CAPACITY, 7u}) {
+		RowBatch batch(capacity);
+		u_int32_t batches = 0;
+		Operator* plan = new TableScan(table);
+		if (count_rows(plan, batch, &batches) != N || batches != (N + capacity - 1) / capacity)
+			return false;
+		delete plan;
+
+		// WHERE a < 100 AND b = 'even'
+		ColumnNames used = {"a", "b"};
+		plan = new Filter(new TableScan(table, &used), Expression::binary(Expression::AND,
+			Expression::binary(Expression::LT, Expression::column(0, ColumnAttribute::INT), Expression::literal(100)),
+			Expression::binary(Expression::EQ, Expression::column(1, ColumnAttribute::TEXT), Expression::literal("even"))));
+		if (count_rows(plan, batch) != 50)
+			return false;
+		delete plan;
+
+		// SELECT a * 2 + 1, d FROM _test_executor WHERE c = 3, with c = 3 tested on the records' bytes
+		ValueDict where;
+		where["c"] = Value(3);
+		used = {"a", "d"};
+		plan = new Project(new TableScan(table, &used, &where), {Expression::binary(Expression::PLUS,
+			Expression::binary(Expression::TIMES, Expression::column(0, ColumnAttribute::INT), Expression::literal(2)),
+			Expression::literal(1)), Expression::column(3, ColumnAttribute::TEXT)}, {"twice_a_plus_1", "d"});
+		if (plan->get_column_names()[0] != "twice_a_plus_1" || plan->get_column_attributes()[1].get_data_type()
+				!= ColumnAttribute::TEXT)
+			return false;
+		int expected = 3;
+		plan->open();
+		while (plan->next(batch)) {
+			for (u_int32_t i = 0; i < batch.size; i++, expected += 10) {
+				const Row& projected = batch.rows[i];
+				if (projected.size() != 2 || projected.get_int(0) != expected * 2 + 1
+						|| projected.get(1).s != long_text(expected))
+					return false;
+			}
+		}
+		plan->close();
+		if (expected != N + 3)
+			return false;
+
+		// run again: open() starts over
+		if (count_rows(plan, batch) != N / 10)
+			return false;
+		delete plan;
+
+		// LIMIT 10 OFFSET 1025 (across a batch boundary) and LIMIT 0
+		plan = new Limit(new TableScan(table), 10, 1025);
+		plan->open();
+		expected = 1025;
+		while (plan->next(batch))
+			for (u_int32_t i = 0; i < batch.size; i++)
+				if (batch.rows[i].get_int(0) != expected++)
+					return false;
+		plan->close();
+		if (expected != 1035 || count_rows(plan, batch) != 10)
+			return false;
+		delete plan;
+		plan = new Limit(new TableScan(table), 0);
+		if (count_rows(plan, batch) != 0)
+			return false;
+		delete plan;
+	}
+	std::cout << "executor ok" << std::endl;
+
+	// SELECT * FROM _test_executor WHERE c = ?, prepared once and run for two values
+	PreparedStatement select;
+	select.parameters.resize(1);
+	select.parameter_types = {ColumnAttribute::INT};
+	TableScan* scan = new TableScan(table);
+	scan->add_where("c", Expression::parameter(&select.parameters, 0, ColumnAttribute::INT));
+	select.plan = scan;
+	RowBatch batch;
+	for (int32_t c : {3, 11}) {
+		select.bind(Parameters{Value(c)});
+		if (count_rows(select.plan, batch) != (c < 10 ? N / 10 : 0))
+			return false;
+	}
+	try {
+		select.bind(Parameters{Value(std::string("3"))});
+		return false;
+	} catch (DbRelationError &e) {}
+	try {
+		select.bind(Parameters());
+		return false;
+	} catch (DbRelationError &e) {}
+
+	// INSERT INTO _test_executor VALUES (?, 'odd', 11, ?)
+	PreparedStatement insert;
+	insert.parameters.resize(2);
+	insert.parameter_types = {ColumnAttribute::INT, ColumnAttribute::TEXT};
+	insert.table = &table;
+	insert.values = {Expression::parameter(&insert.parameters, 0, ColumnAttribute::INT), Expression::literal("odd"),
+		Expression::literal(11), Expression::parameter(&insert.parameters, 1, ColumnAttribute::TEXT)};
+	insert.bind(Parameters{Value(N), Value(long_text(N))});
+	ValueDict* inserted = table.project(insert.insert());
+	if ((*inserted)["a"].n != N || (*inserted)["d"].s != long_text(N))
+		return false;
+	delete inserted;
+	if (count_rows(select.plan, batch) != 1)
+		return false;
+	std::cout << "prepared statements ok" << std::endl;
+
+	// _test_executor JOIN _test_join, on an INT key and on a TEXT one, in memory and spilled to partitions
+	DbRelation& other = catalog.create_table("_test_join", {"k", "parity"}, {ColumnAttribute(ColumnAttribute::INT),
+		ColumnAttribute(ColumnAttribute::TEXT)});
+	for (int i = 0; i <= 10; i++) {  // 0 to 9, then 3 again
+		row.resize(2);
+		row.clear();
+		int k = i < 10 ? i : 3;
+		row.set_int(0, k);
+		row.set_text(1, k % 2 == 0 ? "even" : "odd");
+		other.insert(&row);
+	}
+	ColumnNames used = {"a", "c"};
+	for (size_t memory_budget : {HashJoin::DEFAULT_MEMORY_BUDGET, (size_t)1}) {
+		for (bool build_left : {false, true}) {
+			HashJoin* join = new HashJoin(new TableScan(table, &used), new TableScan(other), 2, 0, build_left,
+				memory_budget);
+			if (join->get_column_names().size() != 6 || join->get_column_names()[4] != "k")
+				return false;
+			u_int32_t found = 0;
+			join->open();
+			while (join->next(batch)) {
+				for (u_int32_t i = 0; i < batch.size; i++)
+					if (batch.rows[i].get_int(2) != batch.rows[i].get_int(4) || batch.rows[i].get_int(0) % 10
+							!= batch.rows[i].get_int(4))
+						return false;
+				found += batch.size;
+			}
+			if (found != N + N / 10 || join->is_spilled() != (memory_budget == 1)
+					|| (join->get_partitions_written() > HashJoin::PARTITIONS) != (memory_budget == 1))
+				return false;
+			join->close();
+			delete join;
+
+			Operator* plan = new HashJoin(new TableScan(table), new TableScan(other), 1, 1, build_left, memory_budget);
+			if (count_rows(plan, batch) != N / 2 * 5 + (N / 2 + 1) * 6)
+				return false;
+			delete plan;
+		}
+	}
+	// a build side many times the budget, on a key with no repeats: the partitions are split again until they fit
+	Operator* all_rows = new TableScan(table);
+	u_int32_t rows = count_rows(all_rows, batch);
+	delete all_rows;
+	HashJoin* self = new HashJoin(new TableScan(table), new TableScan(table), 0, 0, true, 8192);
+	u_int32_t joined = 0;
+	self->open();
+	while (self->next(batch)) {
+		for (u_int32_t i = 0; i < batch.size; i++)
+			if (batch.rows[i].get_int(0) != batch.rows[i].get_int(4)
+					|| order_of(batch.rows[i].get_text(3), batch.rows[i].get_text(7)) != 0)
+				return false;
+		joined += batch.size;
+	}
+	if (joined != rows || self->get_partitions_written() <= HashJoin::PARTITIONS)
+		return false;
+	delete self;
+	try {
+		delete new HashJoin(new TableScan(table), new TableScan(other), 0, 1);
+		return false;
+	} catch (DbRelationError &e) {}
+	std::cout << "hash join ok" << std::endl;
+
+	// ORDER BY, in memory and spilled to runs (more of them than are merged at once), in full and
+	// only the first rows; the keys' prefixes hold all of them, part of them, or don't decide
+	Sort::Keys by_c_a = {{2, false}, {0, true}};
+	Sort::Keys by_b_a = {{1, true}, {0, false}};
+	Sort::Keys by_d = {{3, false}};
+	for (size_t memory_budget : {Sort::DEFAULT_MEMORY_BUDGET, (size_t)4096}) {
+		for (const Sort::Keys* keys : {&by_c_a, &by_b_a, &by_d}) {
+			for (u_int64_t limit : {Sort::NO_LIMIT, (u_int64_t)0, (u_int64_t)7, (u_int64_t)N + 5}) {
+				Sort* sort = new Sort(new TableScan(table), *keys, limit, memory_budget);
+				if (count_sorted(sort, *keys, batch) != min<u_int64_t>(limit, N + 1))
+					return false;
+				if ((sort->get_runs_written() > Sort::MERGE_FAN_IN) != (memory_budget == 4096 && limit > N))
+					return false;
+				delete sort;
+			}
+		}
+	}
+	Sort* top = new Sort(new TableScan(table), by_c_a, 3, 4096);
+	top->open();
+	if (!top->next(batch) || batch.size != 3 || batch.rows[0].get_int(0) != 2990 || batch.rows[2].get_int(0) != 2970
+			|| top->next(batch))
+		return false;
+	delete top;
+	Sort* partly = new Sort(new TableScan(table, &used), by_c_a, Sort::NO_LIMIT, 4096);
+	partly->open();
+	if (!partly->next(batch) || batch.rows[0].get_int(0) != 2990 || batch.rows[0].get_text(1).size != 0)
+		return false;
+	delete partly;
+	std::cout << "sort ok" << std::endl;
+
+	// GROUP BY c with COUNT(*), SUM(a), MIN(b), MAX(d), in memory and spilled a group at a time; GROUP BY a,
+	// spilled and split again; and no GROUP BY, of all the rows and of none
+	HashAggregate::Aggregates aggregates = {{HashAggregate::COUNT, 0}, {HashAggregate::SUM, 0}, {HashAggregate::MIN, 1},
+		{HashAggregate::MAX, 3}};
+	for (size_t memory_budget : {HashAggregate::DEFAULT_MEMORY_BUDGET, (size_t)1}) {
+		HashAggregate* aggregate = new HashAggregate(new TableScan(table), {2}, aggregates, memory_budget);
+		if (aggregate->get_column_names()[1] != "count" || aggregate->get_column_attributes()[4].get_data_type()
+				!= ColumnAttribute::TEXT)
+			return false;
+		u_int32_t found = 0;
+		aggregate->open();
+		if ((aggregate->get_partitions_written() > 0) != (memory_budget == 1))
+			return false;
+		while (aggregate->next(batch)) {
+			for (u_int32_t i = 0; i < batch.size; i++) {
+				const Row& group = batch.rows[i];
+				int32_t c = group.get_int(0);
+				if (c == 3 && (group.get_int(1) != N / 10 || group.get_int(2) != 449400 || group.get_text(3).size != 3
+						|| string(group.get_text(4).data, group.get_text(4).size) != long_text(993)))
+					return false;
+				if (c == 11 && (group.get_int(1) != 1 || group.get_int(2) != N))
+					return false;
+			}
+			found += batch.size;
+		}
+		if (found != 11)
+			return false;
+		delete aggregate;
+	}
+	HashAggregate* by_a = new HashAggregate(new TableScan(table), {0}, {{HashAggregate::COUNT, 0},
+		{HashAggregate::SUM, 2}}, 4096);
+	u_int32_t found = 0;
+	by_a->open();
+	while (by_a->next(batch)) {
+		for (u_int32_t i = 0; i < batch.size; i++)
+			if (batch.rows[i].get_int(1) != 1 || batch.rows[i].get_int(2) != (batch.rows[i].get_int(0) < N
+					? batch.rows[i].get_int(0) % 10 : 11))
+				return false;
+		found += batch.size;
+	}
+	if (found != N + 1 || by_a->get_partitions_written() <= HashAggregate::PARTITIONS)
+		return false;
+	delete by_a;
+	HashAggregate::Aggregates totals = {{HashAggregate::COUNT, 0}, {HashAggregate::SUM, 2}, {HashAggregate::MIN, 0},
+		{HashAggregate::MAX, 1}};
+	HashAggregate* all = new HashAggregate(new TableScan(table), {}, totals);
+	all->open();
+	if (!all->next(batch) || batch.size != 1 || batch.rows[0].get_int(0) != N + 1 || batch.rows[0].get_int(1) != 13511
+			|| batch.rows[0].get_int(2) != 0 || string(batch.rows[0].get_text(3).data, 3) != "odd" || all->next(batch))
+		return false;
+	delete all;
+	HashAggregate* none = new HashAggregate(new Filter(new TableScan(table), Expression::literal(0)), {}, totals);
+	none->open();
+	if (!none->next(batch) || batch.size != 1 || batch.rows[0].get_int(0) != 0 || batch.rows[0].get_text(3).size != 0)
+		return false;
+	delete none;
+	try {
+		delete new HashAggregate(new TableScan(table), {}, {{HashAggregate::SUM, 1}});
+		return false;
+	} catch (DbRelationError &e) {}
+	TableCount count(table);
+	count.open();
+	if (!count.next(batch) || batch.size != 1 || batch.rows[0].get_int(0) != N + 1 || count.next(batch))
+		return false;
+	std::cout << "aggregate ok" << std::endl;
+
+	// parallel scan: the same rows as a TableScan, in whatever order, whole and with WHERE c = 3 on a, d;
+	// opened again, and closed part way through
+	for (u_int32_t workers : {1u, 4u}) {
+		for (u_int32_t capacity : {RowBatch::DEFAULT_CAPACITY, 7u}) {
+			RowBatch rows(capacity);
+			ParallelScan all_rows(table, workers);
+			for (int run = 0; run < 2; run++) {
+				int64_t sum = 0;
+				u_int32_t seen = 0;
+				all_rows.open();
+				while (all_rows.next(rows)) {
+					for (u_int32_t i = 0; i < rows.size; i++)
+						sum += rows.rows[i].get_int(0);
+					seen += rows.size;
+				}
+				all_rows.close();
+				if (seen != N + 1 || sum != (int64_t)N * (N - 1) / 2 + N)
+					return false;
+			}
+			ValueDict where;
+			where["c"] = Value(3);
+			ColumnNames used = {"a", "d"};
+			ParallelScan threes(table, workers, &used, &where);
+			u_int32_t seen = 0;
+			threes.open();
+			while (threes.next(rows)) {
+				for (u_int32_t i = 0; i < rows.size; i++) {
+					const Row& three = rows.rows[i];
+					if (three.get_int(0) % 10 != 3 || string(three.get_text(3).data, three.get_text(3).size)
+							!= long_text(three.get_int(0)))
+						return false;
+				}
+				seen += rows.size;
+			}
+			threes.close();
+			if (seen != N / 10)
+				return false;
+		}
+		ParallelScan partly_read(table, workers);
+		partly_read.open();
+		if (!partly_read.next(batch))
+			return false;
+		partly_read.close();
+		if (partly_read.next(batch))
+			return false;
+	}
+	std::cout << "parallel scan ok" << std::endl;
+
+	catalog.drop();
+	return true;
+}
+
+// benchmark -- SELECT a + c, b FROM t WHERE c = 3 a row at a time against a batch at a time,
+// with the WHERE in a Filter and pushed down into the scan
+void bench_executor() {
+	const int N = 200000;
+	Catalog catalog("_bench_columns");
+	catalog.open();
+	DbRelation& table = catalog.create_table("_bench_executor", {"a", "b", "c"},
+		{ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT), ColumnAttribute(ColumnAttribute::INT)});
+	ValueDicts rows;
+	ValueDict row;
+	for (int i = 0; i < N; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("row number " + to_string(i));
+		row["c"] = Value(i % 10);
+		rows.push_back(row);
+	}
+	delete table.insert_batch(&rows);
+	ColumnNames used = {"a", "b", "c"};
+	ValueDict where;
+	where["c"] = Value(3);
+	for (bool pushed : {false, true}) {
+		std::cout << (pushed ? "executor, WHERE pushed into the scan:" : "executor, WHERE in a Filter:");
+		for (u_int32_t capacity : {1u, 64u, RowBatch::DEFAULT_CAPACITY}) {
+			Operator* scan = new TableScan(table, &used, pushed ? &where : nullptr);
+			Operator* input = pushed ? scan : new Filter(scan, Expression::binary(Expression::EQ,
+				Expression::column(2, ColumnAttribute::INT), Expression::literal(3)));
+			Operator* plan = new Project(input, {Expression::binary(Expression::PLUS,
+				Expression::column(0, ColumnAttribute::INT), Expression::column(2, ColumnAttribute::INT)),
+				Expression::column(1, ColumnAttribute::TEXT)}, {"a_plus_c", "b"});
+			RowBatch batch(capacity);
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			u_int32_t found = count_rows(plan, batch);
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			std::cout << " batch " << capacity << ": " << N / seconds << " rows/sec scanned (" << found << " found)";
+			delete plan;
+		}
+		std::cout << std::endl;
+	}
+	catalog.drop();
+}
+
+// benchmark -- SELECT * FROM fact JOIN dim ON fact.dim_id = dim.id, dim's rows in the hash table,
+// in memory and spilled to partitions
+void bench_join(u_int32_t build_rows, u_int32_t probe_rows) {
+	const u_int32_t CHUNK = 100000;
+	Catalog catalog("_bench_join_columns");
+	catalog.open();
+	DbRelation& dim = catalog.create_table("_bench_dim", {"id", "name"},
+		{ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)});
+	DbRelation& fact = catalog.create_table("_bench_fact", {"id", "dim_id", "amount"},
+		{ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::INT)});
+	ValueDicts rows;
+	ValueDict row;
+	for (u_int32_t i = 0; i < build_rows; i++) {
+		row["id"] = Value((int32_t)i);
+		row["name"] = Value("dim " + to_string(i));
+		rows.push_back(row);
+		if (rows.size() == CHUNK || i + 1 == build_rows) {
+			delete dim.insert_batch(&rows);
+			rows.clear();
+		}
+	}
+	row.clear();
+	for (u_int32_t i = 0; i < probe_rows; i++) {
+		row["id"] = Value((int32_t)i);
+		row["dim_id"] = Value((int32_t)(i * 7 % build_rows));
+		row["amount"] = Value((int32_t)(i % 1000));
+		rows.push_back(row);
+		if (rows.size() == CHUNK || i + 1 == probe_rows) {
+			delete fact.insert_batch(&rows);
+			rows.clear();
+		}
+	}
+
+	std::cout << "hash join " << build_rows << " x " << probe_rows << ":";
+	for (size_t memory_budget : {numeric_limits<size_t>::max(), HashJoin::DEFAULT_MEMORY_BUDGET / 4}) {
+		HashJoin* join = new HashJoin(new TableScan(fact), new TableScan(dim), 1, 0, false, memory_budget);
+		RowBatch batch;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		u_int32_t found = count_rows(join, batch);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		std::cout << (join->is_spilled() ? " spilled to partitions: " : " in memory: ") << probe_rows / seconds
+			<< " probe rows/sec (" << found << " joined, " << seconds << " sec)";
+		delete join;
+	}
+	std::cout << std::endl;
+	catalog.drop();
+}
+
+// benchmark -- SELECT * FROM t ORDER BY b, a in memory, spilled to runs, and with a LIMIT of 10
+void bench_sort(u_int32_t rows) {
+	const u_int32_t CHUNK = 100000;
+	Catalog catalog("_bench_sort_columns");
+	catalog.open();
+	DbRelation& table = catalog.create_table("_bench_sort", {"a", "b"},
+		{ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)});
+	ValueDicts chunk;
+	ValueDict row;
+	for (u_int32_t i = 0; i < rows; i++) {
+		u_int32_t n = i * 2654435761u;  // out of order
+		row["a"] = Value((int32_t)(n % 1000));
+		row["b"] = Value("key " + to_string(n % 100000));
+		chunk.push_back(row);
+		if (chunk.size() == CHUNK || i + 1 == rows) {
+			delete table.insert_batch(&chunk);
+			chunk.clear();
+		}
+	}
+
+	std::cout << "sort " << rows << " rows:";
+	for (size_t memory_budget : {numeric_limits<size_t>::max(), Sort::DEFAULT_MEMORY_BUDGET / 4}) {
+		for (u_int64_t limit : {Sort::NO_LIMIT, (u_int64_t)10}) {
+			Sort* sort = new Sort(new TableScan(table), {{1, false}, {0, false}}, limit, memory_budget);
+			RowBatch batch;
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			u_int32_t found = count_rows(sort, batch);
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			std::cout << (limit != Sort::NO_LIMIT ? " first 10" : sort->get_runs_written() > 0 ? " in runs" : " in memory")
+				<< ": " << rows / seconds << " rows/sec (" << found << " sorted, " << sort->get_runs_written() << " runs)";
+			delete sort;
+		}
+	}
+	std::cout << std::endl;
+	catalog.drop();
+}
+
+// benchmark -- SELECT g, COUNT(*), SUM(amount) FROM t GROUP BY g for a few groups and for many, in memory
+// and spilled, and SELECT COUNT(*) FROM t by aggregating a scan and by counting the blocks' records
+void bench_aggregate(u_int32_t rows) {
+	const u_int32_t CHUNK = 100000;
+	Catalog catalog("_bench_aggregate_columns");
+	catalog.open();
+	DbRelation& table = catalog.create_table("_bench_aggregate", {"few", "many", "amount"},
+		{ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::INT)});
+	ValueDicts chunk;
+	ValueDict row;
+	for (u_int32_t i = 0; i < rows; i++) {
+		row["few"] = Value((int32_t)(i % 16));
+		row["many"] = Value((int32_t)(i * 2654435761u % (rows / 2 + 1)));
+		row["amount"] = Value((int32_t)(i % 1000));
+		chunk.push_back(row);
+		if (chunk.size() == CHUNK || i + 1 == rows) {
+			delete table.insert_batch(&chunk);
+			chunk.clear();
+		}
+	}
+
+	std::cout << "aggregate " << rows << " rows:";
+	HashAggregate::Aggregates aggregates = {{HashAggregate::COUNT, 0}, {HashAggregate::SUM, 2}};
+	for (u_int32_t group : {0u, 1u}) {
+		for (size_t memory_budget : {HashAggregate::DEFAULT_MEMORY_BUDGET, HashAggregate::DEFAULT_MEMORY_BUDGET / 64}) {
+			HashAggregate* aggregate = new HashAggregate(new TableScan(table), {group}, aggregates, memory_budget);
+			RowBatch batch;
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			u_int32_t found = count_rows(aggregate, batch);
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			std::cout << " " << found << " groups" << (aggregate->get_partitions_written() > 0 ? " spilled: " : ": ")
+				<< rows / seconds << " rows/sec";
+			delete aggregate;
+		}
+	}
+	ColumnNames no_columns;
+	for (bool counted : {false, true}) {
+		Operator* plan = counted ? (Operator*)new TableCount(table)
+			: new HashAggregate(new TableScan(table, &no_columns), {}, {{HashAggregate::COUNT, 0}});
+		RowBatch batch;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		count_rows(plan, batch);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		std::cout << (counted ? " COUNT(*) from slots: " : " COUNT(*) from a scan: ") << rows / seconds << " rows/sec";
+		delete plan;
+	}
+	std::cout << std::endl;
+	catalog.drop();
+}
+
+// benchmark -- SELECT a, b FROM t WHERE c < 5 with the WHERE in a Filter, by one TableScan and by
+// ParallelScans of more and more threads (up to one per core)
+void bench_parallel_scan(u_int32_t rows) {
+	const u_int32_t CHUNK = 100000;
+	Catalog catalog("_bench_parallel_columns");
+	catalog.open();
+	DbRelation& table = catalog.create_table("_bench_parallel", {"a", "b", "c"},
+		{ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT), ColumnAttribute(ColumnAttribute::INT)});
+	ValueDicts chunk;
+	ValueDict row;
+	for (u_int32_t i = 0; i < rows; i++) {
+		row["a"] = Value((int32_t)i);
+		row["b"] = Value("row number " + to_string(i));
+		row["c"] = Value((int32_t)(i % 10));
+		chunk.push_back(row);
+		if (chunk.size() == CHUNK || i + 1 == rows) {
+			delete table.insert_batch(&chunk);
+			chunk.clear();
+		}
+	}
+
+	std::cout << "scan " << rows << " rows (" << table.get_block_count() << " blocks):";
+	ColumnNames used = {"a", "b", "c"};
+	for (u_int32_t workers = 0; workers <= ParallelScan::default_workers(); workers = workers == 0 ? 1 : workers * 2) {
+		TableScan* scan = workers == 0 ? new TableScan(table, &used) : new ParallelScan(table, workers, &used);
+		Operator* plan = new Filter(scan, Expression::binary(Expression::LT, Expression::column(2, ColumnAttribute::INT),
+			Expression::literal(5)));
+		RowBatch batch;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		u_int32_t found = count_rows(plan, batch);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (workers == 0)
+			std::cout << " one TableScan: ";
+		else
+			std::cout << " " << workers << (workers == 1 ? " thread: " : " threads: ");
+		std::cout << rows / seconds << " rows/sec (" << found << " found)";
+		delete plan;
+	}
+	std::cout << std::endl;
+	catalog.drop();
+}
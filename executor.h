@@ -0,0 +1,760 @@
+/**
+ * @file executor.h - Pull-based query operators that pass rows along in batches.
+ * RowBatch
+ * Expression
+ * Operator
+ * TableScan: Operator
+ * ParallelScan: TableScan
+ * Filter: Operator
+ * Project: Operator
+ * Limit: Operator
+ * HashJoin: Operator
+ * Sort: Operator
+ * HashAggregate: Operator
+ * TableCount: Operator
+ * PreparedStatement
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "storage_engine.h"
+
+class HeapTable;
+
+/**
+ * Values for the parameters (placeholders) of a PreparedStatement, in order.
+ */
+typedef std::vector<Value> Parameters;
+
+/**
+ * @class RowBatch - the rows one Operator::next() call hands back
+ *
+ * Rows past size keep their memory, so a batch reused call after call stops allocating
+ * once it has been filled.
+ */
+class RowBatch {
+public:
+	static const u_int32_t DEFAULT_CAPACITY = 1024;
+
+	Rows rows;       // rows[0..size) are the batch
+	u_int32_t size;
+
+	explicit RowBatch(u_int32_t capacity=DEFAULT_CAPACITY) : rows(capacity), size(0) {}
+
+	u_int32_t get_capacity() const {return (u_int32_t)rows.size();}
+	bool is_full() const {return size == rows.size();}
+
+	/**
+	 * @returns  the next row of the batch, holding whatever it held last time
+	 */
+	Row& add() {return rows[size++];}
+};
+
+/**
+ * @class Expression - a scalar expression compiled to be evaluated against an Operator's rows
+ *
+ * Leaves are columns (by position in the rows), literals and parameters; above them are comparisons,
+ * AND, OR, NOT and INT arithmetic. There are no booleans as such: comparisons and logic
+ * give INT 1 or 0, and a row passes a Filter if its predicate isn't 0. Types are checked
+ * when the expression is built, so evaluating one never fails except for dividing by 0.
+ */
+class Expression {
+public:
+	enum Op {
+		EQ,
+		NE,
+		LT,
+		LE,
+		GT,
+		GE,
+		AND,
+		OR,
+		NOT,
+		PLUS,
+		MINUS,
+		TIMES,
+		DIVIDE,
+		MODULO,
+		NEGATE
+	};
+
+	Expression(ColumnAttribute::DataType data_type) : data_type(data_type) {}
+	virtual ~Expression() {}
+	Expression(const Expression& other) = delete;
+	Expression(Expression&& temp) = delete;
+	Expression& operator=(const Expression& other) = delete;
+	Expression& operator=(Expression&& temp) = delete;
+
+	ColumnAttribute::DataType get_data_type() const {return data_type;}
+
+	static bool is_comparison(Op op) {return op <= GE;}
+
+	/**
+	 * @param row  a row of the input
+	 * @returns    the value of an INT expression
+	 * @throws     DbRelationError for division by 0
+	 */
+	virtual int32_t eval_int(const Row& row) const = 0;
+
+	/**
+	 * @param row  a row of the input
+	 * @returns    the value of a TEXT expression, good while the row and the expression are
+	 */
+	virtual RecordView eval_text(const Row& row) const = 0;
+
+	/**
+	 * @param row  a row of the input
+	 * @returns    the expression's value
+	 */
+	Value get(const Row& row) const {
+		if (data_type == ColumnAttribute::INT)
+			return Value(eval_int(row));
+		RecordView text = eval_text(row);
+		return Value(std::string(text.data, text.size));
+	}
+
+	/**
+	 * Evaluate into a column of another row.
+	 * @param row     a row of the input
+	 * @param column  which column of out
+	 * @param out     where the value goes
+	 */
+	void eval(const Row& row, u_int32_t column, Row& out) const {
+		if (data_type == ColumnAttribute::INT) {
+			out.set_int(column, eval_int(row));
+		}
+		else {
+			RecordView text = eval_text(row);
+			out.set_text(column, text.data, text.size);
+		}
+	}
+
+	/**
+	 * @param position   where the column is in the input's rows
+	 * @param data_type  its type
+	 * @returns          the column's value (freed by caller)
+	 */
+	static Expression* column(u_int32_t position, ColumnAttribute::DataType data_type);
+
+	static Expression* literal(int32_t n);
+	static Expression* literal(const std::string& s);
+
+	/**
+	 * @param parameters  where the values will be when it is evaluated
+	 * @param index       which of them
+	 * @param data_type   the type it has to be
+	 * @returns           the parameter's value at the time (freed by caller)
+	 */
+	static Expression* parameter(const Parameters* parameters, u_int32_t index, ColumnAttribute::DataType data_type);
+
+	/**
+	 * @param op       NOT or NEGATE
+	 * @param operand  an INT expression (owned by the result from now on)
+	 * @returns        op applied to it (freed by caller)
+	 * @throws         DbRelationError if operand is TEXT or op isn't unary
+	 */
+	static Expression* unary(Op op, Expression* operand);
+
+	/**
+	 * @param op     a comparison (INT or TEXT operands, the same on both sides), AND, OR or arithmetic (INT operands)
+	 * @param left   left operand (owned by the result from now on)
+	 * @param right  right operand (owned by the result from now on)
+	 * @returns      left op right (freed by caller)
+	 * @throws       DbRelationError if the operands' types don't suit op (they're freed)
+	 */
+	static Expression* binary(Op op, Expression* left, Expression* right);
+
+protected:
+	ColumnAttribute::DataType data_type;
+};
+
+/**
+ * @class Operator - one step of a query plan, pulled from by the step above it
+ *
+ * open(), then next() until it returns false, then close(). Each next() hands back up to
+ * a batch's worth of rows, so the per-call overhead of walking the plan is paid once per
+ * batch, not once per row. An Operator owns the operators and expressions it is built on.
+ */
+class Operator {
+public:
+	Operator(const ColumnNames& column_names, const ColumnAttributes& column_attributes)
+		: column_names(column_names), column_attributes(column_attributes) {}
+	virtual ~Operator() {}
+	Operator(const Operator& other) = delete;
+	Operator(Operator&& temp) = delete;
+	Operator& operator=(const Operator& other) = delete;
+	Operator& operator=(Operator&& temp) = delete;
+
+	/**
+	 * Get ready to hand back rows from the start (again, if it has been run before).
+	 */
+	virtual void open() = 0;
+
+	/**
+	 * Hand back the next rows.
+	 * @param batch  emptied, then filled with up to its capacity of rows
+	 * @returns      false, with batch empty, once there are no more rows
+	 */
+	virtual bool next(RowBatch& batch) = 0;
+
+	/**
+	 * Let go of what open() took hold of.
+	 */
+	virtual void close() = 0;
+
+	/**
+	 * @returns  names of the columns of the rows handed back, in column order
+	 */
+	const ColumnNames& get_column_names() const {return column_names;}
+	const ColumnAttributes& get_column_attributes() const {return column_attributes;}
+
+protected:
+	ColumnNames column_names;
+	ColumnAttributes column_attributes;
+};
+
+/**
+ * @class TableScan - the rows of a table, with the table's columns
+ *
+ * Only the columns asked for are decoded; the rest hold whatever they held. Column = value
+ * tests given as where are checked on the records' bytes in their blocks, by the table's
+ * own select, so rows that fail them are never decoded at all. A test's value can also be
+ * a parameter, looked up each time the scan is opened.
+ */
+class TableScan : public Operator {
+public:
+	/**
+	 * @param table    table to read (must stay open while the scan is)
+	 * @param columns  columns the plan uses (nullptr for all of them)
+	 * @param where    column = value tests for select_cursor (nullptr for none)
+	 */
+	TableScan(DbRelation& table, const ColumnNames* columns=nullptr, const ValueDict* where=nullptr);
+	virtual ~TableScan();
+
+	/**
+	 * Add a column = value test.
+	 * @param column_name  the column
+	 * @param value        expression with no columns in it, evaluated by open() (owned by the scan from now on)
+	 */
+	virtual void add_where(const Identifier& column_name, Expression* value);
+
+	virtual void open();
+	virtual bool next(RowBatch& batch);
+	virtual void close();
+
+protected:
+	DbRelation& table;
+	ColumnNames columns;
+	bool all_columns;
+	std::vector<std::pair<Identifier, Expression*>> where;  // not a ValueDict: the scan can outlive the statement's arena
+	HandleCursor* cursor;
+};
+
+/**
+ * @class ParallelScan - a TableScan split up among threads
+ *
+ * open() cuts the table into runs of MORSEL_BLOCKS blocks, each with a cursor of its own,
+ * and starts the workers. Each worker takes the next run no one has taken yet, scans it
+ * (testing where on the records' bytes, as TableScan does), and decodes the rows that pass
+ * into a batch of its own, queueing the batch when it is full. next() hands on the queued
+ * rows, so the rows come back in no particular order. Workers that get QUEUED_BATCHES
+ * batches each ahead of next() wait for it to catch up. An error in a worker is thrown
+ * from next().
+ */
+class ParallelScan : public TableScan {
+public:
+	static const u_int32_t MORSEL_BLOCKS = 16;   // blocks a worker takes at a time
+	static const u_int32_t QUEUED_BATCHES = 2;   // full batches, per worker, that can wait for next()
+
+	/**
+	 * @param table    table to read (must stay open while the scan is)
+	 * @param workers  threads to scan with
+	 * @param columns  columns the plan uses (nullptr for all of them)
+	 * @param where    column = value tests for select_cursor (nullptr for none)
+	 */
+	ParallelScan(DbRelation& table, u_int32_t workers, const ColumnNames* columns=nullptr,
+		const ValueDict* where=nullptr);
+	virtual ~ParallelScan();
+
+	virtual void open();
+
+	/**
+	 * @throws  whatever a worker ran into
+	 */
+	virtual bool next(RowBatch& batch);
+
+	/**
+	 * Stop the workers and wait for them.
+	 */
+	virtual void close();
+
+	/**
+	 * @returns  threads to scan with when nothing says otherwise: one per core
+	 */
+	static u_int32_t default_workers();
+
+	u_int32_t get_workers() const {return workers;}
+
+protected:
+	u_int32_t workers;
+	std::vector<u_int32_t> positions;     // of columns, unless all_columns
+	std::vector<HandleCursor*> morsels;   // a cursor per run of blocks (nullptr once a worker is done with it)
+	std::atomic<u_int32_t> claimed;       // runs taken by workers so far
+	std::vector<std::thread> threads;
+	std::mutex latch;                     // guards the rest
+	std::condition_variable queued;       // a batch was queued, or a worker finished
+	std::condition_variable taken;        // a batch was taken off the queue, or the scan is closing
+	std::deque<RowBatch*> full;
+	std::vector<RowBatch*> spare;
+	RowBatch* current;                    // next() only: the batch it's handing on, from row offset on
+	u_int32_t offset;
+	u_int32_t running;                    // workers still going
+	bool stopping;
+	std::exception_ptr error;
+	virtual void work();
+	virtual bool hand_over(RowBatch*& batch);
+};
+
+/**
+ * @class Filter - the rows of its input for which a predicate isn't 0
+ */
+class Filter : public Operator {
+public:
+	/**
+	 * @param input      rows to test
+	 * @param predicate  INT expression over input's rows
+	 */
+	Filter(Operator* input, Expression* predicate);
+	virtual ~Filter();
+
+	virtual void open() {input->open();}
+	virtual bool next(RowBatch& batch);
+	virtual void close() {input->close();}
+
+protected:
+	Operator* input;
+	Expression* predicate;
+};
+
+/**
+ * @class Project - rows of expressions computed from its input's rows
+ */
+class Project : public Operator {
+public:
+	/**
+	 * @param input         rows to compute from
+	 * @param expressions   one per column of the output
+	 * @param column_names  the output's column names
+	 */
+	Project(Operator* input, const std::vector<Expression*>& expressions, const ColumnNames& column_names);
+	virtual ~Project();
+
+	virtual void open() {input->open();}
+	virtual bool next(RowBatch& batch);
+	virtual void close() {input->close();}
+
+protected:
+	Operator* input;
+	std::vector<Expression*> expressions;
+	RowBatch incoming;
+};
+
+/**
+ * @class Limit - the first limit rows of its input after skipping offset of them
+ *
+ * Stops pulling from its input once it has handed back limit rows, so a scan under it
+ * reads no further than it has to.
+ */
+class Limit : public Operator {
+public:
+	Limit(Operator* input, u_int64_t limit, u_int64_t offset=0);
+	virtual ~Limit();
+
+	virtual void open();
+	virtual bool next(RowBatch& batch);
+	virtual void close() {input->close();}
+
+protected:
+	Operator* input;
+	u_int64_t limit;
+	u_int64_t offset;
+	u_int64_t skipped;
+	u_int64_t returned;
+};
+
+/**
+ * @class HashJoin - each row of its left input joined to each row of its right input with an equal key
+ *
+ * The rows handed back are the left row's columns followed by the right row's. One input, the
+ * build input, is read into a hash table on its key; the other, the probe input, is then read a
+ * batch at a time and looked up in it. Should the build rows come to more than the memory
+ * budget, both inputs are split by the hashes of their keys into partitions written out to
+ * temporary tables in the database environment, and the partitions are joined one at a time,
+ * so only one partition's build rows are in memory at once. A partition whose build rows are
+ * still over the budget is split again, on other bits of the hashes, up to MAX_SPILL_LEVELS
+ * deep, below which it is joined in memory anyway (as are rows that all have the same key).
+ */
+class HashJoin : public Operator {
+public:
+	static const u_int32_t PARTITIONS = 16;
+	static const u_int32_t MAX_SPILL_LEVELS = 4;
+	static const size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+	/**
+	 * @param left           input whose columns come first
+	 * @param right          input whose columns come after left's
+	 * @param left_key       where the key is in left's rows
+	 * @param right_key      where the key is in right's rows (of the same type as left's)
+	 * @param build_left     true to build the hash table from left, false from right (best the smaller one)
+	 * @param memory_budget  bytes of build rows to hold before spilling
+	 * @throws               DbRelationError if the keys' types differ (left and right are freed)
+	 */
+	HashJoin(Operator* left, Operator* right, u_int32_t left_key, u_int32_t right_key, bool build_left=false,
+		size_t memory_budget=DEFAULT_MEMORY_BUDGET);
+	virtual ~HashJoin();
+
+	virtual void open();
+	virtual bool next(RowBatch& batch);
+	virtual void close();
+
+	/**
+	 * @returns  true if the last open() had to spill to partitions
+	 */
+	bool is_spilled() const {return spilled;}
+
+	/**
+	 * @returns  how many partitions of the build input the last open() wrote out (0 if it fit in memory)
+	 */
+	u_int32_t get_partitions_written() const {return partitions_written;}
+
+protected:
+	/**
+	 * A build partition and the probe partition to join it with.
+	 */
+	struct Partition {
+		DbRelation* build;
+		DbRelation* probe;
+		u_int32_t level;  // how many times their rows have been split
+	};
+
+	static const u_int32_t NONE = 0xffffffff;
+	Operator* left;
+	Operator* right;
+	u_int32_t left_key;
+	u_int32_t right_key;
+	bool build_left;
+	size_t memory_budget;
+	Rows built;                        // the build rows in the hash table,
+	std::vector<u_int32_t> hashes;     // the hash of each one's key,
+	std::vector<u_int32_t> chain;      // and the next one in its bucket
+	std::vector<u_int32_t> buckets;    // first build row in each bucket
+	size_t memory;                     // bytes in built
+	bool spilled;
+	u_int32_t level;                         // how many times the rows being built have been split
+	std::vector<DbRelation*> partitions[2];  // build's and probe's, while being written
+	std::vector<Partition> pending;          // written, still to join
+	Partition joining;                       // the one being joined (or split again)
+	u_int32_t partitions_written;
+	HandleCursor* cursor;                    // reading the probe partition being joined
+	Row staged;                              // a row on its way out to a partition
+	RowBatch probe;                          // probe rows being looked up,
+	u_int32_t probe_row;                     // the one being looked up,
+	u_int32_t probe_hash;                    // its key's hash,
+	u_int32_t match;                         // and the next build row it might match
+
+	Operator* build_input() {return build_left ? left : right;}
+	Operator* probe_input() {return build_left ? right : left;}
+	u_int32_t build_key() const {return build_left ? left_key : right_key;}
+	u_int32_t probe_key() const {return build_left ? right_key : left_key;}
+	virtual void add_build_row(const Row& row, u_int32_t hash);
+	virtual void index_build_rows();
+	virtual void spill();
+	virtual void spill_row(u_int32_t side, const Row& row, u_int32_t hash);
+	virtual void finish_partitions();
+	virtual void load_partition();
+	virtual bool next_probe_batch();
+	virtual void drop_partitions();
+};
+
+/**
+ * @class Sort - the rows of its input in order of some of their columns
+ *
+ * Rows are compared on a fixed-width prefix of their keys first: the INT keys as big-endian
+ * bytes with the sign bit flipped, up to and including the first TEXT key's leading bytes,
+ * every byte inverted for a descending key. Only rows whose prefixes are equal, and only when
+ * the prefix doesn't hold all of the keys, go on to compare the columns themselves.
+ *
+ * Rows held for sorting that come to more than the memory budget are sorted and written out
+ * as a run to a temporary table in the database environment. Once the input is used up the
+ * runs are merged with a loser tree, MERGE_FAN_IN at a time, in passes writing longer runs if
+ * there are more of them than that. When only the first limit rows are wanted, only those are
+ * kept of the rows held, and rows that sort after the last of them aren't kept at all.
+ */
+class Sort : public Operator {
+public:
+	/**
+	 * A column to sort on, and which way.
+	 */
+	struct Key {
+		u_int32_t column;
+		bool descending;
+	};
+	typedef std::vector<Key> Keys;
+
+	static const u_int64_t NO_LIMIT = 0xffffffffffffffffULL;
+	static const size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+	static const u_int32_t MERGE_FAN_IN = 64;
+
+	/**
+	 * @param input          rows to sort
+	 * @param keys           columns to sort on, most significant first
+	 * @param limit          how many rows are wanted, from the first in order (NO_LIMIT for all)
+	 * @param memory_budget  bytes of rows to hold before writing them out as a sorted run
+	 */
+	Sort(Operator* input, const Keys& keys, u_int64_t limit=NO_LIMIT, size_t memory_budget=DEFAULT_MEMORY_BUDGET);
+	virtual ~Sort();
+
+	virtual void open();
+	virtual bool next(RowBatch& batch);
+	virtual void close();
+
+	/**
+	 * @returns  how many sorted runs the last open() wrote out (0 if it sorted in memory)
+	 */
+	u_int32_t get_runs_written() const {return runs_written;}
+
+protected:
+	static const u_int32_t NONE = 0xffffffff;
+	struct Entry {
+		u_int64_t prefix[2];  // the keys' first 16 bytes, to be compared as unsigned big-endian
+		u_int32_t row;
+	};
+	Operator* input;
+	Keys keys;
+	u_int64_t limit;
+	size_t memory_budget;
+	bool whole_keys;                 // true if the prefix holds all of the keys
+	Rows rows;                       // rows held,
+	std::vector<Entry> entries;      // an entry for each, sorted once the input is used up
+	size_t memory;                   // bytes in rows and entries
+	bool has_cutoff;                 // when there's a limit, rows that sort after this one
+	Entry cutoff;                    // aren't among the first limit
+	Row cutoff_row;
+	std::vector<HeapTable*> runs;
+	u_int32_t runs_written;
+	u_int32_t next_entry;            // in memory, the next entry to hand back
+	std::vector<HandleCursor*> cursors;  // merging, a cursor on each run,
+	Rows heads;                      // the row each is at,
+	std::vector<Entry> head_entries; // its entry (row NONE once the run is used up),
+	std::vector<u_int32_t> tree;     // and the loser tree: tree[0] the winner, tree[1..] the losers
+	u_int64_t returned;
+
+	void make_entry(const Row& row, u_int32_t position, Entry& entry) const;
+	int compare(const Entry& a, const Row& a_row, const Entry& b, const Row& b_row) const;
+	virtual void add(const Row& row);
+	virtual void sort_entries();
+	virtual void prune();
+	virtual void write_run();
+	virtual void open_runs(u_int32_t count);
+	virtual void advance(u_int32_t run);
+	virtual void close_runs(bool drop);
+	bool beats(u_int32_t a, u_int32_t b) const;
+	virtual void replay(u_int32_t run);
+};
+
+/**
+ * @class HashAggregate - one row for each group of its input's rows with equal group columns
+ *
+ * The rows handed back are the group columns followed by an aggregate of each group's rows
+ * for each of the aggregates asked for. With no group columns there is one group of all the
+ * rows, handed back even when there are none (COUNT and SUM 0, MIN and MAX 0 or '').
+ *
+ * Groups are found in an open-addressing hash table, each with its group columns and MIN
+ * and MAX values in a row and a 64-bit count or sum for each COUNT and SUM. A batch is
+ * aggregated on its own first, in a small table of its rows, so the groups' table is
+ * looked up once for each group in the batch rather than once for each row. Should the
+ * groups come to more than the memory budget, they are written out, aggregated as far as
+ * they go, to partitions by their hashes in temporary tables in the database environment,
+ * and the table starts over; each partition is aggregated in turn once the input is used
+ * up (and may be split again, up to MAX_SPILL_LEVELS deep, below which it stays in memory).
+ * Group and aggregated columns have to be decoded in the input's rows.
+ */
+class HashAggregate : public Operator {
+public:
+	enum Function {
+		COUNT,
+		SUM,
+		MIN,
+		MAX
+	};
+
+	/**
+	 * An aggregate of an input column: COUNT counts rows (of any column, there being no
+	 * NULLs), SUM adds up an INT column, MIN and MAX keep the least or greatest value.
+	 */
+	struct Aggregate {
+		Function function;
+		u_int32_t column;
+	};
+	typedef std::vector<Aggregate> Aggregates;
+
+	static const u_int32_t PARTITIONS = 16;
+	static const u_int32_t MAX_SPILL_LEVELS = 4;
+	static const size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+	/**
+	 * @param input          rows to aggregate
+	 * @param group_by       which of input's columns to group them by
+	 * @param aggregates     what to work out for each group
+	 * @param memory_budget  bytes of groups to hold before spilling
+	 * @throws               DbRelationError for a SUM of a TEXT column (input is freed)
+	 */
+	HashAggregate(Operator* input, const std::vector<u_int32_t>& group_by, const Aggregates& aggregates,
+		size_t memory_budget=DEFAULT_MEMORY_BUDGET);
+	virtual ~HashAggregate();
+
+	virtual void open();
+
+	/**
+	 * @throws  DbRelationError for a COUNT or SUM too big for an INT
+	 */
+	virtual bool next(RowBatch& batch);
+	virtual void close();
+
+	/**
+	 * @returns  how many partitions the last open() wrote out (0 if the groups fit in memory)
+	 */
+	u_int32_t get_partitions_written() const {return partitions_written;}
+
+	/**
+	 * @returns  the name of a function, as in SQL
+	 */
+	static const char* function_name(Function function);
+
+protected:
+	static const u_int32_t NONE = 0xffffffff;
+	Operator* input;
+	std::vector<u_int32_t> group_by;
+	Aggregates aggregates;
+	size_t memory_budget;
+	Rows groups;                       // each group's row as it will be handed back,
+	std::vector<u_int32_t> hashes;     // the hash of its group columns,
+	std::vector<int64_t> states;       // and its counts and sums, aggregates.size() to a group
+	std::vector<u_int32_t> slots;      // the hash table: a group, or NONE
+	size_t memory;                     // bytes of groups
+	std::vector<u_int32_t> batch_hashes;     // the batch being added: each row's hash,
+	std::vector<u_int32_t> batch_slots;      // a table of its first row of each group,
+	std::vector<u_int32_t> batch_groups;     // those rows in order,
+	std::vector<int64_t> batch_states;       // and their counts and sums, or for MIN and MAX the row that has it
+	std::vector<u_int32_t> partial_keys;     // where the group columns are in a partition's rows,
+	std::vector<u_int32_t> partial_columns;  // and each aggregate so far (a count or sum is two INTs, high then low)
+	ColumnAttributes partial_attributes;
+	u_int32_t level;                          // how many times the rows being aggregated have been spilled
+	std::vector<HeapTable*> spilling;         // the partitions they are spilling to, if any
+	std::vector<std::pair<HeapTable*, u_int32_t>> pending;  // partitions still to aggregate, and their levels
+	u_int32_t partitions_written;
+	u_int32_t next_group;
+
+	virtual void add_batch(const RowBatch& batch, bool partial);
+	virtual u_int32_t find_group(const Row& row, u_int32_t hash, bool partial);
+	virtual void accumulate(u_int32_t first, const RowBatch& batch, u_int32_t row, bool partial);
+	virtual void merge(u_int32_t group, const RowBatch& batch, u_int32_t first, bool partial);
+	virtual void spill();
+	virtual void finish_source();
+	virtual void aggregate_partition();
+	virtual void clear_groups();
+	virtual void grow_slots();
+};
+
+/**
+ * @class TableCount - a table's number of rows, in a single INT column
+ *
+ * SELECT COUNT(*) FROM table, read off the blocks' headers by DbRelation::count() with no
+ * row decoded or even handed up through a scan.
+ */
+class TableCount : public Operator {
+public:
+	/**
+	 * @param table  table to count (must stay open while the operator is)
+	 * @param name   the column's name
+	 */
+	TableCount(DbRelation& table, const Identifier& name="count");
+	virtual ~TableCount() {}
+
+	virtual void open() {done = false;}
+
+	/**
+	 * @throws  DbRelationError if the count is too big for an INT
+	 */
+	virtual bool next(RowBatch& batch);
+	virtual void close() {}
+
+protected:
+	DbRelation& table;
+	bool done;
+};
+
+/**
+ * @class PreparedStatement - a SELECT or INSERT planned once, to be run again and again
+ *
+ * Its parameters are read by its expressions as they are evaluated, so bind() is all it
+ * takes to run it with new values. The tables it uses have to stay open while it lives.
+ * A SELECT's plan is chosen by the sizes of its tables, which it remembers, so it can tell
+ * when they have changed enough that another plan may be better.
+ */
+class PreparedStatement {
+public:
+	Parameters parameters;                                   // bound for the next run
+	std::vector<ColumnAttribute::DataType> parameter_types;  // what each one has to be
+	Operator* plan;                                          // a SELECT's plan
+	DbRelation* table;                                       // an INSERT's table,
+	std::vector<Expression*> values;                         // and a value for each of its columns
+	std::vector<std::pair<DbRelation*, u_int32_t>> planned_blocks;  // each table planned on, and its block count then
+
+	static const u_int32_t REPLAN_FACTOR = 2;
+
+	PreparedStatement() : parameters(), parameter_types(), plan(nullptr), table(nullptr), values(), planned_blocks() {}
+	virtual ~PreparedStatement();
+	PreparedStatement(const PreparedStatement& other) = delete;
+	PreparedStatement(PreparedStatement&& temp) = delete;
+	PreparedStatement& operator=(const PreparedStatement& other) = delete;
+	PreparedStatement& operator=(PreparedStatement&& temp) = delete;
+
+	bool is_select() const {return plan != nullptr;}
+
+	/**
+	 * @returns  true if one of the tables the plan was chosen for has since grown or shrunk
+	 *           REPLAN_FACTOR times over, so the statement is worth planning again
+	 */
+	virtual bool is_stale() const;
+
+	/**
+	 * Set the parameters for the next run.
+	 * @param parameters  a value for each parameter
+	 * @throws            DbRelationError for the wrong number of values or one of the wrong type
+	 */
+	virtual void bind(const Parameters& parameters);
+
+	/**
+	 * Run an INSERT with the parameters bound.
+	 * @returns  the new row's handle
+	 */
+	virtual Handle insert();
+};
+
+bool test_executor();
+void bench_executor();
+void bench_join(u_int32_t build_rows=1000000, u_int32_t probe_rows=10000000);
+void bench_sort(u_int32_t rows=1000000);
+void bench_aggregate(u_int32_t rows=1000000);
+void bench_parallel_scan(u_int32_t rows=4000000);
@@ -14,6 +14,10 @@
 #include "db_cxx.h"
 #include "storage_engine.h"
 #include "heap_storage.h"
+#include "buffer_pool.h"
+#include "mmap_heap_file.h"
+#include "page_codec.h"
+#include "int_filter.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,6 +26,13 @@
 #include <string>
 #include <cstring>
 #include <iostream>
+#include <fstream>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 #include <memory.h>
 using namespace std;
 
@@ -42,6 +53,11 @@ etc.
 */
 
 typedef u_int16_t u16;
+typedef u_int32_t u32;
+
+bool SlottedPage::defer_compaction = false;
+u_int32_t SlottedPage::compactions = 0;
+u_int32_t SlottedPage::compactions_avoided = 0;
 
 
 /******************SlottedPage protected functions implementation*************************/
@@ -51,58 +67,101 @@ typedef u_int16_t u16;
 //Paramaters: BlockID - id within DbFile
 SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(block, block_id, is_new) {
 	if (is_new) {
-		this->num_records = 0;
-		this->end_free = DbBlock::BLOCK_SZ - 1;
-		put_header();
+		initialize_new();
 	}
 	else {
 		get_header(this->num_records, this->end_free);
 	}
 }
 
+// Empty the block out
+void SlottedPage::initialize_new() {
+	this->num_records = 0;
+	this->end_free = block_size() - 1;
+	put_header();
+}
+
 // Add a new record to the block. Return its id.
 RecordID SlottedPage::add(const Dbt* data) throw(DbBlockNoRoomError) {
-	if (!has_room(data->get_size()))
+	RecordID id;
+	char* bytes = reserve(data->get_size(), id);
+	memcpy(bytes, data->get_data(), data->get_size());
+	return id;
+}
+
+// Add a new record of the given size, but leave filling it in to the caller
+char* SlottedPage::reserve(u32 size, RecordID &record_id) throw(DbBlockNoRoomError) {
+	if (this->num_records >= MAX_RECORDS || !make_room(size))
 		throw DbBlockNoRoomError("not enough room for new record");
-	u16 id = ++this->num_records;
-	u16 size = (u16)data->get_size();
+	record_id = ++this->num_records;
 	this->end_free -= size;
-	u16 loc = this->end_free + 1;
+	u32 loc = this->end_free + 1;
 	put_header();
-	put_header(id, size, loc);
-	memcpy(this->address(loc), data->get_data(), size);
-	return id;
+	put_header(record_id, size, loc);
+	return (char*)this->address(loc);
 }
 
 //Get a record from the block. Return none if it has been deleted
 Dbt* SlottedPage::get(RecordID record_id) {
-	u_int16_t size;
-	u_int16_t loc;
+	RecordView record = view(record_id);
+	if (record.is_null()) {
+		return nullptr;
+	}
+	return new Dbt((void*)record.data, record.size);
+}
+
+//Same as get, but just points into the block instead of allocating a Dbt
+RecordView SlottedPage::view(RecordID record_id) {
+	u32 size;
+	u32 loc;
 
 	get_header(size, loc, record_id);
 	if (loc == 0) {
-		return nullptr;
+		return RecordView();
 	}
-	return new Dbt(this->address(loc), size);
+	return RecordView((const char*)this->address(loc), size);
+}
+
+//Pick up the header of whatever block is now in the given memory
+void SlottedPage::load(Dbt &block, BlockID block_id) {
+	this->block = block;
+	this->block_id = block_id;
+	get_header(this->num_records, this->end_free);
 }
 
 //Replace the record with the given data. Raises ValueError if it won't fit
 void SlottedPage::put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError) {
-	u_int16_t size;
-	u_int16_t loc;
+	u32 size;
+	u32 loc;
 
 	get_header(size, loc, record_id);
 
-	u_int16_t new_size = (u_int16_t)data.get_size();
+	u32 new_size = data.get_size();
 
 	if (new_size > size) {
-		u_int16_t extra = new_size - size;
-		if (!this->has_room(extra)) {
+		u32 extra = new_size - size;
+		if (defer_compaction && this->has_room(new_size)) {
+			// write it fresh at the front of the data and leave the old copy as dead space
+			this->end_free -= new_size;
+			loc = this->end_free + 1;
+			memcpy(this->address(loc), data.get_data(), new_size);
+			put_header();
+			put_header(record_id, new_size, loc);
+			compactions_avoided++;
+			return;
+		}
+		if (!this->make_room(extra)) {
 			throw DbBlockNoRoomError("not enough room for new record");
 		}
+		get_header(size, loc, record_id); // compaction may have moved it
 		this->slide(loc, loc - extra);
 		memcpy(this->address(loc - extra), data.get_data(), new_size);
 	}
+	else if (defer_compaction) {
+		memcpy(this->address(loc), data.get_data(), new_size);
+		if (new_size < size)
+			compactions_avoided++;
+	}
 	else {
 		memcpy(this->address(loc), data.get_data(), new_size);
 		this->slide(loc + new_size, loc + size);
@@ -115,21 +174,24 @@ void SlottedPage::put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomEr
 //Mark the given record_id as deleted by changing its size to zero and its location to 0.
 //Compact the rest of the data in the block. But keep the record ids the same for everyone.
 void SlottedPage::del(RecordID record_id) {
-	u_int16_t size;
-	u_int16_t loc;
+	u32 size;
+	u32 loc;
 
 	get_header(size, loc, record_id);
 	put_header(record_id, 0, 0);
-	this->slide(loc, loc + size);
+	if (defer_compaction)
+		compactions_avoided++;
+	else
+		this->slide(loc, loc + size);
 }
 
 //Sequence of all non-deleted record ids.
 RecordIDs* SlottedPage::ids(void) {
-	u_int16_t size;
-	u_int16_t loc;
+	u32 size;
+	u32 loc;
 	RecordIDs* temp = new RecordIDs;
 
-	for (u_int16_t i = 1; i <= this->num_records; i++) {
+	for (u32 i = 1; i <= this->num_records; i++) {
 		get_header(size, loc, i);
 		if (loc != 0) {
 			temp->push_back(i);
@@ -138,78 +200,182 @@ RecordIDs* SlottedPage::ids(void) {
 	return temp;
 }
 
+//Next non-deleted record id after prev (0 if none). Walks the slot directory in place.
+RecordID SlottedPage::next_id(RecordID prev) {
+	u32 size;
+	u32 loc;
+
+	for (u32 i = (u32)prev + 1; i <= this->num_records; i++) {
+		get_header(size, loc, i);
+		if (loc != 0)
+			return i;
+	}
+	return 0;
+}
+
+//Live slots in the directory; no record is looked at
+u_int32_t SlottedPage::count_records() {
+	u32 size;
+	u32 loc;
+	u32 count = 0;
+
+	for (u32 i = 1; i <= this->num_records; i++) {
+		get_header(size, loc, i);
+		if (loc != 0)
+			count++;
+	}
+	return count;
+}
+
 //Get the size and offset for given record_id. For record_id of zero, it is the block header
-void SlottedPage::get_header(u_int16_t &size, u_int16_t &loc, RecordID id) {
-	size = get_n(4 * id);
-	loc = get_n(4 * id + 2);
+void SlottedPage::get_header(u32 &size, u32 &loc, RecordID id) {
+	if (is_wide()) {
+		size = get_wide_n(8 * id);
+		loc = get_wide_n(8 * id + 4);
+	}
+	else {
+		size = get_n(4 * id);
+		loc = get_n(4 * id + 2);
+	}
 }
 
 //Provided by Professor Lundeen
 //Put the size and offset for given record_id. For record_id of zero, store the block header
-void SlottedPage::put_header(RecordID id, u_int16_t size, u_int16_t loc) {
+void SlottedPage::put_header(RecordID id, u32 size, u32 loc) {
 	if (id == 0) { // called the put_header() version and using the default params
 		size = this->num_records;
 		loc = this->end_free;
 	}
-	put_n(4 * id, size);
-	put_n(4 * id + 2, loc);
+	if (is_wide()) {
+		put_wide_n(8 * id, size);
+		put_wide_n(8 * id + 4, loc);
+	}
+	else {
+		put_n(4 * id, (u16)size);
+		put_n(4 * id + 2, (u16)loc);
+	}
 }
 
-//Calculate if we have room to store a record with given size. The size should include the
-//4 bytes for the header, too, if this is an add
-bool SlottedPage::has_room(u_int16_t size) {
-	u_int16_t available;
-	available = this->end_free - (this->num_records + 2) * 4;
+//Calculate if we have room to store a record with given size. Accounts for the new record's
+//slot, too, in case this is an add
+bool SlottedPage::has_room(u32 size) {
+	u32 headers = (this->num_records + 2) * slot_size();
+	if (this->end_free < headers)
+		return false;
+	u32 available = this->end_free - headers;
 	return (size <= available);
 }
 
+//Biggest record add() could take, counting dead space that compaction would reclaim
+u_int32_t SlottedPage::free_space() {
+	u32 headers = (this->num_records + 2) * slot_size();
+	u_int32_t available = this->end_free < headers ? 0 : this->end_free - headers;
+	if (defer_compaction)
+		available += dead_space();
+	return available;
+}
+
+//Bytes in the data area not belonging to any live record (only nonzero when deferring)
+u32 SlottedPage::dead_space() {
+	u32 size;
+	u32 loc;
+	u32 live = 0;
+
+	for (u32 i = 1; i <= this->num_records; i++) {
+		get_header(size, loc, i);
+		if (loc != 0)
+			live += size;
+	}
+	return (block_size() - 1 - this->end_free) - live;
+}
+
+//Like has_room, but if we are deferring compaction and the dead space would make the
+//difference, compact the page first
+bool SlottedPage::make_room(u32 size) {
+	if (has_room(size))
+		return true;
+	if (!defer_compaction)
+		return false;
+	compact();
+	return has_room(size);
+}
+
+//Squeeze out all the dead space in one pass, packing the live records against the end of
+//the block. Record ids stay the same; only their offsets change.
+void SlottedPage::compact() {
+	char* scratch = new char[block_size()]; // compaction is rare enough not to need a pool
+	u32 size;
+	u32 loc;
+
+	memcpy(scratch, this->address(0), block_size());
+	this->end_free = block_size() - 1;
+	for (u32 i = 1; i <= this->num_records; i++) {
+		get_header(size, loc, i);
+		if (loc == 0)
+			continue;
+		this->end_free -= size;
+		memcpy(this->address(this->end_free + 1), scratch + loc, size);
+		put_header(i, size, this->end_free + 1);
+	}
+	put_header();
+	delete[] scratch;
+	compactions++;
+}
+
 /**If start < end, then remove data from offset start up to but not including offset end by
 *sliding data that is to the left of start to the right. If start > end, then make room for
 *extra data from end to start by sliding data that is to the left of start to the left.
 *Also fix up any record headers whose data has slid. Assumes there is enough room if it is
 *left shift (end < start).
 */
-void SlottedPage::slide(u_int16_t start, u_int16_t end) {
-	u_int16_t shift;
-	shift = end - start;
+void SlottedPage::slide(u32 start, u32 end) {
+	u32 shift;
+	shift = end - start;  // unsigned wrap-around makes loc += shift work for left shifts, too
 	if (shift == 0){
 		return;
 	}
 
-	//slide data
-	memcpy(this->address(this->end_free + 1 + shift), this->address(this->end_free + 1), shift);
+	//slide data (the regions can overlap)
+	u32 from = this->end_free + 1;
+	memmove(this->address(from + shift), this->address(from), start - from);
 
-	//fixup headers
-	u_int16_t loc;
-	u_int16_t size;
-	//RecordIDs* temp = new RecordIDs();
-	RecordIDs* temp = this->ids();
-
-	for (unsigned int i = 0; i < temp->size(); i++) {
-		get_header(size, loc, temp->at(i));
-		if (loc <= start) {
+	//fixup headers in place, walking the slot directory directly
+	u32 loc;
+	u32 size;
+	for (u32 i = 1; i <= this->num_records; i++) {
+		get_header(size, loc, i);
+		if (loc != 0 && loc <= start) {
 			loc += shift;
-			put_header(temp->at(i), size, loc);
+			put_header(i, size, loc);
 		}
 	}
 
 	this->end_free += shift;
 	this->put_header();
-	delete temp;
 }
 
 // Get 2-byte integer at given offset in block.
-u16 SlottedPage::get_n(u16 offset) {
+u16 SlottedPage::get_n(u32 offset) {
 	return *(u16*)this->address(offset);
 }
 
 // Put a 2-byte integer at given offset in block.
-void SlottedPage::put_n(u16 offset, u16 n) {
+void SlottedPage::put_n(u32 offset, u16 n) {
 	*(u16*)this->address(offset) = n;
 }
 
+// Get 4-byte integer at given offset in block (wide slot entries).
+u32 SlottedPage::get_wide_n(u32 offset) {
+	return *(u32*)this->address(offset);
+}
+
+// Put a 4-byte integer at given offset in block (wide slot entries).
+void SlottedPage::put_wide_n(u32 offset, u32 n) {
+	*(u32*)this->address(offset) = n;
+}
+
 // Make a void* pointer for a given offset into the data block.
-void* SlottedPage::address(u16 offset) {
+void* SlottedPage::address(u32 offset) {
 	return (void*)((char*)this->block.get_data() + offset);
 }
 
@@ -227,15 +393,159 @@ void HeapFile::db_open(uint flags) {
 	}
 
 
-	this->db.set_re_len(DbBlock::BLOCK_SZ);
+	// existing files already know their record length; compressed ones have variable-length
+	// records (no re_len) that each start with the block size
+	if (flags && !this->compress)
+		this->db.set_re_len(this->block_sz);
 	const char* path = nullptr;
 	_DB_ENV->get_home(&path);
 	this->dbfilename = "./" + this->name + ".db"; //Get a db::open Is a directory otherwise
-	this->db.open(nullptr, (this->dbfilename).c_str(), nullptr, DB_RECNO, flags, 0644);
-	DB_BTREE_STAT *stat;
-	this->db.stat(nullptr, &stat, DB_FAST_STAT);
-	this->last = flags ? 0 : stat->bt_ndata;
+	// DB_THREAD: parallel scans read blocks through this one handle from several threads
+	this->db.open(nullptr, (this->dbfilename).c_str(), nullptr, DB_RECNO, flags | DB_THREAD, 0644);
+	u_int32_t re_len = 0;
+	this->db.get_re_len(&re_len);
+	this->compress = re_len == 0;
+	if (!this->compress) {
+		this->block_sz = re_len;
+	}
+	else if (!flags) {
+		BlockID first = 1;
+		Dbt key(&first, sizeof(first));
+		Dbt data;
+		data.set_flags(DB_DBT_MALLOC);  // a DB_THREAD handle has no memory of its own to lend
+		this->db.get(nullptr, &key, &data, 0);
+		memcpy(&this->block_sz, data.get_data(), sizeof(this->block_sz));
+		free(data.get_data());
+	}
+	this->compression = CompressionStats();
 	this->closed = false;
+
+	// The free-space map covers exactly the blocks up to last, and its side file is only
+	// there after a close() (or the HeapFile going away while open), so it also tells us
+	// last. It is removed while we have the file open; otherwise count the records, step
+	// back over the empty preallocated blocks at the end, and rescan.
+	if (flags) {
+		this->last = this->allocated = 0;
+		this->fsm.create(fsm_path(), this->block_sz);
+	}
+	else if (this->fsm.load(fsm_path(), this->block_sz)) {
+		this->last = this->allocated = this->fsm.size();
+		std::remove(fsm_path().c_str());
+	}
+	else {
+		DB_BTREE_STAT *stat;
+		this->db.stat(nullptr, &stat, DB_FAST_STAT);
+		this->allocated = stat->bt_ndata;
+		free(stat);
+		this->last = last_used(this->allocated);
+		rebuild_fsm();
+	}
+}
+
+//Going back from end, the first block that isn't an empty SlottedPage (block 1 at the least).
+//Used after a crash, when only the file's record count is left to go on.
+BlockID HeapFile::last_used(BlockID end) {
+	std::vector<char> bytes(this->block_sz);
+	Dbt data(bytes.data(), this->block_sz);
+	for (; end > 1; end--) {
+		fetch(end, bytes.data());
+		if (PaxPage::is_pax(bytes.data()))
+			break;
+		SlottedPage page(data, end, false);
+		if (page.count_records() != 0)
+			break;
+	}
+	return end;
+}
+
+//Add the next extent of blocks, as empty pages, if block_id is past the end of the file
+void HeapFile::extend(BlockID block_id) {
+	if (block_id <= this->allocated)
+		return;
+	std::vector<char> block(this->block_sz, 0);
+	Dbt data(block.data(), this->block_sz);
+	SlottedPage empty(data, 0, true);
+	BlockID end = block_id + this->extent - 1;
+	for (BlockID id = this->allocated + 1; id <= end; id++)
+		store(id, block.data());
+	this->allocated = end;
+}
+
+//Compressed record: block size, compressed size (0 if it didn't shrink and is stored as is), bytes
+static const u_int32_t PACKED_HEADER = 2 * sizeof(u_int32_t);
+
+//Put one block's bytes in the database file, compressing them if this file does that
+void HeapFile::store(BlockID block_id, const char* bytes) {
+	Dbt key(&block_id, sizeof(block_id));
+	if (!this->compress) {
+		Dbt data((void*)bytes, this->block_sz);
+		this->db.put(nullptr, &key, &data, 0);
+		return;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	this->packed.resize(PACKED_HEADER + PageCodec::max_packed_size(this->block_sz));
+	char* out = this->packed.data();
+	u_int32_t size = PageCodec::compress(bytes, this->block_sz, out + PACKED_HEADER);
+	if (size >= this->block_sz) {
+		memcpy(out + PACKED_HEADER, bytes, this->block_sz);
+		size = 0;
+	}
+	memcpy(out, &this->block_sz, sizeof(u_int32_t));
+	memcpy(out + sizeof(u_int32_t), &size, sizeof(u_int32_t));
+	u_int32_t stored = PACKED_HEADER + (size ? size : this->block_sz);
+	Dbt data(out, stored);
+	this->db.put(nullptr, &key, &data, 0);
+	this->compression.pages_packed++;
+	this->compression.bytes_in += this->block_sz;
+	this->compression.bytes_out += stored;
+	this->compression.pack_seconds +=
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//Read one block's bytes from the database file into the given block_sz bytes of memory
+void HeapFile::fetch(BlockID block_id, char* bytes) {
+	Dbt key(&block_id, sizeof(block_id));
+	if (!this->compress) {
+		Dbt data(bytes, this->block_sz);
+		data.set_ulen(this->block_sz);
+		data.set_flags(DB_DBT_USERMEM);
+		this->db.get(nullptr, &key, &data, 0);
+		return;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Dbt data;
+	data.set_flags(DB_DBT_MALLOC);
+	this->db.get(nullptr, &key, &data, 0);
+	const char* in = (const char*)data.get_data();
+	u_int32_t size;
+	memcpy(&size, in + sizeof(u_int32_t), sizeof(u_int32_t));
+	if (size == 0)
+		memcpy(bytes, in + PACKED_HEADER, this->block_sz);
+	else
+		PageCodec::decompress(in + PACKED_HEADER, size, bytes, this->block_sz);
+	free(data.get_data());
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::lock_guard<std::mutex> lock(this->stats_latch);  // scan threads unpack blocks side by side
+	this->compression.pages_unpacked++;
+	this->compression.unpack_seconds += seconds;
+}
+
+//Side file for the free-space map, next to the Berkeley DB file in the environment home
+std::string HeapFile::fsm_path() {
+	const char* home = nullptr;
+	_DB_ENV->get_home(&home);
+	return std::string(home) + "/" + this->name + ".fsm";
+}
+
+//Missing or out-of-date side file: scan every block to recompute its free space
+void HeapFile::rebuild_fsm() {
+	PinnedPage pinned;
+	this->fsm.create(fsm_path(), this->block_sz);
+	for (BlockID block_id = 1; block_id <= this->last; block_id++) {
+		pin(block_id, pinned);
+		SlottedPage* page = pinned.get_page();
+		this->fsm.update(block_id, this->measure ? this->measure(page) : page->free_space());
+	}
 }
 
 //Create physical File
@@ -250,6 +560,14 @@ void HeapFile::drop(void) {
 	close();
 	Db db(_DB_ENV, 0);
 	db.remove(this->dbfilename.c_str(), nullptr, 0);
+	this->fsm.drop();
+}
+
+//Write back and forget any of our blocks still in the buffer pool, keeping the map if still open
+HeapFile::~HeapFile() {
+	BufferPool::instance().release(this);
+	if (!this->closed)
+		this->fsm.save();  // so the next open() still knows last
 }
 
 //Open physical file
@@ -260,6 +578,9 @@ void HeapFile::open(void) {
 //Close file
 void HeapFile::close(void) {
 	//this->write_lock = 1;
+	BufferPool::instance().release(this);
+	if (!closed)
+		fsm.save();
 	db.close(0);
 	closed = true;
 
@@ -267,47 +588,282 @@ void HeapFile::close(void) {
 
 //Get a block from the database file
 SlottedPage* HeapFile::get(BlockID block_id) {
-	Dbt key(&block_id, sizeof(block_id));
-	Dbt data;
-
-	this->db.get(nullptr, &key, &data, 0);
+	BufferPool::instance().flush(this, block_id); // so we don't read an out-of-date copy
+	this->unpacked.resize(this->block_sz);
+	fetch(block_id, this->unpacked.data());
+	Dbt data(this->unpacked.data(), this->block_sz);
 	return new SlottedPage(data, block_id, false);
 }
 
 //Provided by Professor Lundeen
-//Returns the new empty DbBlock that is manging the records in this block and its block id
+//Returns the new empty DbBlock that is manging the records in this block and its block id.
+//The block is already in the file as an empty page from its extent, so there is no I/O here.
 SlottedPage* HeapFile::get_new(void) {
-	char block[DbBlock::BLOCK_SZ];
-	std::memset(block, 0, sizeof(block));
-	Dbt data(block, sizeof(block));
+	BlockID block_id = this->last + 1;
+	extend(block_id);
+	this->last = block_id;
+
+	this->fresh.assign(this->block_sz, 0);
+	Dbt data(this->fresh.data(), this->block_sz);
+	SlottedPage* page = new SlottedPage(data, block_id, true);
+	this->fsm.update(block_id, page->free_space());
+	return page;
+}
 
-	int block_id = ++this->last;
-	Dbt key(&block_id, sizeof(block_id));
+//Pin a block through the buffer pool (nothing to do if the handle already holds it)
+void HeapFile::pin(BlockID block_id, PinnedPage &pinned) {
+	if (pinned.frame != nullptr && pinned.frame->get_file() == this && pinned.frame->get_block_id() == block_id)
+		return;
+	BufferFrame* frame = BufferPool::instance().pin(this, block_id);
+	pinned.release();
+	pinned.frame = frame;
+}
 
-	// write out an empty block and read it back in so Berkeley DB is managing the memory
-	SlottedPage* page = new SlottedPage(data, this->last, true);
-	this->db.put(nullptr, &key, &data, 0); // write it out with initialization applied
-	this->db.get(nullptr, &key, &data, 0);
-	return page;
+//Empty new block, in the buffer pool only until it is put()
+void HeapFile::pin_new(PinnedPage &pinned) {
+	BufferFrame* frame = BufferPool::instance().pin_new(this, this->last + 1);
+	pinned.release();
+	pinned.frame = frame;
+}
+
+//Read a block into the given memory (for the buffer pool)
+void HeapFile::read(BlockID block_id, Dbt &data) {
+	fetch(block_id, (char*)data.get_data());
 }
 
-//Write a block back to the database file
+//Write a block straight to the database file (for the buffer pool)
+void HeapFile::write(DbBlock* block) {
+	store(block->get_block_id(), (const char*)block->get_data());
+}
+
+//Write a block back to the database file (writing the block after the last one appends it).
+//A pinned page (or any other DbBlock over the frame's memory, like a PaxPage) just gets its
+//frame marked dirty; the pool writes it back later.
 void HeapFile::put(DbBlock* block) {
 	BlockID block_id = block->get_block_id();
-	Dbt key(&block_id, sizeof(block_id));
-	this->db.put(nullptr, &key, block->get_block(), 0);
+	BufferPool &pool = BufferPool::instance();
+	BufferFrame* frame = pool.lookup(this, block_id);
+	if (frame != nullptr && frame->get_page()->get_data() == block->get_data()) {
+		extend(block_id);
+		pool.mark_dirty(frame);
+	}
+	else {
+		extend(block_id);
+		write(block);
+		if (frame != nullptr) { // keep the cached copy in step
+			SlottedPage* cached = frame->get_page();
+			memcpy(cached->get_data(), block->get_data(), this->block_sz);
+			cached->load(*cached->get_block(), block_id);
+		}
+	}
+	if (block_id > this->last)
+		this->last = block_id;
+	this->fsm.update(block_id, block->free_space());
+}
+
+
+/**************************FreeSpaceMap Implementation*********************/
+
+//Empty map for a brand new file
+void FreeSpaceMap::create(std::string path, u_int32_t block_sz) {
+	this->path = path;
+	this->block_sz = block_sz;
+	this->buckets.clear();
+	for (uint b = 0; b < BUCKETS; b++)
+		this->candidates[b].clear();
+}
+
+//Side file is just one bucket byte per block
+bool FreeSpaceMap::load(std::string path, u_int32_t block_sz) {
+	create(path, block_sz);
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in)
+		return false;
+	char bucket;
+	while (in.get(bucket)) {
+		this->buckets.push_back((u_int8_t)bucket);
+		push((BlockID)this->buckets.size(), (u_int8_t)bucket);
+	}
+	return true;
+}
+
+void FreeSpaceMap::save() {
+	if (this->path.empty())
+		return;
+	std::ofstream out(this->path.c_str(), std::ios::binary | std::ios::trunc);
+	out.write((const char*)this->buckets.data(), this->buckets.size());
+}
+
+void FreeSpaceMap::drop() {
+	if (!this->path.empty())
+		std::remove(this->path.c_str());
+	create("", this->block_sz);
+}
+
+//Round down to a bucket and remember the block as a candidate there if it moved
+void FreeSpaceMap::update(BlockID block_id, u_int32_t free_bytes) {
+	u_int32_t bucket = free_bytes / (this->block_sz / BUCKETS);
+	if (bucket >= BUCKETS)
+		bucket = BUCKETS - 1;
+	if (block_id > this->buckets.size())
+		this->buckets.resize(block_id, 0);
+	else if (this->buckets[block_id - 1] == bucket)
+		return;
+	this->buckets[block_id - 1] = (u_int8_t)bucket;
+	push(block_id, (u_int8_t)bucket);
+}
+
+//Best fit: smallest bucket guaranteed to hold size, so roomy blocks are left for big rows
+BlockID FreeSpaceMap::find(u_int32_t size) {
+	u_int32_t bucket_sz = this->block_sz / BUCKETS;
+	for (u_int32_t b = (size + bucket_sz - 1) / bucket_sz; b < BUCKETS; b++) {
+		std::vector<BlockID> &stack = this->candidates[b];
+		while (!stack.empty()) {
+			BlockID block_id = stack.back();
+			if (this->buckets[block_id - 1] == b)
+				return block_id;
+			stack.pop_back(); // block has since moved to another bucket
+		}
+	}
+	return 0;
+}
+
+void FreeSpaceMap::push(BlockID block_id, u_int8_t bucket) {
+	this->candidates[bucket].push_back(block_id);
 }
 
 
 //Sequence of all block ids
 BlockIDs* HeapFile::block_ids() {
 	BlockIDs* id = new BlockIDs();
-	
-	for (BlockID i = 1; i <= (this->last); i++)
-		id->push_back(i);
+	BlockCursor* cursor = block_cursor();
+	BlockID block_id;
+
+	while (cursor->next(block_id))
+		id->push_back(block_id);
+	delete cursor;
 	return id;
 }
 
+//Lazy sequence of all block ids (caller frees)
+BlockCursor* HeapFile::block_cursor() {
+	return new HeapBlockCursor(1, this->last);
+}
+
+
+/**************************Heap Cursors Implementation*********************/
+
+//Step to the next block id in the range
+bool HeapBlockCursor::next(BlockID &block_id) {
+	if (this->current >= this->last)
+		return false;
+	block_id = ++this->current;
+	return true;
+}
+
+//Takes ownership of blocks
+HeapHandleCursor::HeapHandleCursor(HeapFile &file, BlockCursor* blocks, const RowCodec* codec, const RowFilter& filter,
+	const PaxLayout* layout)
+	: file(file), blocks(blocks), pinned(), pinned_ok(false), record_id(0), codec(codec), filter(filter),
+	  layout(layout), pax(nullptr), selected() {}
+
+HeapHandleCursor::~HeapHandleCursor() {
+	delete pax;
+	delete blocks;
+}
+
+//Handle of the next live record that passes the filter, fetching the next block when this one runs out
+bool HeapHandleCursor::next(Handle &handle) {
+	while (this->pinned_ok || next_block()) {
+		SlottedPage* page = this->pinned.get_page();
+		if (this->pax != nullptr)
+			this->record_id = this->filter.empty() ? this->pax->next_id(this->record_id) : next_selected(this->record_id);
+		else
+			this->record_id = page->next_id(this->record_id);
+		if (this->record_id == 0) {
+			this->pinned_ok = false;
+			continue;
+		}
+		if (this->pax == nullptr && !this->filter.empty() && !this->codec->matches(page->view(this->record_id), this->filter))
+			continue;
+		handle = Handle(this->pinned.get_block_id(), this->record_id);
+		return true;
+	}
+	return false;
+}
+
+//Decode the current record from our pinned block (and PaxPage), touching nothing of the table's
+void HeapHandleCursor::project(const std::vector<u_int32_t>* columns, Row* row) {
+	if (row->size() != this->codec->get_num_columns())
+		row->resize(this->codec->get_num_columns());
+	if (this->pax != nullptr) {
+		if (columns == nullptr) {
+			row->clear();
+			for (u_int32_t column = 0; column < row->size(); column++)
+				this->codec->decode_value(this->pax->column_bytes(this->record_id, column), column, *row);
+		}
+		else {
+			for (u_int32_t column : *columns)
+				this->codec->decode_value(this->pax->column_bytes(this->record_id, column), column, *row);
+		}
+		return;
+	}
+	RecordView data = this->pinned.get_page()->view(this->record_id);
+	if (columns == nullptr) {
+		this->codec->decode(data, *row);
+		return;
+	}
+	for (u_int32_t column : *columns)
+		this->codec->decode_value(this->codec->column_bytes(data, column), column, *row);
+}
+
+//Pin the next block into our own page so it survives other calls on the file
+bool HeapHandleCursor::next_block() {
+	BlockID block_id;
+	if (!this->blocks->next(block_id))
+		return false;
+	this->file.pin(block_id, this->pinned);
+	if (this->layout != nullptr) {
+		Dbt &data = *this->pinned.get_page()->get_block();
+		if (this->pax == nullptr)
+			this->pax = new PaxPage(data, block_id, *this->codec, *this->layout);
+		else
+			this->pax->load(data, block_id);
+		if (!this->filter.empty())
+			this->pax->select(this->filter, this->selected);
+	}
+	this->pinned_ok = true;
+	this->record_id = 0;
+	return true;
+}
+
+//First record after prev whose bit is set in the PAX block's selection mask
+RecordID HeapHandleCursor::next_selected(RecordID prev) {
+	for (u_int32_t i = prev; i / 64 < this->selected.size(); i = (i / 64 + 1) * 64) {
+		u_int64_t bits = this->selected[i / 64] >> (i % 64);
+		if (bits != 0)
+			return i + (u_int32_t)__builtin_ctzll(bits) + 1;
+	}
+	return 0;
+}
+
+
+/**************************PinnedPage Implementation*********************/
+
+SlottedPage* PinnedPage::get_page() {
+	return this->frame->get_page();
+}
+
+BlockID PinnedPage::get_block_id() {
+	return this->frame == nullptr ? 0 : this->frame->get_block_id();
+}
+
+void PinnedPage::release() {
+	if (this->frame != nullptr)
+		BufferPool::instance().unpin(this->frame);
+	this->frame = nullptr;
+}
+
 
 /**************************Heap Table Public Functions Implementation*********************/
 
@@ -316,13 +872,43 @@ BlockIDs* HeapFile::block_ids() {
 */
 
 
-HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes)
-: DbRelation(table_name, column_names, column_attributes), file(table_name){}
+//block_sz, pax and dictionary only matter for create(); an existing table's files remember its own block
+//size, block layout and encoded columns. The file kind (options.mmap) has to be the same every time the table is opened.
+HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+	const StorageOptions& options)
+: DbRelation(table_name, column_names, column_attributes), file(nullptr), pinned(), batch_stats(),
+  dictionary(), encoded(), codec(column_names, column_attributes), staged(column_names.size()), projected_names(), projected(), layout(codec),
+  pax(options.pax), record(),
+  text_added(0), rows_added(0) {
+	if (!DbBlock::valid_block_size(options.block_sz))
+		throw DbRelationError("block size must be a power of two from 4096 to 1048576");
+	if (options.mmap)
+		this->file = new MmapHeapFile(table_name, options.block_sz);
+	else
+		this->file = new HeapFile(table_name, options.block_sz, options.extent, options.compress);
+	this->file->set_free_space_measure([this](SlottedPage* page) {return block_free_space(page);});
+	if (!options.dictionary.empty()) {
+		this->encoded = column_positions(&options.dictionary);
+		configure_dictionary(false);
+	}
+}
+
+HeapTable::~HeapTable() {
+	pinned.release();
+	delete this->file;
+}
 
 //Execute: CREATE TABLE <table_name> ( <columns> )
 //Is not responsible for metadata storage or validation
 void HeapTable::create() {
-	file.create();
+	file->create();
+	configure_dictionary(true); // a failed open() may have loaded some other table's choice
+	if (this->pax) { // so open() can tell this is a PAX table
+		this->file->pin(1, this->pinned);
+		PaxPage page(*this->pinned.get_page()->get_block(), 1, this->codec, this->layout);
+		page.format();
+		this->file->put(&page);
+	}
 }
 
 //Execute: CREATE TABLE IF NOT EXISTS <table_name> ( <columns> )
@@ -338,17 +924,48 @@ void HeapTable::create_if_not_exists() {
 
 //Excecute: DROP TABLE <table_name>
 void HeapTable::drop() {
-	file.drop();
+	pinned.release();
+	file->drop();
+	this->dictionary.close();
+	std::remove(dictionary_path().c_str());
 }
 
 //Open existing table. Enables: insert, update, delete, select, project
+//Block 1 says whether the table was created with PAX blocks (create() formats it), and
+//the dictionary's side file, if there is one, which columns are encoded. The codec and
+//layout are set first, in case the file has to measure PAX blocks to rebuild its free-space map.
 void HeapTable::open() {
-	file.open();
+	if (file->is_open())
+		return;
+	if (this->dictionary.load(dictionary_path()))
+		this->codec.use_dictionary(&this->dictionary, this->dictionary.get_columns());
+	else
+		this->codec.use_dictionary(nullptr, std::vector<u_int32_t>());
+	this->layout = PaxLayout(this->codec);
+	try {
+		file->open();
+	}
+	catch (...) { // no table, so keep what we were constructed with for create()
+		configure_dictionary(false);
+		throw;
+	}
+	this->file->pin(1, this->pinned);
+	this->pax = PaxPage::is_pax(this->pinned.get_page()->get_data());
+}
+
+//Encode the columns StorageOptions::dictionary named (if any); with a side file, so open()
+//can tell which they are, once the table is created
+void HeapTable::configure_dictionary(bool persist) {
+	this->dictionary.create(persist && !this->encoded.empty() ? dictionary_path() : "", this->encoded);
+	this->codec.use_dictionary(this->encoded.empty() ? nullptr : &this->dictionary, this->encoded);
+	this->layout = PaxLayout(this->codec);
 }
 
 //Closes the table. Disables: insert, update, delete, select, project
 void HeapTable::close() {
-	file.close();
+	pinned.release();
+	file->close();
+	this->dictionary.close();
 }
 
 //Expect row to be a dictionary with column name keys.
@@ -356,11 +973,205 @@ void HeapTable::close() {
 //Return the handle of the inserted row
 Handle HeapTable::insert(const ValueDict* row){
 	open();
-	//ValueDict* full = validate(row);
-	Handle h = append(validate(row));
+	ValueDict* full = validate(row);
+	Handle h;
+	try {
+		h = append(full);
+	}
+	catch (...) {
+		delete full;
+		throw;
+	}
+	delete full;
 	return h;
 }
 
+//INSERT from a Row already in column order: no ValueDict lookups or copies at all
+Handle HeapTable::insert(const Row* row) {
+	open();
+	this->codec.check(*row);
+	return append(*row);
+}
+
+//Bulk INSERT: marshal each row straight into an in-memory block and write each block
+//once, when it fills up (and the partly-filled last one at the end). The codec checks
+//each row has every column, so rows aren't copied through validate().
+//Every row is converted and measured before any block is touched, so a bad one fails
+//the whole batch; anything that goes wrong after that still writes what got in.
+//Return the handles of the inserted rows, in order
+Handles* HeapTable::insert_batch(const ValueDicts* rows) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	open();
+	this->batch_stats = BatchStats();
+	Rows converted(rows->size());
+	u_int32_t largest = largest_record();
+	for (u_int32_t i = 0; i < rows->size(); i++) {
+		this->codec.to_row(&(*rows)[i], converted[i]);
+		if (this->codec.size(converted[i]) > largest)
+			throw DbRelationError("row " + to_string(i) + " is too big for a block");
+	}
+	std::unique_ptr<Handles> handles(new Handles());
+	handles->reserve(rows->size());
+	if (this->pax) {
+		insert_batch_pax(converted, handles.get());
+		this->batch_stats.rows = rows->size();
+		this->batch_stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		return handles.release();
+	}
+
+	//top off the current last block first, then carry on with new ones
+	PinnedPage pinned;
+	this->file->pin(this->file->get_last_block_id(), pinned);
+	SlottedPage* block = pinned.get_page();
+	bool dirty = false;
+	try {
+		for (auto const& row : converted) {
+			u_int32_t size = this->codec.size(row);
+			RecordID record_id;
+			char* bytes;
+			try {
+				bytes = block->reserve(size, record_id);
+			}
+			catch (DbBlockNoRoomError &e) {
+				if (dirty) {
+					this->file->put(block);
+					this->batch_stats.blocks_written++;
+				}
+				dirty = false;
+				this->file->pin_new(pinned);
+				block = pinned.get_page();
+				bytes = block->reserve(size, record_id);
+			}
+			this->codec.encode(row, bytes);
+			dirty = true;
+			handles->push_back(Handle(block->get_block_id(), record_id));
+		}
+	}
+	catch (...) {
+		if (dirty)
+			this->file->put(block);
+		throw;
+	}
+	if (dirty) {
+		this->file->put(block);
+		this->batch_stats.blocks_written++;
+	}
+
+	this->batch_stats.rows = rows->size();
+	this->batch_stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	return handles.release();
+}
+
+//insert_batch for PAX blocks: same idea, one record at a time scattered into the pinned block
+void HeapTable::insert_batch_pax(const Rows& rows, Handles* handles) {
+	PinnedPage pinned;
+	this->file->pin(this->file->get_last_block_id(), pinned);
+	PaxPage page(*pinned.get_page()->get_block(), pinned.get_block_id(), this->codec, this->layout);
+	bool dirty = false;
+	try {
+		for (auto const& row : rows) {
+			u_int32_t size = this->codec.size(row);
+			this->record.resize(size);
+			this->codec.encode(row, this->record.data());
+			Dbt data(this->record.data(), size);
+			this->text_added += size - this->codec.get_fixed_size();
+			this->rows_added++;
+			page.set_expected_text((u_int32_t)(this->text_added / this->rows_added));
+			RecordID record_id;
+			try {
+				record_id = page.add(&data);
+			}
+			catch (DbBlockNoRoomError &e) {
+				if (dirty) {
+					this->file->put(&page);
+					this->batch_stats.blocks_written++;
+				}
+				dirty = false;
+				this->file->pin_new(pinned);
+				page.load(*pinned.get_page()->get_block(), pinned.get_block_id());
+				record_id = page.add(&data);
+			}
+			dirty = true;
+			handles->push_back(Handle(pinned.get_block_id(), record_id));
+		}
+	}
+	catch (...) {
+		if (dirty)
+			this->file->put(&page);
+		throw;
+	}
+	if (dirty) {
+		this->file->put(&page);
+		this->batch_stats.blocks_written++;
+	}
+}
+
+//Largest record that fits in an empty block of this table
+u_int32_t HeapTable::largest_record() {
+	std::vector<char> bytes(this->file->get_block_size(), 0);
+	Dbt block(bytes.data(), (u_int32_t)bytes.size());
+	if (this->pax) {
+		PaxPage page(block, 0, this->codec, this->layout, true);
+		return page.free_space();
+	}
+	SlottedPage page(block, 0, true);
+	return page.free_space();
+}
+
+//Like insert_batch: the last block is topped off, then new blocks are filled one after another
+void HeapTable::append_rows(const Rows& rows) {
+	open();
+	if (this->pax)
+		throw DbRelationError("append_rows is for slotted pages only");
+	PinnedPage pinned;
+	this->file->pin(this->file->get_last_block_id(), pinned);
+	SlottedPage* block = pinned.get_page();
+	bool dirty = false;
+	for (auto const& row : rows) {
+		this->codec.check(row);
+		u_int32_t size = this->codec.size(row);
+		RecordID record_id;
+		char* bytes;
+		try {
+			bytes = block->reserve(size, record_id);
+		}
+		catch (DbBlockNoRoomError &e) {
+			if (dirty)
+				this->file->put(block);
+			this->file->pin_new(pinned);
+			block = pinned.get_page();
+			bytes = block->reserve(size, record_id);
+		}
+		this->codec.encode(row, bytes);
+		dirty = true;
+	}
+	if (dirty)
+		this->file->put(block);
+}
+
+//One block at a time, pinned only long enough to read its header and slots (or flags)
+u_int64_t HeapTable::count() {
+	open();
+	u_int64_t count = 0;
+	PinnedPage pinned;
+	PaxPage* pax = nullptr;
+	for (BlockID block_id = 1; block_id <= this->file->get_last_block_id(); block_id++) {
+		this->file->pin(block_id, pinned);
+		if (!this->pax) {
+			count += pinned.get_page()->count_records();
+			continue;
+		}
+		Dbt &data = *pinned.get_page()->get_block();
+		if (pax == nullptr)
+			pax = new PaxPage(data, block_id, this->codec, this->layout);
+		else
+			pax->load(data, block_id);
+		count += pax->count_records();
+	}
+	delete pax;
+	return count;
+}
+
 //NOT SUPPORTED IN MILESTONE 1
 /*Expect new_values to be a dictionary with column name keys.
 Conceptually, execute: UPDATE INTO <table_name> SET <new_values> WHERE <handle>
@@ -385,40 +1196,53 @@ If handles is specified, then use those as the base set of records to apply a re
 Returns a list of handles for qualifying rows.
 */
 Handles* HeapTable::select() {
+	HandleCursor* cursor = select_cursor();
 	Handles* handles = new Handles();
-	BlockIDs* block_ids = file.block_ids();
-	for (auto const& block_id : *block_ids) {
-		SlottedPage* block = file.get(block_id);
-		RecordIDs* record_ids = block->ids();
-		for (auto const& record_id : *record_ids)
-			handles->push_back(Handle(block_id, record_id));
-		delete record_ids;
-		delete block;
-	}
-	delete block_ids;
+	Handle handle;
+	while (cursor->next(handle))
+		handles->push_back(handle);
+	delete cursor;
 	return handles;
 }
 
-//NOTE SUPPORTED IN MILESTONE 1
+//Same as select(), but the handles come back lazily one block at a time (caller frees)
+HandleCursor* HeapTable::select_cursor() {
+	open();
+	return new HeapHandleCursor(*this->file, this->file->block_cursor(), &this->codec, RowFilter(),
+		this->pax ? &this->layout : nullptr);
+}
+
 /*Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
-If handles is specified, then use those as the base set of records to apply a refined selection to.
+where is column = value pairs, all of which have to hold. Each row is tested on its
+marshaled bytes in the pinned block, so rows that don't qualify are never unmarshaled.
 Returns a list of handles for qualifying rows.
 */
 Handles* HeapTable::select(const ValueDict* where) {
-	//Handles* handles = new Handles();
-	//BlockIDs* block_ids = file.block_ids();
-	//for (auto const& block_id : *block_ids) {
-	//	SlottedPage* block = file.get(block_id);
-	//	RecordIDs* record_ids = block->ids();
-	//	for (auto const& record_id : *record_ids)
-	//		handles->push_back(Handle(block_id, record_id));
-	//	delete record_ids;
-	//	delete block;
-	//}
-	//delete block_ids;
-	//return handles;
-	throw DbRelationError("Not Implemented");
-	return NULL;
+	HandleCursor* cursor = select_cursor(where); // first, since it throws for a bad WHERE
+	Handles* handles = new Handles();
+	Handle handle;
+	while (cursor->next(handle))
+		handles->push_back(handle);
+	delete cursor;
+	return handles;
+}
+
+//Same as select(where), one block at a time (caller frees)
+HandleCursor* HeapTable::select_cursor(const ValueDict* where) {
+	RowFilter filter = this->codec.compile_filter(where);
+	open();
+	return new HeapHandleCursor(*this->file, this->file->block_cursor(), &this->codec, filter,
+		this->pax ? &this->layout : nullptr);
+}
+
+//Just blocks first..last, for one of a parallel scan's threads (caller frees). The filter is
+//compiled here, on the caller's thread, since that looks TEXT values up in the dictionary.
+HandleCursor* HeapTable::select_cursor(const ValueDict* where, BlockID first, BlockID last) {
+	RowFilter filter = where == nullptr ? RowFilter() : this->codec.compile_filter(where);
+	open();
+	last = std::min(last, this->file->get_last_block_id());
+	return new HeapHandleCursor(*this->file, new HeapBlockCursor(first, last), &this->codec, filter,
+		this->pax ? &this->layout : nullptr);
 }
 
 //Return a ValueDict containing all data in a row
@@ -426,33 +1250,146 @@ ValueDict* HeapTable::project(Handle handle) {
 	this->open();
 	BlockID block_id = handle.first;
 	RecordID record_id = handle.second;
-	SlottedPage* block = this->file.get(block_id);
-	Dbt* data = block->get(record_id);
-	ValueDict* row = this->unmarshal(data);
-	delete data;
-	delete block;
-	return row;
+	this->file->pin(block_id, this->pinned);
+	return this->unmarshal_pinned(record_id, nullptr);
 }
 
-//Return a sequence of values for handle given by column_names
+//Return a sequence of values for handle given by column_names, decoding only those columns
 ValueDict* HeapTable::project(Handle handle, const ColumnNames* column_names){
 	this->open();
+	std::vector<u_int32_t> columns = column_positions(column_names);
 	BlockID block_id = handle.first;
 	RecordID record_id = handle.second;
-	SlottedPage* block = this->file.get(block_id);
-	Dbt* data = block->get(record_id);
-	ValueDict* row = this->unmarshal(data);
-	delete data;
-	delete block;
+	this->file->pin(block_id, this->pinned);
+	return this->unmarshal_pinned(record_id, &columns);
+}
 
-	//This is to include column parameters. Can use Project(Handle handle) function above
-	ValueDict* rowsToReturn = new ValueDict();
-	for (auto const& column_name : *column_names) {
-		//(rowsToReturn)[column_name] = (row)[column_name];
-		(*rowsToReturn)[column_name] = (*row)[column_name];
+//Into the caller's Row: no map, and no allocation once the Row has held a row this long
+void HeapTable::project(Handle handle, const ColumnNames* column_names, Row* row) {
+	this->open();
+	if (row->size() != this->codec.get_num_columns())
+		row->resize(this->codec.get_num_columns());
+	this->file->pin(handle.first, this->pinned);
+	if (column_names == nullptr && !this->pax) {
+		this->codec.decode(this->pinned.get_page()->view(handle.second), *row);
+		return;
+	}
+	const ColumnNames &wanted = column_names == nullptr ? this->column_names : *column_names;
+	if (wanted != this->projected_names) {
+		this->projected = column_positions(&wanted);
+		this->projected_names = wanted;
+	}
+	const std::vector<u_int32_t> &columns = this->projected;
+	if (this->pax) {
+		if (column_names == nullptr)
+			row->clear();  // as RowCodec::decode does, or each long TEXT piles up in the overflow
+		PaxPage page(*this->pinned.get_page()->get_block(), handle.first, this->codec, this->layout);
+		for (u_int32_t column : columns)
+			this->codec.decode_value(page.column_bytes(handle.second, column), column, *row);
+		return;
+	}
+	RecordView data = this->pinned.get_page()->view(handle.second);
+	for (u_int32_t column : columns)
+		this->codec.decode_value(this->codec.column_bytes(data, column), column, *row);
+}
+
+//Same columns for many handles; pin() is a no-op while the handles stay in one block
+ValueDicts* HeapTable::project(const Handles* handles, const ColumnNames* column_names) {
+	this->open();
+	std::vector<u_int32_t> columns = column_positions(column_names);
+	ValueDicts* rows = new ValueDicts();
+	rows->reserve(handles->size());
+	for (auto const& handle : *handles) {
+		this->file->pin(handle.first, this->pinned);
+		ValueDict* row = this->unmarshal_pinned(handle.second, &columns);
+		rows->push_back(std::move(*row));
 		delete row;
 	}
-	return rowsToReturn;
+	return rows;
+}
+
+//Visit the handles a block at a time (stable, so handles within a block keep their order), pinning
+//each block once, and drop every column's value straight into its row of the batch
+ColumnBatch* HeapTable::project_many(const Handles& handles, const ColumnNames* column_names) {
+	this->open();
+	std::vector<u_int32_t> columns = column_positions(column_names);
+	ColumnBatch* batch = new ColumnBatch();
+	batch->num_rows = handles.size();
+	for (u_int32_t column : columns) {
+		batch->columns.push_back(ColumnVector(this->codec.get_column_name(column), this->codec.get_data_type(column)));
+		ColumnVector &vector = batch->columns.back();
+		if (vector.data_type == ColumnAttribute::INT) {
+			vector.ints.resize(handles.size());
+		}
+		else {
+			vector.text_offsets.resize(handles.size());
+			vector.text_sizes.resize(handles.size());
+		}
+	}
+
+	std::vector<u_int32_t> order(handles.size());
+	for (u_int32_t row = 0; row < order.size(); row++)
+		order[row] = row;
+	std::stable_sort(order.begin(), order.end(), [&handles](u_int32_t a, u_int32_t b) {
+		return handles[a].first < handles[b].first;
+	});
+
+	PaxPage* page = nullptr;
+	BlockID block_id = 0;
+	for (u_int32_t row : order) {
+		const Handle &handle = handles[row];
+		if (handle.first != block_id) {
+			block_id = handle.first;
+			this->file->pin(block_id, this->pinned);
+			if (this->pax && page == nullptr)
+				page = new PaxPage(*this->pinned.get_page()->get_block(), block_id, this->codec, this->layout);
+			else if (this->pax)
+				page->load(*this->pinned.get_page()->get_block(), block_id);
+		}
+		RecordView data;
+		if (!this->pax)
+			data = this->pinned.get_page()->view(handle.second);
+		for (u_int32_t c = 0; c < columns.size(); c++) {
+			RecordView bytes = this->pax ? page->column_bytes(handle.second, columns[c])
+				: this->codec.column_bytes(data, columns[c]);
+			ColumnVector &vector = batch->columns[c];
+			if (vector.data_type == ColumnAttribute::INT) {
+				memcpy(&vector.ints[row], bytes.data, sizeof(int32_t));
+			}
+			else {
+				RecordView text = this->codec.value_bytes(bytes, columns[c]);
+				vector.text_offsets[row] = (u_int32_t)vector.text.size();
+				vector.text_sizes[row] = text.size;
+				vector.text.append(text.data, text.size);
+			}
+		}
+	}
+	delete page;
+	return batch;
+}
+
+//Side file for the dictionary, next to the table's file in the environment home
+std::string HeapTable::dictionary_path() {
+	const char* home = nullptr;
+	_DB_ENV->get_home(&home);
+	return std::string(home) + "/" + this->table_name + ".dict";
+}
+
+//Positions of the named columns in the table (all of them for nullptr)
+std::vector<u_int32_t> HeapTable::column_positions(const ColumnNames* column_names) {
+	std::vector<u_int32_t> columns;
+	if (column_names == nullptr) {
+		for (u_int32_t column = 0; column < this->codec.get_num_columns(); column++)
+			columns.push_back(column);
+		return columns;
+	}
+	for (auto const& column_name : *column_names) {
+		int column = this->codec.column_index(column_name);
+		if (column < 0)
+			throw DbRelationError("unknown column " + column_name);
+		columns.push_back((u_int32_t)column);
+	}
+	return columns;
 }
 
 //Check if the given row is acceptable to inser. Riase error if not.
@@ -475,94 +1412,468 @@ ValueDict* HeapTable::validate(const ValueDict* row) {
 	return full_row;	
 }
 
-//Assumes row is fully fleshed-out. Appends a record to the file
+//Assumes row is fully fleshed-out. Appends a record to the file, by way of a Row
 Handle HeapTable::append(const ValueDict* row) {
-	Dbt* data = marshal(row);
-	//u_int32_t from heap_storage.h HeapFile
-	SlottedPage* block = this->file.get(this->file.get_last_block_id());
+	this->codec.to_row(row, this->staged);
+	return append(this->staged);
+}
+
+//Appends a record to the file, marshaled right into its block
+Handle HeapTable::append(const Row& row) {
+	if (this->pax)
+		return append_pax(row);
+	u_int32_t size = this->codec.size(row);
+	//any block the free-space map says has room, otherwise a brand new one
+	PinnedPage pinned;
+	BlockID block_id = this->file->find_room(size);
+	if (block_id)
+		this->file->pin(block_id, pinned);
+	else
+		this->file->pin_new(pinned);
 	RecordID recordID;
+	char* bytes;
 	Handle result;
 	try {
-		recordID = block->add(data);
+		bytes = pinned.get_page()->reserve(size, recordID);
 	}
-	catch (DbBlockNoRoomError) {//From SlottedPage class put() function
-		block = this->file.get_new();
-		recordID = block->add(data);
+	catch (DbBlockNoRoomError &e) {//From SlottedPage class put() function (stale free-space map)
+		this->file->put(pinned.get_page()); // just to correct its free-space map entry
+		this->file->pin_new(pinned);
+		bytes = pinned.get_page()->reserve(size, recordID);
 	}
-	this->file.put(block);
-	delete[] (char*)data->get_data();
-	delete block;
-	result.first = file.get_last_block_id();
+	this->codec.encode(row, bytes);
+	this->file->put(pinned.get_page());
+	result.first = pinned.get_block_id();
 	result.second = recordID;
 	return result;
 }
 
+//PaxPage scatters whole records, so marshal into a scratch record first. New blocks are
+//laid out for the average TEXT size of the rows added so far, with room for this row whatever that is.
+Handle HeapTable::append_pax(const Row& row) {
+	u_int32_t size = this->codec.size(row);
+	this->record.resize(size);
+	this->codec.encode(row, this->record.data());
+	Dbt data(this->record.data(), size);
+	this->text_added += size - this->codec.get_fixed_size();
+	this->rows_added++;
+
+	PinnedPage pinned;
+	BlockID block_id = this->file->find_room(size);
+	if (block_id)
+		this->file->pin(block_id, pinned);
+	else
+		this->file->pin_new(pinned);
+	PaxPage page(*pinned.get_page()->get_block(), pinned.get_block_id(), this->codec, this->layout);
+	page.set_expected_text((u_int32_t)(this->text_added / this->rows_added));
+	RecordID record_id;
+	try {
+		record_id = page.add(&data);
+	}
+	catch (DbBlockNoRoomError &e) {
+		this->file->put(&page); // just to correct its free-space map entry
+		this->file->pin_new(pinned);
+		page.load(*pinned.get_page()->get_block(), pinned.get_block_id());
+		record_id = page.add(&data);
+	}
+	this->file->put(&page);
+	return Handle(pinned.get_block_id(), record_id);
+}
+
+//For HeapFile::rebuild_fsm, which pins every block as a SlottedPage: PAX blocks answer as PaxPages
+u_int32_t HeapTable::block_free_space(SlottedPage* page) {
+	if (!PaxPage::is_pax(page->get_data()))
+		return page->free_space();
+	PaxPage pax_page(*page->get_block(), page->get_block_id(), this->codec, this->layout);
+	return pax_page.free_space();
+}
+
 // return the bits to go into the file
 // caller responsible for freeing the returned Dbt and its enclosed ret->get_data().
 Dbt* HeapTable::marshal(const ValueDict* row) {
-	char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need (we insist that one row fits into DbBlock::BLOCK_SZ)
-	uint offset = 0;
-	uint col_num = 0;
-	for (auto const& column_name : this->column_names) {
-		ColumnAttribute ca = this->column_attributes[col_num++];
-		ValueDict::const_iterator column = row->find(column_name);
-		Value value = column->second;
-		if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-			*(int32_t*)(bytes + offset) = value.n;
-			offset += sizeof(int32_t);
-		}
-		else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-			uint size = value.s.length();
-			*(u16*)(bytes + offset) = size;
-			offset += sizeof(u16);
-			memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
-			offset += size;
-		}
-		else {
-			throw DbRelationError("Only know how to marshal INT and TEXT");
-		}
-	}
-	char *right_size_bytes = new char[offset];
-	memcpy(right_size_bytes, bytes, offset);
-	delete[] bytes;
-	Dbt *data = new Dbt(right_size_bytes, offset);
+	this->codec.to_row(row, this->staged);
+	uint size = this->codec.size(this->staged);
+	char *bytes = new char[size];
+	this->codec.encode(this->staged, bytes);
+	Dbt *data = new Dbt(bytes, size);
 	return data;
 }
 
-//TODO
+// how many bytes marshal_into will write for this row
+uint HeapTable::marshal_size(const ValueDict* row) {
+	return this->codec.size(row);
+}
+
+// write the row's bits to bytes, which must have room for marshal_size(row)
+void HeapTable::marshal_into(const ValueDict* row, char* bytes) {
+	this->codec.encode(row, bytes);
+}
+
 //Converts marshaled object back to original object type
 ValueDict* HeapTable::unmarshal(Dbt* data) {
-	ValueDict *row = new ValueDict();
-	Value value;
-	char *bytes = (char*)data->get_data();
-	u16 offset = 0;
-	u16 col_num= 0;
-	for (auto const& column_name: this->column_names){
-		ColumnAttribute ca = this->column_attributes[col_num++];
-		value.data_type = ca.get_data_type();
-		if(ca.get_data_type() == ColumnAttribute::DataType::INT){
-			value.n = *(int32_t*)(bytes + offset);
-			offset += sizeof(int32_t);
-		}
-		else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT){
-			u16 size = *(u16*)(bytes + offset);
-			offset += sizeof(u16);
-			char buffer[DbBlock::BLOCK_SZ];
-			memcpy(buffer, bytes + offset, size);
-			buffer[size] = '\0';
-			value.s = string(buffer);
-			offset += size;
-		}
-		else {
-			throw DbRelationError("Only know how to unmarshal INT and TEXT");
-		}
-		(*row)[column_name] = value;
+	return unmarshal(RecordView((const char*)data->get_data(), data->get_size()));
+}
+
+//Same as above, straight from the record's bytes in its block
+ValueDict* HeapTable::unmarshal(const RecordView &data) {
+	return this->codec.decode(data);
+}
+
+//A record in the block this->pinned holds, in whichever layout the table has (all columns for nullptr)
+ValueDict* HeapTable::unmarshal_pinned(RecordID record_id, const std::vector<u_int32_t>* columns) {
+	if (!this->pax) {
+		RecordView data = this->pinned.get_page()->view(record_id);
+		return columns == nullptr ? unmarshal(data) : unmarshal(data, *columns);
 	}
+	PaxPage page(*this->pinned.get_page()->get_block(), this->pinned.get_block_id(), this->codec, this->layout);
+	ValueDict* row = new ValueDict();
+	for (u_int32_t column = 0; column < this->codec.get_num_columns(); column++)
+		if (columns == nullptr || std::find(columns->begin(), columns->end(), column) != columns->end())
+			(*row)[this->codec.get_column_name(column)] = this->codec.decode_value(page.column_bytes(record_id, column), column);
 	return row;
 }
 
+//Just the given columns, each read straight from its place in the record
+ValueDict* HeapTable::unmarshal(const RecordView &data, const std::vector<u_int32_t> &columns) {
+	ValueDict *row = new ValueDict();
+	for (u_int32_t column : columns)
+		(*row)[this->codec.get_column_name(column)] = this->codec.decode_column(data, column);
+	return row;
+}
+
+// exercise add/put/del on a lone page in the given maintenance mode and block size
+bool test_slotted_page(bool deferred, u_int32_t block_sz=DbBlock::BLOCK_SZ) {
+	std::vector<char> block(block_sz);
+	Dbt data(block.data(), block_sz);
+	SlottedPage page(data, 1, true);
+	SlottedPage::defer_compaction = deferred;
+
+	u_int32_t scale = block_sz / DbBlock::BLOCK_SZ;
+	std::vector<char> big(1300 * scale, 'x');
+	Dbt big_rec(big.data(), big.size());
+	RecordID a = page.add(&big_rec);
+	RecordID b = page.add(&big_rec);
+	RecordID c = page.add(&big_rec);
+	page.del(b);
+
+	// the 4th 1300-byte record only fits once b's space is reclaimed
+	big[0] = 'd';
+	RecordID d = page.add(&big_rec);
+
+	// grow, then shrink, a record in the middle
+	char hello[] = "hello";
+	Dbt small(hello, sizeof(hello));
+	page.put(c, small);
+	big[0] = 'c';
+	page.put(c, Dbt(big.data(), 900 * scale));
+	page.put(a, small);
+
+	Dbt* got = page.get(c);
+	bool ok = got->get_size() == 900 * scale && ((char*)got->get_data())[0] == 'c';
+	delete got;
+	got = page.get(a);
+	ok = ok && got->get_size() == sizeof(hello) && strcmp((char*)got->get_data(), hello) == 0;
+	delete got;
+	got = page.get(d);
+	ok = ok && got->get_size() == 1300 * scale && ((char*)got->get_data())[0] == 'd';
+	delete got;
+	ok = ok && page.get(b) == nullptr && page.view(b).is_null() && page.view(d).size == 1300 * scale
+		&& page.next_id() == a && page.next_id(a) == c && page.next_id(c) == d;
+	SlottedPage::defer_compaction = false;
+	return ok;
+}
+
 // test function -- returns true if all tests pass
 bool test_heap_storage() {
+	if (!test_slotted_page(false))
+		return false;
+	u_int32_t compactions = SlottedPage::compactions;
+	u_int32_t avoided = SlottedPage::compactions_avoided;
+	if (!test_slotted_page(true))
+		return false;
+	if (!test_slotted_page(false, 64 * 1024) || !test_slotted_page(true, 256 * 1024))
+		return false;
+	char hello[] = "hello";
+	Dbt data_of_hello(hello, sizeof(hello));
+	FreeSpaceMap fsm;
+	fsm.create("");
+	fsm.update(1, 100);
+	fsm.update(2, 3000);
+	fsm.update(3, 1000);
+	if (fsm.find(2000) != 2 || fsm.find(700) != 3 || fsm.find(4000) != 0)
+		return false;
+	fsm.update(2, 10);
+	if (fsm.find(2000) != 0 || fsm.find(500) != 3)
+		return false;
+	std::cout << "free space map ok" << std::endl;
+
+	// codec round trips a mostly empty page, a repetitive one and noise, and rejects damage
+	std::vector<char> original(DbBlock::BLOCK_SZ, 0), packed(PageCodec::max_packed_size(DbBlock::BLOCK_SZ)),
+		unpacked(DbBlock::BLOCK_SZ);
+	for (int pass = 0; pass < 3; pass++) {
+		for (u_int32_t i = 0; i < DbBlock::BLOCK_SZ; i++)
+			original[i] = pass == 0 ? (i < 20 ? (char)i : 0) : pass == 1 ? "abcabcabd"[i % 9] : (char)(i * 7919 >> 3);
+		u_int32_t size = PageCodec::compress(original.data(), DbBlock::BLOCK_SZ, packed.data());
+		if (pass < 2 && size > DbBlock::BLOCK_SZ / 20)
+			return false;
+		PageCodec::decompress(packed.data(), size, unpacked.data(), DbBlock::BLOCK_SZ);
+		if (unpacked != original)
+			return false;
+		try {
+			PageCodec::decompress(packed.data(), size - 1, unpacked.data(), DbBlock::BLOCK_SZ);
+			return false;
+		} catch (PageCodecError &e) {}
+	}
+	std::cout << "page codec ok" << std::endl;
+
+	// row codec: round trip, and any one column straight from the record's bytes
+	ColumnNames codec_names = {"z", "a", "m", "b"};
+	ColumnAttributes codec_attributes = {ColumnAttribute(ColumnAttribute::TEXT), ColumnAttribute(ColumnAttribute::INT),
+		ColumnAttribute(ColumnAttribute::TEXT), ColumnAttribute(ColumnAttribute::INT)};
+	RowCodec codec(codec_names, codec_attributes);
+	ValueDict codec_row;
+	codec_row["z"] = Value("last");
+	codec_row["a"] = Value(-7);
+	codec_row["m"] = Value("");
+	codec_row["b"] = Value(1 << 30);
+	codec_row["extra"] = Value("ignored");
+	std::vector<char> record(codec.size(&codec_row));
+	if (record.size() != 2 * 4 + 2 * 4 + 4)
+		return false;
+	codec.encode(&codec_row, record.data());
+	RecordView record_view(record.data(), (u_int32_t)record.size());
+	ValueDict* decoded = codec.decode(record_view);
+	codec_row.erase("extra");
+	if (decoded->size() != 4 || (*decoded)["z"].s != "last" || (*decoded)["a"].n != -7 || (*decoded)["m"].s != ""
+			|| (*decoded)["b"].n != 1 << 30)
+		return false;
+	delete decoded;
+	if (codec.decode_column(record_view, 0).s != "last" || codec.decode_column(record_view, 3).n != 1 << 30
+			|| codec.column_bytes(record_view, 2).size != 0 || codec.column_index("m") != 2)
+		return false;
+	codec_row.erase("a");
+	try {
+		codec.size(&codec_row);
+		return false;
+	} catch (DbRelationError &e) {}
+	std::cout << "row codec ok" << std::endl;
+
+	// Row: short TEXT in its cell, long TEXT in the shared buffer, same record as from the ValueDict
+	codec_row["a"] = Value(-7);
+	codec_row["m"] = Value(std::string(40, 'm'));
+	Row flat;
+	codec.to_row(&codec_row, flat);
+	if (flat.size() != 4 || flat.get_int(1) != -7 || flat.get(0).s != "last" || flat.get_text(2).size != 40)
+		return false;
+	std::vector<char> from_dict(codec.size(&codec_row));
+	codec.encode(&codec_row, from_dict.data());
+	std::vector<char> from_row(codec.size(flat));
+	codec.encode(flat, from_row.data());
+	if (from_row != from_dict)
+		return false;
+	Row round_trip;
+	codec.decode(RecordView(from_row.data(), (u_int32_t)from_row.size()), round_trip);
+	decoded = codec.to_dict(round_trip);
+	if (decoded->size() != 4 || (*decoded)["m"].s != std::string(40, 'm') || (*decoded)["b"].n != 1 << 30)
+		return false;
+	delete decoded;
+	round_trip.clear();
+	round_trip.set(0, Value(std::string(17, 'x')));
+	round_trip.set(2, Value("y"));
+	if (round_trip.get_text(0).size != 17 || round_trip.get(2).s != "y" || round_trip.get_int(3) != 0)
+		return false;
+	codec.check(round_trip);  // columns 1 and 3 are INT 0, fine
+	round_trip.set_int(2, 5);
+	try {
+		codec.check(round_trip);
+		return false;
+	} catch (DbRelationError &e) {}
+	codec_row["m"] = Value("");
+	std::cout << "row ok" << std::endl;
+
+	// arena: bump allocation, destructors at release, and ValueDicts made in a statement live in it
+	Arena arena;
+	int destroyed = 0;
+	struct Counted {
+		int &count;
+		explicit Counted(int &count) : count(count) {}
+		~Counted() {count++;}
+	};
+	arena.make<Counted>(destroyed);
+	arena.make<Counted>(destroyed);
+	char* big = (char*)arena.allocate(3 * Arena::FIRST_CHUNK, 1);
+	big[3 * Arena::FIRST_CHUNK - 1] = 'x';
+	if (arena.get_used() < 3 * Arena::FIRST_CHUNK || arena.get_reserved() < 4 * Arena::FIRST_CHUNK)
+		return false;
+	arena.release();
+	if (destroyed != 2 || arena.get_used() != 0 || arena.get_reserved() != Arena::FIRST_CHUNK)
+		return false;
+	Arena* outer = Arena::current();
+	{
+		StatementArena statement(arena);
+		ValueDict in_statement;
+		for (int i = 0; i < 100; i++)
+			in_statement["column " + to_string(i)] = Value(i);
+		ValueDict copied(in_statement);
+		Handles handles(100, Handle(1, 1));
+		if (Arena::current() != &arena || arena.get_allocations() < 200 || copied["column 99"].n != 99
+				|| handles.get_allocator().arena != &arena)
+			return false;
+	}
+	if (Arena::current() != outer || arena.get_used() != 0 || StatementArena::last_peak == 0)
+		return false;
+	std::cout << "arena ok" << std::endl;
+
+	// PAX page: records in and out whole, columns read in place
+	PaxLayout pax_layout(codec);
+	std::vector<char> pax_block(DbBlock::BLOCK_SZ);
+	Dbt pax_data(pax_block.data(), DbBlock::BLOCK_SZ);
+	PaxPage pax_page(pax_data, 1, codec, pax_layout, true);
+	if (pax_page.next_id() != 0 || PaxPage::is_pax(pax_block.data()))
+		return false;
+	codec_row["a"] = Value(0);
+	RecordID pax_id = 0;
+	try {
+		for (int i = 0; ; i++) {
+			codec_row["a"] = Value(i);
+			codec_row["z"] = Value(std::string(i % 20, 'q'));
+			std::vector<char> pax_record(codec.size(&codec_row));
+			codec.encode(&codec_row, pax_record.data());
+			Dbt pax_rec(pax_record.data(), (u_int32_t)pax_record.size());
+			pax_id = pax_page.add(&pax_rec);
+		}
+	} catch (DbBlockNoRoomError &e) {}
+	if (pax_id < 50 || pax_page.get_num_records() != pax_id || pax_page.int_column(1)[pax_id - 1] != (int32_t)pax_id - 1)
+		return false;
+	Dbt* pax_rec = pax_page.get(7);
+	decoded = codec.decode(RecordView((const char*)pax_rec->get_data(), pax_rec->get_size()));
+	if ((*decoded)["a"].n != 6 || (*decoded)["z"].s != std::string(6, 'q') || (*decoded)["b"].n != 1 << 30)
+		return false;
+	delete decoded;
+	delete pax_rec;
+	codec_row["a"] = Value(-1);
+	codec_row["z"] = Value(std::string(30, 'r'));
+	std::vector<char> pax_record(codec.size(&codec_row));
+	codec.encode(&codec_row, pax_record.data());
+	pax_page.put(3, Dbt(pax_record.data(), (u_int32_t)pax_record.size())); // longer, so it moves
+	RecordView pax_z = pax_page.column_bytes(3, 0);
+	if (std::string(pax_z.data, pax_z.size) != std::string(30, 'r'))
+		return false;
+	codec_row["z"] = Value("r");
+	pax_record.resize(codec.size(&codec_row));
+	codec.encode(&codec_row, pax_record.data());
+	pax_page.put(3, Dbt(pax_record.data(), (u_int32_t)pax_record.size()));
+	pax_page.del(2);
+	pax_z = pax_page.column_bytes(3, 0);
+	if (std::string(pax_z.data, pax_z.size) != "r" || pax_page.int_column(1)[2] != -1 || pax_page.next_id(1) != 3)
+		return false;
+	ValueDict pax_where;
+	pax_where["a"] = Value(6);
+	std::vector<u_int64_t> pax_mask;
+	pax_page.select(codec.compile_filter(&pax_where), pax_mask);
+	if (IntFilter::count(pax_mask.data(), pax_id) != 1 || (pax_mask[0] & (1 << 6)) == 0)
+		return false;
+	pax_where["a"] = Value(1);  // record 2, deleted
+	pax_page.select(codec.compile_filter(&pax_where), pax_mask);
+	if (IntFilter::count(pax_mask.data(), pax_id) != 0)
+		return false;
+	std::cout << "pax page ok" << std::endl;
+
+	// every kernel the CPU has agrees with plain comparisons, including the ragged last word
+	std::vector<int32_t> filter_values(1000);
+	for (u_int32_t i = 0; i < filter_values.size(); i++)
+		filter_values[i] = (int32_t)((i * 7919) % 101) - 50;
+	IntPredicate predicates[] = {IntPredicate(IntPredicate::EQ, 3), IntPredicate(IntPredicate::LT, -10),
+		IntPredicate(IntPredicate::GT, 40), IntPredicate(IntPredicate::BETWEEN, -5, 5)};
+	for (int isa = IntFilter::SCALAR; isa <= IntFilter::best_isa(); isa++) {
+		for (auto const& predicate : predicates) {
+			for (u_int32_t n : {0u, 1u, 63u, 64u, 65u, 1000u}) {
+				std::vector<u_int64_t> filter_mask(IntFilter::mask_words(n), ~(u_int64_t)0);
+				IntFilter::evaluate(predicate, filter_values.data(), n, filter_mask.data(), (IntFilter::Isa)isa);
+				for (u_int32_t i = 0; i < IntFilter::mask_words(n) * 64; i++) {
+					int32_t v = i < n ? filter_values[i] : 0;
+					bool expected = i < n && (predicate.op == IntPredicate::EQ ? v == predicate.lo
+						: predicate.op == IntPredicate::LT ? v < predicate.lo
+						: predicate.op == IntPredicate::GT ? v > predicate.lo
+						: v >= predicate.lo && v <= predicate.hi);
+					if (((filter_mask[i / 64] >> (i % 64)) & 1) != expected)
+						return false;
+				}
+			}
+		}
+	}
+	std::cout << "int filter ok (" << IntFilter::isa_name(IntFilter::best_isa()) << ")" << std::endl;
+
+	// CLOCK gives the recently used block a second chance and evicts the other one
+	HeapFile pool_file("_test_buffer_pool_cpp");
+	pool_file.create();
+	for (int i = 0; i < 3; i++)
+		delete pool_file.get_new();
+	BufferPool pool(3);
+	for (BlockID block_id = 1; block_id <= 3; block_id++)
+		pool.unpin(pool.pin(&pool_file, block_id));
+	BufferFrame* frame = pool.pin(&pool_file, 4);  // full sweep clears every bit, evicts block 1
+	frame->get_page()->add(&data_of_hello);
+	pool.mark_dirty(frame);
+	pool.unpin(frame);  // written back right away
+	pool.unpin(pool.pin(&pool_file, 2));  // hit, so block 2 gets a second chance
+	pool.unpin(pool.pin(&pool_file, 1));  // evicts block 3
+	if (pool.lookup(&pool_file, 2) == nullptr || pool.lookup(&pool_file, 3) != nullptr
+		|| pool.get_hits() != 1 || pool.get_misses() != 5 || pool.get_evictions() != 2 || pool.get_writes() != 1)
+		return false;
+	SlottedPage* written = pool_file.get(4);
+	if (written->next_id() != 1)
+		return false;
+	delete written;
+	pool_file.drop();
+	std::cout << "buffer pool ok" << std::endl;
+
+	// blocks come out of 8-block extents; last survives a reopen even though the file has 16
+	HeapFile extent_file("_test_extent_cpp", DbBlock::BLOCK_SZ, 8);
+	extent_file.create();
+	u_int32_t empty_free = 0;
+	for (int i = 0; i < 9; i++) {
+		SlottedPage* page = extent_file.get_new();
+		if (page->get_block_id() != (BlockID)i + 2 || page->next_id() != 0)
+			return false;
+		empty_free = page->free_space();
+		delete page;
+	}
+	extent_file.close();
+	extent_file.open();
+	if (extent_file.get_last_block_id() != 10)
+		return false;
+	written = extent_file.get(9);
+	if (written->next_id() != 0 || written->free_space() != empty_free)
+		return false;
+	delete written;
+	extent_file.drop();
+
+	// last survives the file going away without close(), and without the side file the empty
+	// preallocated blocks at the end aren't counted
+	HeapFile* unclosed = new HeapFile("_test_unclosed_cpp", DbBlock::BLOCK_SZ, 8);
+	unclosed->create();
+	written = unclosed->get_new();
+	written->add(&data_of_hello);
+	unclosed->put(written);
+	delete written;
+	delete unclosed;
+	HeapFile unclosed_again("_test_unclosed_cpp");
+	unclosed_again.open();
+	if (unclosed_again.get_last_block_id() != 2)
+		return false;
+	unclosed_again.close();
+	const char* extent_home = nullptr;
+	_DB_ENV->get_home(&extent_home);
+	std::remove((std::string(extent_home) + "/_test_unclosed_cpp.fsm").c_str());
+	unclosed_again.open();
+	if (unclosed_again.get_last_block_id() != 2 || unclosed_again.find_room(100) == 0)
+		return false;
+	unclosed_again.drop();
+	std::cout << "extents ok" << std::endl;
+	std::cout << "slotted page ok (deferred: " << SlottedPage::compactions - compactions << " compactions, "
+		<< SlottedPage::compactions_avoided - avoided << " avoided)" << std::endl;
+
 	ColumnNames column_names;
 	column_names.push_back("a");
 	column_names.push_back("b");
@@ -597,7 +1908,718 @@ bool test_heap_storage() {
 	value = (*result)["b"];
 	if (value.s != "Hello!")
 		return false;
+	delete result;
+
+	// fill a few blocks and make sure the cursor walks them in the same order as select()
+	for (int i = 0; i < 1000; i++) {
+		row["a"] = Value(i);
+		table.insert(&row);
+	}
+	delete handles;
+	handles = table.select();
+	HandleCursor* cursor = table.select_cursor();
+	Handle handle;
+	uint n = 0;
+	while (cursor->next(handle)) {
+		if (n >= handles->size() || handle != (*handles)[n++])
+			return false;
+		result = table.project(handle);  // interleaved file access must not disturb the cursor
+		delete result;
+	}
+	delete cursor;
+	if (n != handles->size() || n != 1001 || table.count() != 1001)
+		return false;
+	if (BufferPool::instance().get_hits() == 0)
+		return false;  // every project() after the first in a block should have been a hit
+	std::cout << "select_cursor ok " << n << std::endl;
+	delete handles;
+
+	// Rows in and out, with no ValueDict on the way
+	Row flat_row(2);
+	flat_row.set_int(0, 13);
+	flat_row.set_text(1, "Hello from a Row, long enough to overflow");
+	handle = table.insert(&flat_row);
+	Row projected_row;
+	table.project(handle, nullptr, &projected_row);
+	if (projected_row.get_int(0) != 13 || projected_row.get(1).s != "Hello from a Row, long enough to overflow")
+		return false;
+	ColumnNames only_a = {"a"};
+	projected_row.clear();
+	table.project(handle, &only_a, &projected_row);
+	if (projected_row.get_int(0) != 13 || projected_row.get_data_type(1) != ColumnAttribute::INT)
+		return false;
+	try {
+		table.insert(&projected_row);  // b is an INT 0
+		return false;
+	} catch (DbRelationError &e) {}
+	std::cout << "insert/project Row ok" << std::endl;
 	table.drop();
 
+	// a 16kB-block table, reopened through an object that doesn't know its block size
+	StorageOptions big_blocks;
+	big_blocks.block_sz = 16 * 1024;
+	HeapTable big_table("_test_big_blocks_cpp", column_names, column_attributes, big_blocks);
+	big_table.create();
+	row["b"] = Value(string(3000, 'z'));
+	for (int i = 0; i < 20; i++) {
+		row["a"] = Value(i);
+		big_table.insert(&row);
+	}
+	big_table.close();
+	HeapTable reopened("_test_big_blocks_cpp", column_names, column_attributes);
+	handles = reopened.select();
+	if (handles->size() != 20 || handles->back().first != 4)
+		return false;
+	result = reopened.project(handles->back());
+	if ((*result)["a"].n != 19 || (*result)["b"].s != row["b"].s)
+		return false;
+	delete result;
+	delete handles;
+	std::cout << "16kB blocks ok" << std::endl;
+	reopened.drop();
+
+	// bulk load lands in the same rows as inserting one at a time would
+	HeapTable batch_table("_test_batch_cpp", column_names, column_attributes);
+	batch_table.create();
+	ValueDicts rows;
+	for (int i = 0; i < 500; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("row " + to_string(i));
+		rows.push_back(row);
+	}
+	handles = batch_table.insert_batch(&rows);
+	Handles* selected = batch_table.select();
+	if (*handles != *selected || batch_table.get_batch_stats().blocks_written != handles->back().first)
+		return false;
+	result = batch_table.project((*handles)[321]);
+	if ((*result)["a"].n != 321 || (*result)["b"].s != "row 321")
+		return false;
+	delete result;
+
+	// a batch with a row missing a column, or one too big for any block, adds nothing
+	for (bool columnar : {false, true}) {
+		StorageOptions layout;
+		layout.pax = columnar;
+		HeapTable bad_batch("_test_bad_batch_cpp", column_names, column_attributes, layout);
+		bad_batch.create();
+		delete bad_batch.insert_batch(&rows);
+		ValueDicts bad_rows(rows.begin(), rows.begin() + 10);
+		bad_rows[5].erase("b");
+		try {
+			delete bad_batch.insert_batch(&bad_rows);
+			return false;
+		} catch (DbRelationError &e) {}
+		bad_rows[5]["b"] = Value(string(DbBlock::BLOCK_SZ, 'x'));
+		try {
+			delete bad_batch.insert_batch(&bad_rows);
+			return false;
+		} catch (DbRelationError &e) {}
+		if (bad_batch.count() != 500)
+			return false;
+		bad_batch.close();
+		if (bad_batch.count() != 500)
+			return false;
+		bad_batch.drop();
+	}
+	std::cout << "insert_batch ok" << std::endl;
+
+	// projecting a few columns of one row, then of many rows at once
+	ColumnNames b_then_a = {"b", "a"};
+	result = batch_table.project((*handles)[400], &b_then_a);
+	if (result->size() != 2 || (*result)["a"].n != 400 || (*result)["b"].s != "row 400")
+		return false;
+	delete result;
+	ColumnNames just_b = {"b"};
+	ValueDicts* projected = batch_table.project(handles, &just_b);
+	if (projected->size() != 500 || (*projected)[499].size() != 1 || (*projected)[499]["b"].s != "row 499")
+		return false;
+	delete projected;
+	ColumnNames bogus = {"a", "nope"};
+	try {
+		delete batch_table.project((*handles)[0], &bogus);
+		return false;
+	} catch (DbRelationError &e) {}
+	delete selected;
+	std::cout << "project columns ok" << std::endl;
+
+	// a column at a time, back in the order asked for even when the handles jump between blocks
+	Handles scattered;
+	for (u_int32_t i = 0; i < 500; i += 7)
+		scattered.push_back((*handles)[(i * 131) % 500]);
+	scattered.push_back(scattered.front());
+	ColumnBatch* columns = batch_table.project_many(scattered, &b_then_a);
+	if (columns->num_rows != scattered.size() || columns->columns.size() != 2 || columns->columns[0].column_name != "b")
+		return false;
+	for (u_int32_t i = 0; i < scattered.size(); i++) {
+		ValueDict* expected = batch_table.project(scattered[i]);
+		ValueDict got = columns->get_row(i);
+		if (got.size() != 2 || got["b"].s != (*expected)["b"].s || columns->get_column("a")->ints[i] != (*expected)["a"].n)
+			return false;
+		delete expected;
+	}
+	delete columns;
+	columns = batch_table.project_many(Handles(), nullptr);
+	if (columns->num_rows != 0 || columns->columns.size() != 2)
+		return false;
+	delete columns;
+	std::cout << "project_many ok" << std::endl;
+
+	// equality predicates, tested against the records' bytes
+	ValueDict where;
+	where["a"] = Value(321);
+	selected = batch_table.select(&where);
+	if (selected->size() != 1 || selected->front() != (*handles)[321])
+		return false;
+	delete selected;
+	where["b"] = Value("row 321");
+	selected = batch_table.select(&where);
+	if (selected->size() != 1)
+		return false;
+	delete selected;
+	where["b"] = Value("row 322");
+	selected = batch_table.select(&where);
+	if (!selected->empty())
+		return false;
+	delete selected;
+	where.clear();
+	selected = batch_table.select(&where);
+	if (*selected != *handles)
+		return false;
+	delete selected;
+	where["a"] = Value("321");
+	try {
+		delete batch_table.select(&where);
+		return false;
+	} catch (DbRelationError &e) {}
+	delete handles;
+	std::cout << "select where ok" << std::endl;
+	batch_table.drop();
+
+	// same rows through the memory-mapped file, reopened without being told its block size
+	StorageOptions mapped;
+	mapped.mmap = true;
+	mapped.block_sz = 8 * 1024;
+	HeapTable mmap_table("_test_mmap_cpp", column_names, column_attributes, mapped);
+	mmap_table.create();
+	handles = mmap_table.insert_batch(&rows);
+	row["a"] = Value(500);
+	row["b"] = Value("row 500");
+	mmap_table.insert(&row);
+	mmap_table.close();
+	mapped.block_sz = DbBlock::BLOCK_SZ;
+	HeapTable mmap_reopened("_test_mmap_cpp", column_names, column_attributes, mapped);
+	mmap_reopened.open();
+	selected = mmap_reopened.select();
+	if (selected->size() != 501 || (*selected)[321] != (*handles)[321])
+		return false;
+	result = mmap_reopened.project(selected->back());
+	if ((*result)["a"].n != 500 || (*result)["b"].s != "row 500")
+		return false;
+	delete result;
+	delete selected;
+	delete handles;
+	std::cout << "mmap file ok" << std::endl;
+	mmap_reopened.drop();
+
+	// compressed pages, reopened by a table that doesn't know they are compressed
+	StorageOptions compressed;
+	compressed.compress = true;
+	HeapTable packed_table("_test_compressed_cpp", column_names, column_attributes, compressed);
+	packed_table.create();
+	handles = packed_table.insert_batch(&rows);
+	packed_table.close();
+	packed_table.open();
+	delete packed_table.select();
+	if (packed_table.get_compression_stats().pages_unpacked == 0)
+		return false;
+	row["a"] = Value(500);
+	row["b"] = Value("row 500");
+	packed_table.insert(&row);
+	BufferPool::instance().checkpoint();
+	if (packed_table.get_compression_stats().ratio() < 2.0)
+		return false;
+	packed_table.close();
+	HeapTable packed_reopened("_test_compressed_cpp", column_names, column_attributes);
+	packed_reopened.open();
+	selected = packed_reopened.select();
+	if (selected->size() != 501 || (*selected)[321] != (*handles)[321])
+		return false;
+	result = packed_reopened.project((*selected)[321]);
+	if ((*result)["a"].n != 321 || (*result)["b"].s != "row 321")
+		return false;
+	delete result;
+	delete selected;
+	delete handles;
+	std::cout << "compressed pages ok" << std::endl;
+	packed_reopened.drop();
+
+	// PAX blocks behind the same HeapTable interface, reopened by a table that doesn't know
+	StorageOptions columnar;
+	columnar.pax = true;
+	HeapTable pax_table("_test_pax_cpp", column_names, column_attributes, columnar);
+	pax_table.create();
+	handles = pax_table.insert_batch(&rows);
+	row["a"] = Value(500);
+	row["b"] = Value("row 500");
+	pax_table.insert(&row);
+	pax_table.close();
+	HeapTable pax_reopened("_test_pax_cpp", column_names, column_attributes);
+	selected = pax_reopened.select();
+	if (!pax_reopened.is_pax() || selected->size() != 501 || (*selected)[321] != (*handles)[321])
+		return false;
+	result = pax_reopened.project(selected->back());
+	if ((*result)["a"].n != 500 || (*result)["b"].s != "row 500")
+		return false;
+	delete result;
+	projected = pax_reopened.project(handles, &b_then_a);
+	if ((*projected)[77]["a"].n != 77 || (*projected)[77]["b"].s != "row 77")
+		return false;
+	delete projected;
+	scattered.clear();
+	for (u_int32_t i = 0; i < 500; i += 7)
+		scattered.push_back((*handles)[(i * 131) % 500]);
+	columns = pax_reopened.project_many(scattered, &b_then_a);
+	for (u_int32_t i = 0; i < scattered.size(); i++)
+		if (columns->get_column("a")->ints[i] != (int32_t)((i * 7 * 131) % 500) || columns->get_row(i)["b"].s != "row "
+				+ to_string((i * 7 * 131) % 500))
+			return false;
+	delete columns;
+	delete selected;
+	where.clear();
+	where["b"] = Value("row 42");
+	selected = pax_reopened.select(&where);
+	if (selected->size() != 1 || selected->front() != (*handles)[42])
+		return false;
+	delete selected;
+	where["a"] = Value(42);
+	selected = pax_reopened.select(&where);
+	if (selected->size() != 1 || selected->front() != (*handles)[42])
+		return false;
+	delete selected;
+	where["a"] = Value(43);
+	selected = pax_reopened.select(&where);
+	if (!selected->empty())
+		return false;
+	delete selected;
+	delete handles;
+	Row pax_row(2);
+	pax_row.set_int(0, 501);
+	pax_row.set_text(1, "row 501");
+	handle = pax_reopened.insert(&pax_row);
+	pax_row.clear();
+	pax_reopened.project(handle, nullptr, &pax_row);
+	if (pax_row.get_int(0) != 501 || pax_row.get(1).s != "row 501" || pax_reopened.count() != 502)
+		return false;
+	std::cout << "pax table ok" << std::endl;
+	pax_reopened.drop();
+
+	// a long row after many short ones: a fresh block leaves it room whatever the average so far
+	HeapTable pax_long("_test_pax_long_cpp", column_names, column_attributes, columnar);
+	pax_long.create();
+	for (int i = 0; i < 1000; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("s");
+		pax_long.insert(&row);
+	}
+	row["a"] = Value(1000);
+	row["b"] = Value(std::string(3000, 'L'));
+	handle = pax_long.insert(&row);
+	result = pax_long.project(handle);
+	if ((*result)["a"].n != 1000 || (*result)["b"].s != std::string(3000, 'L') || pax_long.count() != 1001)
+		return false;
+	delete result;
+	Row long_row;
+	pax_long.project(handle, nullptr, &long_row);
+	size_t long_row_memory = long_row.memory_size();
+	for (int i = 0; i < 100; i++)
+		pax_long.project(handle, nullptr, &long_row);
+	if (long_row.get_text(1).size != 3000 || long_row.memory_size() != long_row_memory)
+		return false;
+	for (int pass = 0; pass < 3; pass++) {
+		HandleCursor* cursor = pax_long.select_cursor(nullptr, 1, pax_long.get_block_count());
+		while (cursor->next(handle))
+			cursor->project(nullptr, &long_row);
+		delete cursor;
+	}
+	if (long_row.get_text(1).size != 3000 || long_row.memory_size() != long_row_memory)
+		return false;
+	std::cout << "pax long row ok" << std::endl;
+
+	// without its side file the free-space map is rebuilt from the PAX blocks themselves, so a
+	// short row goes in one of them rather than past them
+	BlockID pax_blocks = pax_long.get_block_count();
+	pax_long.close();
+	const char* home = nullptr;
+	_DB_ENV->get_home(&home);
+	std::remove((std::string(home) + "/_test_pax_long_cpp.fsm").c_str());
+	HeapTable pax_rebuilt("_test_pax_long_cpp", column_names, column_attributes);
+	row["a"] = Value(1001);
+	row["b"] = Value("s");
+	handle = pax_rebuilt.insert(&row);
+	if (!pax_rebuilt.is_pax() || handle.first > pax_blocks || pax_rebuilt.count() != 1002)
+		return false;
+	std::cout << "pax free-space map rebuilt ok" << std::endl;
+	pax_rebuilt.drop();
+
+	// dictionary: one code per distinct string, shared by the encoded columns
+	TextDictionary words;
+	words.create("", {1});
+	if (words.code(RecordView("red", 3)) != 0 || words.code(RecordView("green", 5)) != 1
+			|| words.code(RecordView("red", 3)) != 0 || words.find(RecordView("blue", 4)) != TextDictionary::NO_CODE
+			|| std::string(words.text(1).data, words.text(1).size) != "green" || words.size() != 2)
+		return false;
+	try {
+		words.text(2);
+		return false;
+	} catch (DbRelationError &e) {}
+
+	// dictionary-encoded b: smaller records, same values back, and reopened without being told
+	StorageOptions encoded;
+	encoded.dictionary = {"b"};
+	ValueDicts statuses;
+	for (int i = 0; i < 2000; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("status number " + to_string(i % 5));
+		statuses.push_back(row);
+	}
+	HeapTable plain_table("_test_plain_cpp", column_names, column_attributes);
+	plain_table.create();
+	handles = plain_table.insert_batch(&statuses);
+	BlockID plain_blocks = handles->back().first;
+	delete handles;
+	plain_table.drop();
+	for (bool columnar : {false, true}) {
+		encoded.pax = columnar;
+		HeapTable dict_table("_test_dictionary_cpp", column_names, column_attributes, encoded);
+		dict_table.create();
+		handles = dict_table.insert_batch(&statuses);
+		if (dict_table.get_dictionary().size() != 5 || (!columnar && handles->back().first * 2 > plain_blocks))
+			return false;
+		dict_table.close();
+		HeapTable dict_reopened("_test_dictionary_cpp", column_names, column_attributes);
+		result = dict_reopened.project((*handles)[1234]);
+		if ((*result)["a"].n != 1234 || (*result)["b"].s != "status number 4")
+			return false;
+		delete result;
+		where.clear();
+		where["b"] = Value("status number 2");
+		selected = dict_reopened.select(&where);
+		if (selected->size() != 400 || (*selected)[1] != (*handles)[7])
+			return false;
+		delete selected;
+		where["b"] = Value("status number 9");
+		selected = dict_reopened.select(&where);
+		if (!selected->empty() || dict_reopened.get_dictionary().size() != 5)
+			return false;
+		delete selected;
+		row["a"] = Value(-1);
+		row["b"] = Value("brand new status");
+		Handle added = dict_reopened.insert(&row);
+		ColumnBatch* batch_b = dict_reopened.project_many(Handles({(*handles)[3], added}), &just_b);
+		if (batch_b->get_row(0)["b"].s != "status number 3" || batch_b->get_row(1)["b"].s != "brand new status")
+			return false;
+		delete batch_b;
+		delete handles;
+		dict_reopened.close();
+		HeapTable dict_again("_test_dictionary_cpp", column_names, column_attributes);
+		dict_again.open();
+		if (dict_again.get_dictionary().size() != 6)
+			return false;
+		dict_again.drop();
+	}
+	encoded.pax = false;
+	HeapTable dict_if_new("_test_dictionary_cpp", column_names, column_attributes, encoded);
+	dict_if_new.create_if_not_exists();
+	dict_if_new.insert(&statuses[0]);
+	dict_if_new.close();
+	HeapTable dict_if_reopened("_test_dictionary_cpp", column_names, column_attributes);
+	dict_if_reopened.open();
+	if (dict_if_reopened.get_dictionary().size() != 1)
+		return false;
+	dict_if_reopened.drop();
+	std::cout << "dictionary ok" << std::endl;
+
 	return true;
 }
+
+// time stamp counter where there is one, else nanoseconds (which the report then calls cycles)
+static u_int64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return (u_int64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// each INT kernel over a block's worth of values at a time, as cycles per value
+static void bench_int_filter() {
+	const u_int32_t BATCH = 1024;
+	const int REPEAT = 20000;
+	std::vector<int32_t> values(BATCH);
+	for (u_int32_t i = 0; i < BATCH; i++)
+		values[i] = (int32_t)((i * 2654435761u) % 1000);
+	std::vector<u_int64_t> mask(IntFilter::mask_words(BATCH));
+	IntPredicate predicates[] = {IntPredicate(IntPredicate::EQ, 500), IntPredicate(IntPredicate::LT, 500),
+		IntPredicate(IntPredicate::GT, 500), IntPredicate(IntPredicate::BETWEEN, 250, 750)};
+	const char* names[] = {"=", "<", ">", "between"};
+	for (int isa = IntFilter::SCALAR; isa <= IntFilter::best_isa(); isa++) {
+		std::cout << "int filter " << IntFilter::isa_name((IntFilter::Isa)isa) << ":";
+		for (int p = 0; p < 4; p++) {
+			u_int64_t start = read_cycles();
+			for (int r = 0; r < REPEAT; r++)
+				IntFilter::evaluate(predicates[p], values.data(), BATCH, mask.data(), (IntFilter::Isa)isa);
+			double cycles = (double)(read_cycles() - start) / ((double)BATCH * REPEAT);
+			std::cout << " " << names[p] << " " << cycles;
+		}
+		std::cout << " cycles/value" << std::endl;
+	}
+}
+
+// benchmark one file kind: bulk load, then a full scan projecting every row
+static void bench_storage(const char* label, const StorageOptions& options, const ColumnNames& column_names,
+	const ColumnAttributes& column_attributes, const ValueDicts& rows) {
+	HeapTable table(string("_bench_storage_cpp_") + label, column_names, column_attributes, options);
+	table.create();
+	delete table.insert_batch(&rows);
+	double load = table.get_batch_stats().seconds;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	HandleCursor* cursor = table.select_cursor();
+	Handle handle;
+	while (cursor->next(handle))
+		delete table.project(handle);
+	delete cursor;
+	double scan = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << label << " load: " << rows.size() / load << " rows/sec, scan: " << rows.size() / scan
+		<< " rows/sec" << std::endl;
+	ColumnNames one_column = {"a"};
+	Handles* handles = table.select();
+	start = chrono::steady_clock::now();
+	delete table.project(handles, &one_column);
+	scan = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << label << " one INT column: " << rows.size() / scan << " rows/sec" << std::endl;
+	Handles shuffled(*handles);
+	for (u_int32_t i = 0; i < shuffled.size(); i++)
+		std::swap(shuffled[i], shuffled[(i * 2654435761u) % shuffled.size()]);
+	delete handles;
+	start = chrono::steady_clock::now();
+	delete table.project(&shuffled, nullptr);
+	scan = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << label << " shuffled handles, project: " << rows.size() / scan << " rows/sec";
+	start = chrono::steady_clock::now();
+	delete table.project_many(shuffled, nullptr);
+	scan = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << ", project_many: " << rows.size() / scan << " rows/sec" << std::endl;
+	ValueDict where;
+	where["a"] = Value((int)rows.size() / 2);
+	start = chrono::steady_clock::now();
+	delete table.select(&where);
+	scan = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << label << " select where a =: " << rows.size() / scan << " rows/sec" << std::endl;
+	const CompressionStats &compression = table.get_compression_stats();
+	if (compression.pages_packed > 0)
+		std::cout << label << " ratio: " << compression.ratio() << ", compress: " << compression.pack_seconds
+			<< "s for " << compression.pages_packed << " pages, decompress: " << compression.unpack_seconds
+			<< "s for " << compression.pages_unpacked << " pages" << std::endl;
+	table.drop();
+}
+
+// benchmark -- prints rows/sec for row-at-a-time insert() against insert_batch(),
+// then for the Berkeley DB RecNo file (plain and compressed) against the memory-mapped one
+void bench_heap_storage() {
+	const int N = 100000;
+	ColumnNames column_names;
+	column_names.push_back("a");
+	column_names.push_back("b");
+	ColumnAttributes column_attributes;
+	column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+	column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+
+	ValueDicts rows;
+	ValueDict row;
+	for (int i = 0; i < N; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("bench row number " + to_string(i));
+		rows.push_back(row);
+	}
+
+	HeapTable one_at_a_time("_bench_insert_cpp", column_names, column_attributes);
+	one_at_a_time.create();
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (auto const& r : rows)
+		one_at_a_time.insert(&r);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "insert:       " << N << " rows in " << seconds << "s (" << N / seconds << " rows/sec)" << std::endl;
+	one_at_a_time.drop();
+
+	RowCodec codec(column_names, column_attributes);
+	Rows flat_rows(N);
+	for (int i = 0; i < N; i++)
+		codec.to_row(&rows[i], flat_rows[i]);
+	HeapTable row_at_a_time("_bench_insert_row_cpp", column_names, column_attributes);
+	row_at_a_time.create();
+	start = chrono::steady_clock::now();
+	for (auto const& r : flat_rows)
+		row_at_a_time.insert(&r);
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "insert Row:   " << N << " rows in " << seconds << "s (" << N / seconds << " rows/sec)" << std::endl;
+	Handles* row_handles = row_at_a_time.select();
+	start = chrono::steady_clock::now();
+	for (auto const& handle : *row_handles)
+		delete row_at_a_time.project(handle);
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "project:      " << N / seconds << " rows/sec";
+	Row flat;
+	start = chrono::steady_clock::now();
+	for (auto const& handle : *row_handles)
+		row_at_a_time.project(handle, nullptr, &flat);
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << ", into a Row: " << N / seconds << " rows/sec" << std::endl;
+	Arena arena;
+	{
+		StatementArena statement(arena);
+		start = chrono::steady_clock::now();
+		for (auto const& handle : *row_handles)
+			delete row_at_a_time.project(handle);
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+	std::cout << "project in a statement arena: " << N / seconds << " rows/sec, " << StatementArena::last_allocations
+		<< " allocations, " << StatementArena::last_peak << " bytes peak" << std::endl;
+	delete row_handles;
+	row_at_a_time.drop();
+
+	HeapTable batch("_bench_insert_batch_cpp", column_names, column_attributes);
+	batch.create();
+	delete batch.insert_batch(&rows);
+	const BatchStats &stats = batch.get_batch_stats();
+	std::cout << "insert_batch: " << stats.rows << " rows in " << stats.seconds << "s (" << stats.rows_per_sec()
+		<< " rows/sec, " << stats.blocks_written << " blocks written)" << std::endl;
+
+	// one row out of N: every row projected and compared, against testing the bytes in place
+	ValueDict where;
+	where["b"] = Value("bench row number " + to_string(N / 2));
+	start = chrono::steady_clock::now();
+	Handles* matches = new Handles();
+	Handles* all = batch.select();
+	for (auto const& handle : *all) {
+		ValueDict* r = batch.project(handle);
+		if ((*r)["b"].s == where["b"].s)
+			matches->push_back(handle);
+		delete r;
+	}
+	delete all;
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "select+project: " << N / seconds << " rows/sec scanned, " << matches->size() << " found" << std::endl;
+	delete matches;
+	start = chrono::steady_clock::now();
+	matches = batch.select(&where);
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "select where:   " << N / seconds << " rows/sec scanned, " << matches->size() << " found" << std::endl;
+	delete matches;
+	batch.drop();
+
+	// rows' TEXTs differ in length, so the buffer is sized for the longest, and the record
+	// decoded is the last one encoded, at its own length
+	const int M = 1000000;
+	u_int32_t longest = 0;
+	for (auto const& r : rows)
+		longest = std::max(longest, codec.size(&r));
+	std::vector<char> record(longest);
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < M; i++)
+		codec.encode(&rows[i % N], record.data());
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "marshal:      " << M / seconds << " rows/sec" << std::endl;
+	u_int32_t encoded = codec.size(&rows[(M - 1) % N]);
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < M; i++)
+		delete codec.decode(RecordView(record.data(), encoded));
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "unmarshal:    " << M / seconds << " rows/sec" << std::endl;
+	for (auto const& r : flat_rows)
+		longest = std::max(longest, codec.size(r));
+	record.resize(longest);
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < M; i++)
+		codec.encode(flat_rows[i % N], record.data());
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "marshal Row:  " << M / seconds << " rows/sec" << std::endl;
+	encoded = codec.size(flat_rows[(M - 1) % N]);
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < M; i++)
+		codec.decode(RecordView(record.data(), encoded), flat);
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "unmarshal Row: " << M / seconds << " rows/sec" << std::endl;
+
+	// 2 of 40 columns: whole rows against decoding just the ones asked for
+	const int W = 20000;
+	ColumnNames wide_names;
+	ColumnAttributes wide_attributes;
+	ValueDict wide_row;
+	for (int c = 0; c < 40; c++) {
+		wide_names.push_back("c" + to_string(c));
+		wide_attributes.push_back(ColumnAttribute(c % 2 ? ColumnAttribute::TEXT : ColumnAttribute::INT));
+		wide_row[wide_names.back()] = c % 2 ? Value("wide column text " + to_string(c)) : Value(c);
+	}
+	HeapTable wide("_bench_wide_cpp", wide_names, wide_attributes);
+	wide.create();
+	ValueDicts wide_rows(W, wide_row);
+	delete wide.insert_batch(&wide_rows);
+	Handles* wide_handles = wide.select();
+	start = chrono::steady_clock::now();
+	for (auto const& handle : *wide_handles) {
+		ValueDict* full = wide.project(handle);
+		ValueDict two;
+		two["c3"] = (*full)["c3"];
+		two["c30"] = (*full)["c30"];
+		delete full;
+	}
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "project all:  " << W / seconds << " rows/sec" << std::endl;
+	ColumnNames two_columns = {"c3", "c30"};
+	start = chrono::steady_clock::now();
+	delete wide.project(wide_handles, &two_columns);
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	std::cout << "project 2/40: " << W / seconds << " rows/sec" << std::endl;
+	delete wide_handles;
+	wide.drop();
+
+	bench_int_filter();
+
+	StorageOptions options;
+	bench_storage("recno", options, column_names, column_attributes, rows);
+	options.compress = true;
+	bench_storage("compressed", options, column_names, column_attributes, rows);
+	options.compress = false;
+	options.pax = true;
+	bench_storage("pax", options, column_names, column_attributes, rows);
+	options.pax = false;
+	options.mmap = true;
+	bench_storage("mmap", options, column_names, column_attributes, rows);
+
+	// a few hundred distinct TEXT values: the strings in every record against codes
+	ValueDicts status_rows;
+	for (int i = 0; i < N; i++) {
+		row["a"] = Value(i);
+		row["b"] = Value("region-" + to_string(i % 300) + "/status-pending-review");
+		status_rows.push_back(row);
+	}
+	for (bool coded : {false, true}) {
+		StorageOptions status_options;
+		if (coded)
+			status_options.dictionary = {"b"};
+		HeapTable table("_bench_dictionary_cpp", column_names, column_attributes, status_options);
+		table.create();
+		Handles* handles = table.insert_batch(&status_rows);
+		ValueDict where;
+		where["b"] = Value("region-42/status-pending-review");
+		start = chrono::steady_clock::now();
+		Handles* found = table.select(&where);
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		std::cout << (coded ? "dictionary" : "plain TEXT") << ": " << handles->back().first << " blocks, load: "
+			<< table.get_batch_stats().rows_per_sec() << " rows/sec, select where b =: " << N / seconds
+			<< " rows/sec (" << found->size() << " found)" << std::endl;
+		delete found;
+		delete handles;
+		table.drop();
+	}
+}
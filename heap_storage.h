@@ -9,8 +9,15 @@
  */
 #pragma once
 
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "db_cxx.h"
 #include "storage_engine.h"
+#include "row_codec.h"
+#include "pax_page.h"
+#include "text_dictionary.h"
 
 /**
  * @class SlottedPage - heap file implementation of DbBlock.
@@ -25,6 +32,16 @@
             Bytes 0x04 - 0x05: size of record 1
             Bytes 0x06 - 0x07: offset to record 1
             etc.
+
+        Blocks may be any size the HeapFile was created with (see DbBlock::valid_block_size).
+        Two-byte slot entries can address every byte of a block up to 64kB (offset 0 is never a
+        record, so it still means "deleted"). Bigger blocks use wide slot entries: the same
+        layout but with 4-byte counts, sizes and offsets (8 bytes per record).
+
+        Deleted records have size and offset 0. With defer_compaction set, del() and put()
+        leave the bytes they vacate as dead space in the data area instead of sliding the
+        other records over, and the whole page is compacted in one pass only when a later
+        add() or put() would not otherwise fit.
  *
  */
 class SlottedPage : public DbBlock {
@@ -38,23 +55,216 @@ public:
 	SlottedPage& operator=(const SlottedPage& other) = delete;
 	SlottedPage& operator=(SlottedPage& temp) = delete;
 
+	virtual void initialize_new();
 	virtual RecordID add(const Dbt* data) throw(DbBlockNoRoomError);
 	virtual Dbt* get(RecordID record_id);
 	virtual void put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError);
 	virtual void del(RecordID record_id);
 	virtual RecordIDs* ids(void);
+	virtual RecordID next_id(RecordID prev=0);
+
+	/**
+	 * @returns  how many records the block has, from its slot directory alone
+	 */
+	virtual u_int32_t count_records();
+
+	/**
+	 * Zero-copy version of get().
+	 * @param record_id  which record to look at
+	 * @returns          view of the record's bytes in this block (is_null() if deleted)
+	 */
+	virtual RecordView view(RecordID record_id);
+	virtual u_int32_t free_space();
+
+	/**
+	 * Add a new record of the given size without filling it in, so the caller can build
+	 * the record directly in the block.
+	 * @param size       size of the new record
+	 * @param record_id  set to the new record's id
+	 * @returns          where to write the record's size bytes
+	 * @throws           DbBlockNoRoomError if insufficient room in the block
+	 */
+	virtual char* reserve(u_int32_t size, RecordID &record_id) throw(DbBlockNoRoomError);
+
+	/**
+	 * Point this page at a refilled block of memory (e.g., by HeapFile::pin) and re-read
+	 * its header, so one SlottedPage object can be reused across blocks.
+	 * @param block     the block's memory (its size is the block size)
+	 * @param block_id  the BlockID of the block now in memory
+	 */
+	virtual void load(Dbt &block, BlockID block_id);
+
+	/**
+	 * Biggest block that still uses two-byte slot entries.
+	 */
+	static const u_int32_t MAX_NARROW_BLOCK_SZ = 65536;
+
+	/**
+	 * RecordIDs are two bytes, so no block can hold more records than this.
+	 */
+	static const u_int32_t MAX_RECORDS = 65535;
+
+	/**
+	 * Page maintenance mode shared by all pages: false (the default) slides data on every
+	 * del/put; true defers it to a single compact() when room runs out.
+	 */
+	static bool defer_compaction;
+
+	// maintenance counters, shared by all pages
+	static u_int32_t compactions;          // compact() passes actually run
+	static u_int32_t compactions_avoided;  // del/put calls that left dead space instead of sliding
+
+protected:
+	u_int32_t num_records;
+	u_int32_t end_free;
+
+	u_int32_t block_size() {return block.get_size();}
+	bool is_wide() {return block_size() > MAX_NARROW_BLOCK_SZ;}
+	u_int32_t slot_size() {return is_wide() ? 8 : 4;}
+
+	virtual void get_header(u_int32_t &size, u_int32_t &loc, RecordID id=0);
+	virtual void put_header(RecordID id=0, u_int32_t size=0, u_int32_t loc=0);
+	virtual bool has_room(u_int32_t size);
+	virtual bool make_room(u_int32_t size);
+	virtual void compact();
+	virtual u_int32_t dead_space();
+	virtual void slide(u_int32_t start, u_int32_t end);
+	virtual u_int16_t get_n(u_int32_t offset);
+	virtual void put_n(u_int32_t offset, u_int16_t n);
+	virtual u_int32_t get_wide_n(u_int32_t offset);
+	virtual void put_wide_n(u_int32_t offset, u_int32_t n);
+	virtual void* address(u_int32_t offset);
+};
+
+class BufferFrame;
+
+/**
+ * @class PinnedPage - handle on one block of a HeapFile pinned in the BufferPool
+ *
+ * HeapFile::pin() points it at the block's frame (reading the block in only on a miss),
+ * and the block stays in memory until the handle moves to another block, release() is
+ * called, or the handle goes away. Pinning again the block it already holds is free,
+ * so scanning or projecting through one PinnedPage costs no allocations or copies per
+ * block or per record. Small enough to live on the stack.
+ */
+class PinnedPage {
+public:
+	PinnedPage() : frame(nullptr) {}
+	~PinnedPage() {release();}
+	PinnedPage(const PinnedPage& other) = delete;
+	PinnedPage(PinnedPage&& temp) = delete;
+	PinnedPage& operator=(const PinnedPage& other) = delete;
+	PinnedPage& operator=(PinnedPage&& temp) = delete;
+
+	/**
+	 * @returns  the page for the currently pinned block
+	 */
+	SlottedPage* get_page();
+
+	/**
+	 * @returns  which block is pinned (0 if none)
+	 */
+	BlockID get_block_id();
+
+	/**
+	 * Unpin the block now (a dirty block may be written back).
+	 */
+	void release();
+
+protected:
+	friend class HeapFile;
+	BufferFrame* frame;
+};
+
+/**
+ * @class FreeSpaceMap - coarse record of how much room each block of a HeapFile has
+ *
+ * Each block gets one byte holding its free space rounded down to a bucket of
+ * BLOCK_SZ/BUCKETS bytes, so any block in a bucket is guaranteed to have at least
+ * that much room. Per-bucket stacks of candidate blocks make find() constant time
+ * (stale entries are dropped lazily as they surface).
+ *
+ * The bytes are kept in a side file next to the Berkeley DB file, written on save()
+ * and read back on load(). A stale side file only costs us a wasted lookup: if the
+ * block turns out to be full after all, the caller falls back to a new block.
+ */
+class FreeSpaceMap {
+public:
+	static const uint BUCKETS = 16;
+
+	FreeSpaceMap() : path(""), block_sz(DbBlock::BLOCK_SZ) {}
+	virtual ~FreeSpaceMap() {}
+	FreeSpaceMap(const FreeSpaceMap& other) = delete;
+	FreeSpaceMap(FreeSpaceMap&& temp) = delete;
+	FreeSpaceMap& operator=(const FreeSpaceMap& other) = delete;
+	FreeSpaceMap& operator=(FreeSpaceMap&& temp) = delete;
+
+	/**
+	 * Start an empty map that will be saved to the given side file.
+	 * @param path      where the map lives on disk
+	 * @param block_sz  block size of the file being mapped
+	 */
+	virtual void create(std::string path, u_int32_t block_sz=DbBlock::BLOCK_SZ);
+
+	/**
+	 * Read the map back from its side file.
+	 * @param path      where the map lives on disk
+	 * @param block_sz  block size of the file being mapped
+	 * @returns         false if there is no usable side file (map is left empty)
+	 */
+	virtual bool load(std::string path, u_int32_t block_sz=DbBlock::BLOCK_SZ);
+
+	/**
+	 * Write the map out to its side file.
+	 */
+	virtual void save();
+
+	/**
+	 * Remove the side file.
+	 */
+	virtual void drop();
+
+	/**
+	 * Record how much room a block has now.
+	 * @param block_id    which block
+	 * @param free_bytes  its DbBlock::free_space()
+	 */
+	virtual void update(BlockID block_id, u_int32_t free_bytes);
+
+	/**
+	 * Find a block with room for a record.
+	 * @param size  size of the record to add
+	 * @returns     a block that has at least size bytes free, or 0 if none does
+	 */
+	virtual BlockID find(u_int32_t size);
+
+	/**
+	 * @returns  number of blocks covered by the map
+	 */
+	virtual u_int32_t size() {return (u_int32_t)buckets.size();}
 
 protected:
-	u_int16_t num_records;
-	u_int16_t end_free;
-
-	virtual void get_header(u_int16_t &size, u_int16_t &loc, RecordID id=0);
-	virtual void put_header(RecordID id=0, u_int16_t size=0, u_int16_t loc=0);
-	virtual bool has_room(u_int16_t size);
-	virtual void slide(u_int16_t start, u_int16_t end);
-	virtual u_int16_t get_n(u_int16_t offset);
-	virtual void put_n(u_int16_t offset, u_int16_t n);
-	virtual void* address(u_int16_t offset);
+	std::string path;
+	u_int32_t block_sz;
+	std::vector<u_int8_t> buckets;               // bucket for block i is at buckets[i - 1]
+	std::vector<BlockID> candidates[BUCKETS];    // blocks (maybe stale) per bucket
+	virtual void push(BlockID block_id, u_int8_t bucket);
+};
+
+/**
+ * @class CompressionStats - what page compression has cost and saved a HeapFile since it was opened
+ */
+struct CompressionStats {
+	u_int64_t pages_packed;
+	u_int64_t bytes_in;       // block bytes handed to the compressor
+	u_int64_t bytes_out;      // bytes actually stored for them
+	double pack_seconds;
+	u_int64_t pages_unpacked;
+	double unpack_seconds;
+
+	CompressionStats() : pages_packed(0), bytes_in(0), bytes_out(0), pack_seconds(0.0), pages_unpacked(0),
+		unpack_seconds(0.0) {}
+	double ratio() const {return bytes_out > 0 ? (double)bytes_in / bytes_out : 0.0;}
 };
 
 /**
@@ -64,11 +274,25 @@ protected:
         database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
         for buffer management and file management.
         Uses SlottedPage for storing records within blocks.
+        Keeps a FreeSpaceMap in <name>.fsm in the environment home so inserts can reuse room
+        in any block, not just the last one. Without the side file the map is rebuilt by
+        measuring every block, as the owner says to (set_free_space_measure) or as SlottedPages.
+        The block size is chosen when the file is created and kept by Berkeley DB as the RecNo
+        record length, so open() picks it back up from the file itself.
+        Blocks are cached in the engine's BufferPool: pin() and pin_new() go through it, and
+        put() of a pinned page just marks its frame dirty.
+        The Berkeley DB handle is opened DB_THREAD, so any number of threads can pin() blocks
+        of one open file at once (for parallel scans); everything else is for one thread.
  */
 class HeapFile : public DbFile {
 public:
-	HeapFile(std::string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {}
-	virtual ~HeapFile() {}
+	static const u_int32_t DEFAULT_EXTENT = 64;  // blocks added to the file at a time
+
+	HeapFile(std::string name, u_int32_t block_sz=DbBlock::BLOCK_SZ, u_int32_t extent=DEFAULT_EXTENT,
+		bool compress=false)
+		: DbFile(name), dbfilename(""), last(0), allocated(0), block_sz(block_sz), extent(extent), compress(compress),
+		closed(true), db(_DB_ENV, 0), fsm(), measure(), fresh(), unpacked(), packed(), compression(), stats_latch() {}
+	virtual ~HeapFile();
 	HeapFile(const HeapFile& other) = delete;
 	HeapFile(HeapFile&& temp) = delete;
 	HeapFile& operator=(const HeapFile& other) = delete;
@@ -82,15 +306,156 @@ public:
 	virtual SlottedPage* get(BlockID block_id);
 	virtual void put(DbBlock* block);
 	virtual BlockIDs* block_ids();
+	virtual BlockCursor* block_cursor();
+
+	/**
+	 * Pin a block in the buffer pool, moving the PinnedPage off whatever block it held.
+	 * @param block_id  which block to pin
+	 * @param pinned    handle to pin it with
+	 */
+	virtual void pin(BlockID block_id, PinnedPage &pinned);
+
+	/**
+	 * Pin an empty new block without any I/O. It becomes part of the file when it is
+	 * put(), as BlockID get_next_block_id().
+	 * @param pinned  handle to pin it with
+	 */
+	virtual void pin_new(PinnedPage &pinned);
+
+	/**
+	 * Find a block with room for a new record (via the free-space map).
+	 * @param size  size of the record to add
+	 * @returns     BlockID of a block with room, or 0 if a new block is needed
+	 */
+	virtual BlockID find_room(u_int32_t size) {return fsm.find(size);}
+
+	/**
+	 * How to tell a block's free space when the free-space map has to be rebuilt, for owners
+	 * whose blocks aren't all SlottedPages. Without one, SlottedPage::free_space().
+	 * @param measure  given a block pinned as a SlottedPage, its DbBlock::free_space()
+	 */
+	virtual void set_free_space_measure(std::function<u_int32_t(SlottedPage*)> measure) {this->measure = measure;}
 
 	virtual u_int32_t get_last_block_id() {return last;}
+	virtual BlockID get_next_block_id() {return last + 1;}  // id put() will append as
+	virtual u_int32_t get_block_size() {return block_sz;}
+	virtual bool is_compressed() {return compress;}
+	virtual bool is_open() {return !closed;}
+	virtual const CompressionStats& get_compression_stats() {return compression;}
 
 protected:
+	friend class BufferPool;
 	std::string dbfilename;
 	u_int32_t last;
+	u_int32_t allocated;  // blocks in the file, counting the empty ones preallocated past last
+	u_int32_t block_sz;
+	u_int32_t extent;
+	bool compress;            // blocks stored through PageCodec as variable-length records
 	bool closed;
 	Db db;
+	FreeSpaceMap fsm;
+	std::function<u_int32_t(SlottedPage*)> measure;  // rebuild_fsm()'s, if the owner gave one
+	std::vector<char> fresh;     // get_new()'s page (good until the next get_new)
+	std::vector<char> unpacked;  // get()'s page (good until the next get)
+	std::vector<char> packed;
+	CompressionStats compression;
+	std::mutex stats_latch;      // guards compression's unpack counters, which concurrent pins add to
 	virtual void db_open(uint flags=0);
+	virtual void extend(BlockID block_id);
+	virtual void store(BlockID block_id, const char* bytes);
+	virtual void fetch(BlockID block_id, char* bytes);
+	virtual std::string fsm_path();
+	virtual void rebuild_fsm();
+	virtual BlockID last_used(BlockID end);
+	virtual void read(BlockID block_id, Dbt &data);
+	virtual void write(DbBlock* block);
+};
+
+/**
+ * @class HeapBlockCursor - BlockCursor over a contiguous range of a HeapFile's BlockIDs
+ *
+ * HeapFile block ids are dense (1..last), so all we need to remember is where we are.
+ */
+class HeapBlockCursor : public BlockCursor {
+public:
+	HeapBlockCursor(BlockID first, BlockID last) : current(first - 1), last(last) {}
+	virtual ~HeapBlockCursor() {}
+
+	virtual bool next(BlockID &block_id);
+
+protected:
+	BlockID current;
+	BlockID last;
+};
+
+/**
+ * @class HeapHandleCursor - HandleCursor over the rows of a HeapFile
+ *
+ * Pins just the current block with its own PinnedPage and walks its slot directory
+ * with next_id(), so memory stays at one block no matter how big the file is.
+ * (The pin keeps the block in the pool even if a project() between next() calls
+ * brings in other blocks.)
+ */
+class HeapHandleCursor : public HandleCursor {
+public:
+	/**
+	 * @param file    file to walk
+	 * @param blocks  which of its blocks, in order (the cursor frees it)
+	 * @param codec   record format, needed for a filter or project()
+	 * @param filter  tests a record has to pass to be returned, checked on its bytes in the block
+	 * @param layout  for a file of PaxPage blocks, their layout (nullptr for SlottedPage)
+	 */
+	HeapHandleCursor(HeapFile &file, BlockCursor* blocks, const RowCodec* codec=nullptr,
+		const RowFilter& filter=RowFilter(), const PaxLayout* layout=nullptr);
+	virtual ~HeapHandleCursor();
+	HeapHandleCursor(const HeapHandleCursor& other) = delete;
+	HeapHandleCursor(HeapHandleCursor&& temp) = delete;
+	HeapHandleCursor& operator=(const HeapHandleCursor& other) = delete;
+	HeapHandleCursor& operator=(HeapHandleCursor&& temp) = delete;
+
+	virtual bool next(Handle &handle);
+	virtual void project(const std::vector<u_int32_t>* columns, Row* row);
+
+protected:
+	HeapFile &file;
+	BlockCursor* blocks;
+	PinnedPage pinned;
+	bool pinned_ok;
+	RecordID record_id;
+	const RowCodec* codec;
+	RowFilter filter;
+	const PaxLayout* layout;
+	PaxPage* pax;  // over the pinned block, when the file is PAX
+	std::vector<u_int64_t> selected;  // PAX: the pinned block's records that pass the filter, as a bitmask
+	virtual bool next_block();
+	RecordID next_selected(RecordID prev);
+};
+
+/**
+ * @class BatchStats - what the most recent HeapTable::insert_batch did
+ */
+struct BatchStats {
+	u_int32_t rows;
+	u_int32_t blocks_written;
+	double seconds;
+
+	BatchStats() : rows(0), blocks_written(0), seconds(0.0) {}
+	double rows_per_sec() const {return seconds > 0.0 ? rows / seconds : 0.0;}
+};
+
+/**
+ * @class StorageOptions - how a HeapTable lays out its file, chosen when the table is created
+ */
+struct StorageOptions {
+	u_int32_t block_sz;  // power of two, DbBlock::BLOCK_SZ to DbBlock::MAX_BLOCK_SZ
+	bool mmap;           // MmapHeapFile instead of a Berkeley DB RecNo file
+	u_int32_t extent;    // blocks the RecNo file grows by at a time
+	bool compress;       // RecNo file only: compress blocks on their way to disk
+	bool pax;            // PaxPage blocks (columns kept together) instead of SlottedPage
+	ColumnNames dictionary;  // TEXT columns to store as codes from the table's TextDictionary
+
+	StorageOptions() : block_sz(DbBlock::BLOCK_SZ), mmap(false), extent(HeapFile::DEFAULT_EXTENT), compress(false),
+		pax(false), dictionary() {}
 };
 
 /**
@@ -99,8 +464,9 @@ protected:
 
 class HeapTable : public DbRelation {
 public:
-	HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes );
-	virtual ~HeapTable() {}
+	HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+		const StorageOptions& options=StorageOptions());
+	virtual ~HeapTable();
 	HeapTable(const HeapTable& other) = delete;
 	HeapTable(HeapTable&& temp) = delete;
 	HeapTable& operator=(const HeapTable& other) = delete;
@@ -114,21 +480,101 @@ public:
 	virtual void close();
 
 	virtual Handle insert(const ValueDict* row);
+	virtual Handle insert(const Row* row);
+	virtual Handles* insert_batch(const ValueDicts* rows);
 	virtual void update(const Handle handle, const ValueDict* new_values);
 	virtual void del(const Handle handle);
 
 	virtual Handles* select();
 	virtual Handles* select(const ValueDict* where);
+	virtual HandleCursor* select_cursor();
+	virtual HandleCursor* select_cursor(const ValueDict* where);
+	virtual HandleCursor* select_cursor(const ValueDict* where, BlockID first, BlockID last);
 	virtual ValueDict* project(Handle handle);
 	virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
+	virtual void project(Handle handle, const ColumnNames* column_names, Row* row);
+
+	/**
+	 * Project the same columns from many rows. Each column is decoded straight from the
+	 * record's bytes, and a run of handles in one block is served from a single pin of it.
+	 * @param handles       rows to project, in the order the results should come back
+	 * @param column_names  columns wanted (nullptr for all of them)
+	 * @returns             one ValueDict per handle (freed by caller)
+	 * @throws              DbRelationError if a column isn't in the table
+	 */
+	virtual ValueDicts* project(const Handles* handles, const ColumnNames* column_names);
+	virtual ColumnBatch* project_many(const Handles& handles, const ColumnNames* column_names);
+
+	virtual u_int32_t get_block_count() {return file->get_last_block_id();}
+
+	/**
+	 * Add up the blocks' record counts: SlottedPage slot directories or PaxPage deleted flags,
+	 * with no record decoded.
+	 */
+	virtual u_int64_t count();
+
+	/**
+	 * Add rows after the table's last record, in order, so a scan reads them back in that order
+	 * (insert() may put a row into room left in an earlier block). For slotted pages only.
+	 * @param rows  rows to add, each with every column
+	 * @throws      DbRelationError for a PAX table
+	 */
+	virtual void append_rows(const Rows& rows);
+
+	/**
+	 * @returns  rows, blocks and timing for the last insert_batch call
+	 */
+	virtual const BatchStats& get_batch_stats() {return batch_stats;}
+
+	/**
+	 * @returns  page compression ratio and time since the table was opened (all zero if it isn't compressed)
+	 */
+	virtual const CompressionStats& get_compression_stats() {return file->get_compression_stats();}
+
+	/**
+	 * @returns  true if the table's blocks are PaxPages (known once it is open)
+	 */
+	virtual bool is_pax() {return pax;}
+
+	/**
+	 * @returns  the table's dictionary for its encoded TEXT columns (size 0 if it has none)
+	 */
+	virtual const TextDictionary& get_dictionary() {return dictionary;}
 
 protected:
-	HeapFile file;
+	HeapFile* file;
+	PinnedPage pinned;  // reused by project() so it doesn't allocate a block per row
+	BatchStats batch_stats;
+	TextDictionary dictionary;
+	std::vector<u_int32_t> encoded;   // columns StorageOptions::dictionary named, for create()
+	RowCodec codec;
+	Row staged;                       // a ValueDict being inserted, as a Row
+	ColumnNames projected_names;      // the last column_names project() into a Row was given, and their positions,
+	std::vector<u_int32_t> projected; // so a scan asking for the same ones row after row looks them up once
+	PaxLayout layout;
+	bool pax;
+	std::vector<char> record;         // a PAX row marshaled before it is scattered into its block
+	u_int64_t text_added;             // TEXT bytes and rows added, for sizing new PAX blocks
+	u_int64_t rows_added;
 	virtual ValueDict* validate(const ValueDict* row);
 	virtual Handle append(const ValueDict* row);
+	virtual Handle append(const Row& row);
+	virtual Handle append_pax(const Row& row);
+	virtual void insert_batch_pax(const Rows& rows, Handles* handles);
+	virtual u_int32_t largest_record();
+	virtual void configure_dictionary(bool persist);
+	virtual u_int32_t block_free_space(SlottedPage* page);
+	virtual ValueDict* unmarshal_pinned(RecordID record_id, const std::vector<u_int32_t>* columns);
 	virtual Dbt* marshal(const ValueDict* row);
+	virtual uint marshal_size(const ValueDict* row);
+	virtual void marshal_into(const ValueDict* row, char* bytes);
 	virtual ValueDict* unmarshal(Dbt* data);
+	virtual ValueDict* unmarshal(const RecordView &data);
+	virtual ValueDict* unmarshal(const RecordView &data, const std::vector<u_int32_t> &columns);
+	virtual std::vector<u_int32_t> column_positions(const ColumnNames* column_names);
+	virtual std::string dictionary_path();
 };
 
 bool test_heap_storage();
+void bench_heap_storage();
 
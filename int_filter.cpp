@@ -0,0 +1,201 @@
+/**
+ * @file int_filter.cpp - implementation of the INT predicate kernels.
+ * IntFilter
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "int_filter.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define INT_FILTER_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const u_int32_t WORD_BITS = 64;
+
+typedef void (*Kernel)(const int32_t* values, u_int32_t n, int32_t lo, int32_t hi, u_int64_t* mask);
+
+static inline bool passes(int op, int32_t value, int32_t lo, int32_t hi) {
+	switch (op) {
+	case IntPredicate::EQ:
+		return value == lo;
+	case IntPredicate::LT:
+		return value < lo;
+	case IntPredicate::GT:
+		return value > lo;
+	default:
+		return value >= lo && value <= hi;
+	}
+}
+
+//Values from start to n a bit at a time, the last word zero-filled past n
+static inline void scalar_from(int op, const int32_t* values, u_int32_t start, u_int32_t n, int32_t lo, int32_t hi,
+		u_int64_t* mask) {
+	for (u_int32_t w = start / WORD_BITS; w * WORD_BITS < n; w++) {
+		u_int64_t bits = 0;
+		u_int32_t end = (w + 1) * WORD_BITS < n ? (w + 1) * WORD_BITS : n;
+		for (u_int32_t i = w * WORD_BITS; i < end; i++)
+			bits |= (u_int64_t)passes(op, values[i], lo, hi) << (i % WORD_BITS);
+		mask[w] = bits;
+	}
+}
+
+template <int OP>
+static void scalar_kernel(const int32_t* values, u_int32_t n, int32_t lo, int32_t hi, u_int64_t* mask) {
+	scalar_from(OP, values, 0, n, lo, hi, mask);
+}
+
+
+#ifdef INT_FILTER_X86
+
+//SSE2 has the 32-bit compares; the tier is keyed on SSE4.2 so it lines up with what we detect
+template <int OP>
+__attribute__((target("sse4.2")))
+static inline u_int32_t sse_bits(__m128i v, __m128i lo, __m128i hi) {
+	__m128i hit;
+	switch (OP) {
+	case IntPredicate::EQ:
+		hit = _mm_cmpeq_epi32(v, lo);
+		break;
+	case IntPredicate::LT:
+		hit = _mm_cmpgt_epi32(lo, v);
+		break;
+	case IntPredicate::GT:
+		hit = _mm_cmpgt_epi32(v, lo);
+		break;
+	default:  // outside on either side, then flipped
+		hit = _mm_or_si128(_mm_cmpgt_epi32(lo, v), _mm_cmpgt_epi32(v, hi));
+		return ~(u_int32_t)_mm_movemask_ps(_mm_castsi128_ps(hit)) & 0xf;
+	}
+	return (u_int32_t)_mm_movemask_ps(_mm_castsi128_ps(hit));
+}
+
+template <int OP>
+__attribute__((target("sse4.2")))
+static void sse42_kernel(const int32_t* values, u_int32_t n, int32_t lo, int32_t hi, u_int64_t* mask) {
+	const __m128i vlo = _mm_set1_epi32(lo);
+	const __m128i vhi = _mm_set1_epi32(hi);
+	u_int32_t full = n / WORD_BITS;
+	for (u_int32_t w = 0; w < full; w++) {
+		const int32_t* word = values + w * WORD_BITS;
+		u_int64_t bits = 0;
+		for (u_int32_t j = 0; j < WORD_BITS; j += 4)
+			bits |= (u_int64_t)sse_bits<OP>(_mm_loadu_si128((const __m128i*)(word + j)), vlo, vhi) << j;
+		mask[w] = bits;
+	}
+	scalar_from(OP, values, full * WORD_BITS, n, lo, hi, mask);
+}
+
+template <int OP>
+__attribute__((target("avx2")))
+static inline u_int32_t avx2_bits(__m256i v, __m256i lo, __m256i hi) {
+	__m256i hit;
+	switch (OP) {
+	case IntPredicate::EQ:
+		hit = _mm256_cmpeq_epi32(v, lo);
+		break;
+	case IntPredicate::LT:
+		hit = _mm256_cmpgt_epi32(lo, v);
+		break;
+	case IntPredicate::GT:
+		hit = _mm256_cmpgt_epi32(v, lo);
+		break;
+	default:
+		hit = _mm256_or_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(v, hi));
+		return ~(u_int32_t)_mm256_movemask_ps(_mm256_castsi256_ps(hit)) & 0xff;
+	}
+	return (u_int32_t)_mm256_movemask_ps(_mm256_castsi256_ps(hit));
+}
+
+template <int OP>
+__attribute__((target("avx2")))
+static void avx2_kernel(const int32_t* values, u_int32_t n, int32_t lo, int32_t hi, u_int64_t* mask) {
+	const __m256i vlo = _mm256_set1_epi32(lo);
+	const __m256i vhi = _mm256_set1_epi32(hi);
+	u_int32_t full = n / WORD_BITS;
+	for (u_int32_t w = 0; w < full; w++) {
+		const int32_t* word = values + w * WORD_BITS;
+		u_int64_t bits = 0;
+		for (u_int32_t j = 0; j < WORD_BITS; j += 8)
+			bits |= (u_int64_t)avx2_bits<OP>(_mm256_loadu_si256((const __m256i*)(word + j)), vlo, vhi) << j;
+		mask[w] = bits;
+	}
+	scalar_from(OP, values, full * WORD_BITS, n, lo, hi, mask);
+}
+
+//CPUID for the instructions, XGETBV for whether the OS saves the YMM registers
+static IntFilter::Isa detect_isa() {
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return IntFilter::SCALAR;
+	bool sse42 = (ecx & bit_SSE4_2) != 0;
+	if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX) && __get_cpuid_max(0, nullptr) >= 7) {
+		unsigned int xcr0_lo, xcr0_hi;
+		__asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if ((xcr0_lo & 6) == 6 && (ebx & bit_AVX2))
+			return IntFilter::AVX2;
+	}
+	return sse42 ? IntFilter::SSE42 : IntFilter::SCALAR;
+}
+
+#else
+
+static IntFilter::Isa detect_isa() {
+	return IntFilter::SCALAR;
+}
+
+#endif
+
+
+/**************************IntFilter Implementation*********************/
+
+IntFilter::Isa IntFilter::best_isa() {
+	static const Isa best = detect_isa();
+	return best;
+}
+
+const char* IntFilter::isa_name(Isa isa) {
+	switch (isa) {
+	case AVX2:
+		return "avx2";
+	case SSE42:
+		return "sse4.2";
+	default:
+		return "scalar";
+	}
+}
+
+//One kernel per (instruction set, op), so the op's branch is compiled out of the inner loop
+void IntFilter::evaluate(const IntPredicate& predicate, const int32_t* values, u_int32_t n, u_int64_t* mask,
+		Isa isa) {
+	static const Kernel scalar[] = {scalar_kernel<IntPredicate::EQ>, scalar_kernel<IntPredicate::LT>,
+		scalar_kernel<IntPredicate::GT>, scalar_kernel<IntPredicate::BETWEEN>};
+	const Kernel* kernels = scalar;
+#ifdef INT_FILTER_X86
+	static const Kernel sse42[] = {sse42_kernel<IntPredicate::EQ>, sse42_kernel<IntPredicate::LT>,
+		sse42_kernel<IntPredicate::GT>, sse42_kernel<IntPredicate::BETWEEN>};
+	static const Kernel avx2[] = {avx2_kernel<IntPredicate::EQ>, avx2_kernel<IntPredicate::LT>,
+		avx2_kernel<IntPredicate::GT>, avx2_kernel<IntPredicate::BETWEEN>};
+	if (isa > best_isa())
+		isa = best_isa();
+	if (isa == AVX2)
+		kernels = avx2;
+	else if (isa == SSE42)
+		kernels = sse42;
+#endif
+	kernels[predicate.op](values, n, predicate.lo, predicate.hi, mask);
+}
+
+void IntFilter::intersect(u_int64_t* mask, const u_int64_t* other, u_int32_t n) {
+	for (u_int32_t w = 0; w < mask_words(n); w++)
+		mask[w] &= other[w];
+}
+
+u_int32_t IntFilter::count(const u_int64_t* mask, u_int32_t n) {
+	u_int32_t total = 0;
+	for (u_int32_t w = 0; w < mask_words(n); w++)
+		total += (u_int32_t)__builtin_popcountll(mask[w]);
+	return total;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file int_filter.h - Vectorized predicates over runs of int32_t column values.
+ * IntPredicate
+ * IntFilter
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <stdint.h>
+
+/**
+ * @class IntPredicate - one test on an INT column's values
+ *
+ * EQ, LT and GT compare against lo; BETWEEN is lo <= value <= hi, as in SQL.
+ */
+struct IntPredicate {
+	enum Op {
+		EQ,
+		LT,
+		GT,
+		BETWEEN
+	};
+	Op op;
+	int32_t lo;
+	int32_t hi;
+
+	IntPredicate(Op op, int32_t lo, int32_t hi=0) : op(op), lo(lo), hi(hi) {}
+};
+
+/**
+ * @class IntFilter - kernels that test a run of INT values (a PaxPage minipage, or any batch)
+ *
+ * Results come back as a selection bitmask: bit i % 64 of word i / 64 is set if values[i]
+ * passes, and the bits past n in the last word are clear. There is a kernel per Isa; the best
+ * one the CPU has is found once with CPUID, and evaluate() uses it unless told otherwise.
+ */
+class IntFilter {
+public:
+	enum Isa {
+		SCALAR,
+		SSE42,
+		AVX2
+	};
+
+	/**
+	 * @returns  the widest instruction set this CPU (and OS) supports
+	 */
+	static Isa best_isa();
+
+	/**
+	 * @param isa  an instruction set
+	 * @returns    its name, for reports
+	 */
+	static const char* isa_name(Isa isa);
+
+	/**
+	 * @param n  number of values
+	 * @returns  number of 64-bit words in their mask
+	 */
+	static u_int32_t mask_words(u_int32_t n) {return (n + 63) / 64;}
+
+	/**
+	 * Test values[0..n) and write the mask.
+	 * @param predicate  the test
+	 * @param values     the values (no alignment needed)
+	 * @param n          how many
+	 * @param mask       room for mask_words(n) words, all of them overwritten
+	 * @param isa        which kernel to use (anything past best_isa() falls back to it)
+	 */
+	static void evaluate(const IntPredicate& predicate, const int32_t* values, u_int32_t n, u_int64_t* mask,
+		Isa isa);
+	static void evaluate(const IntPredicate& predicate, const int32_t* values, u_int32_t n, u_int64_t* mask) {
+		evaluate(predicate, values, n, mask, best_isa());
+	}
+
+	/**
+	 * mask &= other, over the words for n values.
+	 */
+	static void intersect(u_int64_t* mask, const u_int64_t* other, u_int32_t n);
+
+	/**
+	 * @returns  how many of the n values have their bit set
+	 */
+	static u_int32_t count(const u_int64_t* mask, u_int32_t n);
+};
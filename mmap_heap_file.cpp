@@ -0,0 +1,184 @@
+/**
+ * @file mmap_heap_file.cpp - implementation of the memory-mapped heap file.
+ * MmapHeapFile: HeapFile
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "mmap_heap_file.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "buffer_pool.h"
+using namespace std;
+
+static const u_int32_t MIN_CAPACITY = 16;  // blocks mapped for a brand new file
+
+
+/**************************MmapHeapFile Implementation*********************/
+
+MmapHeapFile::MmapHeapFile(string name, u_int32_t block_sz)
+	: HeapFile(name, block_sz), path(""), fd(-1), map(nullptr), capacity(0) {}
+
+MmapHeapFile::~MmapHeapFile() {
+	close();
+}
+
+//Open the flat file (creating it with DB_CREATE) and map it; the header says the block size
+void MmapHeapFile::db_open(uint flags) {
+	if (!this->closed)
+		return;
+
+	const char* home = nullptr;
+	_DB_ENV->get_home(&home);
+	this->path = string(home) + "/" + this->name + ".mmap";
+	int oflags = O_RDWR;
+	if (flags & DB_CREATE)
+		oflags |= O_CREAT;
+	if (flags & DB_EXCL)
+		oflags |= O_EXCL;
+	this->fd = ::open(this->path.c_str(), oflags, 0644);
+	if (this->fd < 0)
+		throw DbException(("cannot open " + this->path).c_str(), errno);
+
+	if (flags & DB_CREATE) {
+		this->last = 0;
+		map_file(MIN_CAPACITY);
+		save_header();
+	}
+	else {
+		Header header;
+		struct stat st;
+		if (pread(this->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || header.magic != MAGIC
+				|| !DbBlock::valid_block_size(header.block_sz) || fstat(this->fd, &st) != 0) {
+			::close(this->fd);
+			this->fd = -1;
+			throw DbException(("not a heap file: " + this->path).c_str(), EINVAL);
+		}
+		this->block_sz = header.block_sz;
+		this->last = header.last;
+		map_file((u_int32_t)(st.st_size / this->block_sz) - 1);
+	}
+	this->closed = false;
+
+	if (flags & DB_CREATE)
+		this->fsm.create(fsm_path(), this->block_sz);
+	else if (!this->fsm.load(fsm_path(), this->block_sz) || this->fsm.size() != this->last)
+		rebuild_fsm();
+}
+
+//Write back our cached blocks and the free-space map, then flush and unmap
+void MmapHeapFile::close(void) {
+	BufferPool::instance().release(this);
+	if (this->closed)
+		return;
+	this->fsm.save();
+	save_header();
+	sync();
+	unmap_file();
+	::close(this->fd);
+	this->fd = -1;
+	this->closed = true;
+}
+
+void MmapHeapFile::drop(void) {
+	close();
+	unlink(this->path.c_str());
+	this->fsm.drop();
+}
+
+void MmapHeapFile::sync() {
+	if (this->map != nullptr)
+		msync(this->map, (size_t)(this->capacity + 1) * this->block_sz, MS_SYNC);
+}
+
+//Block in place in the mapping (valid until the file grows)
+SlottedPage* MmapHeapFile::get(BlockID block_id) {
+	BufferPool::instance().flush(this, block_id); // so we don't read an out-of-date copy
+	Dbt data(address(block_id), this->block_sz);
+	return new SlottedPage(data, block_id, false);
+}
+
+//Append an empty block, initialized right in the mapping
+SlottedPage* MmapHeapFile::get_new(void) {
+	BlockID block_id = this->last + 1;
+	extend(block_id);
+	memset(address(block_id), 0, this->block_sz);
+	Dbt data(address(block_id), this->block_sz);
+	SlottedPage* page = new SlottedPage(data, block_id, true);
+	this->last = block_id;
+	save_header();
+	this->fsm.update(block_id, page->free_space());
+	return page;
+}
+
+void MmapHeapFile::put(DbBlock* block) {
+	u_int32_t was_last = this->last;
+	HeapFile::put(block);
+	if (this->last != was_last)
+		save_header();
+}
+
+//Scans read the file front to back, so have the kernel read ahead and drop pages behind us
+BlockCursor* MmapHeapFile::block_cursor() {
+	if (this->map != nullptr && this->last > 0) {
+		size_t length = (size_t)(this->last + 1) * this->block_sz;
+		madvise(this->map, length, MADV_SEQUENTIAL);
+		madvise(this->map, length, MADV_WILLNEED);
+	}
+	return HeapFile::block_cursor();
+}
+
+//Copy a block out of the mapping (for the buffer pool)
+void MmapHeapFile::read(BlockID block_id, Dbt &data) {
+	if (block_id > this->capacity)
+		memset(data.get_data(), 0, this->block_sz);
+	else
+		memcpy(data.get_data(), address(block_id), this->block_sz);
+}
+
+//Copy a block into the mapping (for the buffer pool), growing the file when it is appended
+void MmapHeapFile::write(DbBlock* block) {
+	BlockID block_id = block->get_block_id();
+	extend(block_id);
+	char* to = address(block_id);
+	if (block->get_data() != to) // pages from get() are already in place
+		memcpy(to, block->get_data(), this->block_sz);
+}
+
+//Make sure the file and mapping reach block_id, doubling so appends remap only now and then
+void MmapHeapFile::extend(BlockID block_id) {
+	if (block_id <= this->capacity)
+		return;
+	u_int32_t blocks = this->capacity * 2;
+	if (blocks < block_id)
+		blocks = block_id;
+	unmap_file();
+	map_file(blocks);
+}
+
+//Size the file for the header plus the given number of blocks and map all of it
+void MmapHeapFile::map_file(u_int32_t blocks) {
+	size_t length = (size_t)(blocks + 1) * this->block_sz;
+	if (ftruncate(this->fd, (off_t)length) != 0)
+		throw DbException(("cannot extend " + this->path).c_str(), errno);
+	void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+	if (addr == MAP_FAILED)
+		throw DbException(("cannot map " + this->path).c_str(), errno);
+	this->map = (char*)addr;
+	this->capacity = blocks;
+}
+
+void MmapHeapFile::unmap_file() {
+	if (this->map != nullptr)
+		munmap(this->map, (size_t)(this->capacity + 1) * this->block_sz);
+	this->map = nullptr;
+	this->capacity = 0;
+}
+
+void MmapHeapFile::save_header() {
+	Header header = {MAGIC, this->block_sz, this->last};
+	memcpy(this->map, &header, sizeof(header));
+}
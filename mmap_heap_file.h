@@ -0,0 +1,70 @@
+/**
+ * @file mmap_heap_file.h - HeapFile kept in a flat, memory-mapped file instead of a Berkeley DB RecNo file.
+ * MmapHeapFile: HeapFile
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <string>
+#include "db_cxx.h"
+#include "heap_storage.h"
+
+/**
+ * @class MmapHeapFile - blocks stored back to back in one plain file, block n at offset n * block size
+ *
+ * The file is mapped into memory, so reading or writing a block is a memcpy and the kernel's
+ * page cache does the I/O. Block 0's spot holds a small header (block size and last block),
+ * which is how an existing file's block size is found without being told.
+ *
+ * Everything above the block level is inherited from HeapFile: slotted pages, the free-space
+ * map and going through the buffer pool for pin()/pin_new()/put().
+ *
+ * Errors opening, growing or mapping the file throw DbException, as the Berkeley DB file would.
+ * Pages from get() and get_new() point straight into the mapping and are only good until the
+ * file next grows or is closed.
+ */
+class MmapHeapFile : public HeapFile {
+public:
+	static const u_int32_t MAGIC = 0x4d6d4850;  // "PHmM"
+
+	MmapHeapFile(std::string name, u_int32_t block_sz=DbBlock::BLOCK_SZ);
+	virtual ~MmapHeapFile();
+	MmapHeapFile(const MmapHeapFile& other) = delete;
+	MmapHeapFile(MmapHeapFile&& temp) = delete;
+	MmapHeapFile& operator=(const MmapHeapFile& other) = delete;
+	MmapHeapFile& operator=(MmapHeapFile&& temp) = delete;
+
+	virtual void drop(void);
+	virtual void close(void);
+	virtual SlottedPage* get_new(void);
+	virtual SlottedPage* get(BlockID block_id);
+	virtual void put(DbBlock* block);
+	virtual BlockCursor* block_cursor();
+
+	/**
+	 * Flush the mapping to disk (msync). close() does this too.
+	 */
+	virtual void sync();
+
+protected:
+	struct Header {
+		u_int32_t magic;
+		u_int32_t block_sz;
+		u_int32_t last;
+	};
+
+	std::string path;
+	int fd;
+	char* map;
+	u_int32_t capacity;  // blocks the mapping has room for, not counting the header block
+
+	virtual void db_open(uint flags=0);
+	virtual void read(BlockID block_id, Dbt &data);
+	virtual void write(DbBlock* block);
+	virtual void extend(BlockID block_id);
+	virtual void map_file(u_int32_t blocks);
+	virtual void unmap_file();
+	virtual void save_header();
+	char* address(BlockID block_id) {return map + (size_t)block_id * block_sz;}
+};
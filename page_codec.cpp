@@ -0,0 +1,126 @@
+/**
+ * @file page_codec.cpp - implementation of the block compressor.
+ * PageCodec
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "page_codec.h"
+#include <cstring>
+using namespace std;
+
+static const u_int32_t MIN_MATCH = 4;
+static const u_int32_t LAST_LITERALS = 5;  // input tail always goes out as literals
+static const u_int32_t MAX_OFFSET = 65535;
+static const u_int32_t HASH_BITS = 12;
+
+static u_int32_t read32(const char* p) {
+	u_int32_t n;
+	memcpy(&n, p, sizeof(n));
+	return n;
+}
+
+static u_int32_t hash32(u_int32_t sequence) {
+	return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+//Lengths of 15 and up continue in bytes of 255 until one that is less
+static char* put_length(char* out, u_int32_t length) {
+	while (length >= 255) {
+		*out++ = (char)255;
+		length -= 255;
+	}
+	*out++ = (char)length;
+	return out;
+}
+
+static char* put_sequence(char* out, const char* literals, u_int32_t literal_len, u_int32_t offset,
+		u_int32_t match_len) {
+	char* token = out++;
+	u_int32_t match_code = match_len == 0 ? 0 : match_len - MIN_MATCH;
+	*token = (char)(((literal_len < 15 ? literal_len : 15) << 4) | (match_code < 15 ? match_code : 15));
+	if (literal_len >= 15)
+		out = put_length(out, literal_len - 15);
+	memcpy(out, literals, literal_len);
+	out += literal_len;
+	if (match_len == 0)
+		return out;
+	*out++ = (char)(offset & 0xff);
+	*out++ = (char)(offset >> 8);
+	if (match_code >= 15)
+		out = put_length(out, match_code - 15);
+	return out;
+}
+
+//Greedy: look each 4-byte sequence up in a hash of where it was last seen and take the match if it's real
+u_int32_t PageCodec::compress(const char* in, u_int32_t size, char* out) {
+	u_int32_t table[1 << HASH_BITS] = {0};  // position + 1 of the last sequence with this hash
+	char* start = out;
+	u_int32_t anchor = 0;
+	u_int32_t ip = 0;
+	u_int32_t limit = size > LAST_LITERALS + MIN_MATCH ? size - LAST_LITERALS : 0;
+
+	while (ip + MIN_MATCH <= limit) {
+		u_int32_t sequence = read32(in + ip);
+		u_int32_t h = hash32(sequence);
+		u_int32_t ref = table[h];
+		table[h] = ip + 1;
+		if (ref == 0 || ip - (ref - 1) > MAX_OFFSET || read32(in + ref - 1) != sequence) {
+			ip++;
+			continue;
+		}
+		ref--;
+		u_int32_t match_len = MIN_MATCH;
+		while (ip + match_len < limit && in[ref + match_len] == in[ip + match_len])
+			match_len++;
+		out = put_sequence(out, in + anchor, ip - anchor, ip - ref, match_len);
+		ip += match_len;
+		anchor = ip;
+	}
+	out = put_sequence(out, in + anchor, size - anchor, 0, 0);
+	return (u_int32_t)(out - start);
+}
+
+static u_int32_t get_length(const char* in, u_int32_t packed, u_int32_t &ip) {
+	u_int32_t length = 0;
+	u_int8_t b;
+	do {
+		if (ip >= packed)
+			throw PageCodecError("compressed page is truncated");
+		b = (u_int8_t)in[ip++];
+		length += b;
+	} while (b == 255);
+	return length;
+}
+
+void PageCodec::decompress(const char* in, u_int32_t packed, char* out, u_int32_t size) {
+	u_int32_t ip = 0;
+	u_int32_t op = 0;
+	while (ip < packed) {
+		u_int8_t token = (u_int8_t)in[ip++];
+		u_int32_t literal_len = token >> 4;
+		if (literal_len == 15)
+			literal_len += get_length(in, packed, ip);
+		if (literal_len > packed - ip || literal_len > size - op)
+			throw PageCodecError("compressed page overruns its literals");
+		memcpy(out + op, in + ip, literal_len);
+		ip += literal_len;
+		op += literal_len;
+		if (ip == packed)
+			break;
+
+		if (packed - ip < 2)
+			throw PageCodecError("compressed page is truncated");
+		u_int32_t offset = (u_int8_t)in[ip] | ((u_int32_t)(u_int8_t)in[ip + 1] << 8);
+		ip += 2;
+		u_int32_t match_len = token & 15;
+		if (match_len == 15)
+			match_len += get_length(in, packed, ip);
+		match_len += MIN_MATCH;
+		if (offset == 0 || offset > op || match_len > size - op)
+			throw PageCodecError("compressed page has a bad match");
+		for (u_int32_t i = 0; i < match_len; i++, op++)  // may overlap itself, so byte by byte
+			out[op] = out[op - offset];
+	}
+	if (op != size)
+		throw PageCodecError("compressed page is the wrong size");
+}
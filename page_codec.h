@@ -0,0 +1,55 @@
+/**
+ * @file page_codec.h - Byte-oriented LZ77 codec for compressing blocks on their way to disk.
+ * PageCodecError
+ * PageCodec
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <stdexcept>
+#include "db_cxx.h"
+
+/**
+ * @class PageCodecError - compressed data that doesn't decode to the expected size
+ */
+class PageCodecError : public std::runtime_error {
+public:
+	explicit PageCodecError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class PageCodec - LZ4-style compressor, tuned for speed over ratio
+ *
+ * The output is a run of sequences, each a token byte (literal count in the high nibble,
+ * match length - 4 in the low one, 15 meaning more length bytes follow), the literals, then
+ * a 2-byte little-endian offset back to the match. The last sequence is literals only.
+ * Slotted pages, with their zero-filled free space and repeated column values, shrink a lot.
+ */
+class PageCodec {
+public:
+	/**
+	 * @param size  bytes to be compressed
+	 * @returns     the most compress() can write for them (incompressible input)
+	 */
+	static u_int32_t max_packed_size(u_int32_t size) {return size + size / 255 + 16;}
+
+	/**
+	 * Compress a buffer.
+	 * @param in    bytes to compress
+	 * @param size  how many
+	 * @param out   room for at least max_packed_size(size) bytes
+	 * @returns     compressed size
+	 */
+	static u_int32_t compress(const char* in, u_int32_t size, char* out);
+
+	/**
+	 * Decompress a buffer made by compress().
+	 * @param in      compressed bytes
+	 * @param packed  how many
+	 * @param out     room for the original size bytes
+	 * @param size    original size
+	 * @throws        PageCodecError if the input is damaged or doesn't come out to size bytes
+	 */
+	static void decompress(const char* in, u_int32_t packed, char* out, u_int32_t size);
+};
@@ -0,0 +1,273 @@
+/**
+ * @file pax_page.cpp - implementation of the PAX block layout.
+ * PaxLayout
+ * PaxPage: DbBlock
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "pax_page.h"
+#include <cstring>
+#include <algorithm>
+using namespace std;
+
+static const u_int32_t INT_WIDTH = sizeof(int32_t);
+static const u_int32_t TEXT_WIDTH = 2 * sizeof(u_int32_t);  // offset and size in the heap
+static const u_int32_t GUESS_TEXT = 16;                      // per TEXT column, before we know better
+
+static u_int32_t get_u32(const char* p) {
+	u_int32_t n;
+	memcpy(&n, p, sizeof(n));
+	return n;
+}
+
+static void put_u32(char* p, u_int32_t n) {
+	memcpy(p, &n, sizeof(n));
+}
+
+
+/**************************PaxLayout Implementation*********************/
+
+PaxLayout::PaxLayout(const RowCodec& codec) : types(), prefix(), row_width(0) {
+	for (u_int32_t column = 0; column < codec.get_num_columns(); column++) {
+		this->types.push_back(codec.get_stored_type(column));
+		this->prefix.push_back(this->row_width);
+		this->row_width += this->types.back() == ColumnAttribute::INT ? INT_WIDTH : TEXT_WIDTH;
+	}
+	this->row_width += 1;  // deleted flag
+}
+
+
+/**************************PaxPage Implementation*********************/
+
+bool PaxPage::is_pax(const void* bytes) {
+	return get_u32((const char*)bytes) == MAGIC;
+}
+
+PaxPage::PaxPage(Dbt &block, BlockID block_id, const RowCodec &codec, const PaxLayout &layout, bool is_new)
+	: DbBlock(block, block_id, is_new), codec(codec), layout(layout), num_records(0), capacity(0), heap_start(0),
+	  expected_text(0), gathered(), columns() {
+	for (ColumnAttribute::DataType type : layout.types)
+		if (type == ColumnAttribute::TEXT)
+			this->expected_text += GUESS_TEXT;
+	if (is_new)
+		initialize_new();
+	else
+		load(block, block_id);
+}
+
+//Unformatted until the first add()
+void PaxPage::initialize_new() {
+	memset(block.get_data(), 0, sizeof(u_int32_t));
+	this->num_records = this->capacity = this->heap_start = 0;
+}
+
+void PaxPage::load(Dbt &block, BlockID block_id) {
+	this->block = block;
+	this->block_id = block_id;
+	if (is_pax(block.get_data())) {
+		this->num_records = get_u32(address(sizeof(u_int32_t)));
+		this->capacity = get_u32(address(2 * sizeof(u_int32_t)));
+		this->heap_start = get_u32(address(3 * sizeof(u_int32_t)));
+	}
+	else {
+		this->num_records = this->capacity = this->heap_start = 0;
+	}
+}
+
+//Split what's left after the header between minipages and heap by the expected record shape,
+//leaving heap enough for text even if that's more than expected
+void PaxPage::format(u_int32_t text) {
+	u_int32_t room = block_size() - HEADER_SZ;
+	this->capacity = room / (this->layout.row_width + this->expected_text);
+	if (text < room)
+		this->capacity = min(this->capacity, (room - text) / this->layout.row_width);
+	if (this->capacity == 0)
+		this->capacity = 1;
+	this->num_records = 0;
+	this->heap_start = block_size();
+	put_header();
+}
+
+void PaxPage::put_header() {
+	put_u32(address(0), MAGIC);
+	put_u32(address(sizeof(u_int32_t)), this->num_records);
+	put_u32(address(2 * sizeof(u_int32_t)), this->capacity);
+	put_u32(address(3 * sizeof(u_int32_t)), this->heap_start);
+}
+
+//Scatter the record's columns into the minipages and its TEXT bytes onto the heap
+RecordID PaxPage::add(const Dbt* data) throw(DbBlockNoRoomError) {
+	RecordView record((const char*)data->get_data(), data->get_size());
+	u_int32_t text = text_size(record);
+	if (this->capacity == 0)
+		format(text);
+	if (this->num_records == this->capacity || this->heap_start < minipage_end() + text)
+		throw DbBlockNoRoomError("not enough room for new record");
+
+	RecordID record_id = ++this->num_records;
+	u_int32_t i = record_id - 1;
+	split(record);
+	for (u_int32_t column = 0; column < this->columns.size(); column++) {
+		const RecordView &value = this->columns[column];
+		if (this->layout.types[column] == ColumnAttribute::INT) {
+			memcpy(address(minipage(column) + i * INT_WIDTH), value.data, INT_WIDTH);
+		}
+		else {
+			this->heap_start -= value.size;
+			memcpy(address(this->heap_start), value.data, value.size);
+			put_u32(address(minipage(column) + i * TEXT_WIDTH), this->heap_start);
+			put_u32(address(minipage(column) + i * TEXT_WIDTH + sizeof(u_int32_t)), value.size);
+		}
+	}
+	deleted_flags()[i] = 0;
+	put_header();
+	return record_id;
+}
+
+//Gather the columns back into a RowCodec record
+Dbt* PaxPage::get(RecordID record_id) {
+	if (record_id == 0 || record_id > this->num_records || is_deleted(record_id))
+		return nullptr;
+	this->columns.clear();
+	for (u_int32_t column = 0; column < this->layout.types.size(); column++)
+		this->columns.push_back(column_bytes(record_id, column));
+	this->gathered.resize(this->codec.columns_size(this->columns.data()));
+	this->codec.encode_columns(this->columns.data(), this->gathered.data());
+	return new Dbt(this->gathered.data(), (u_int32_t)this->gathered.size());
+}
+
+//TEXT values that got longer move to new heap space (the old bytes are wasted until the block is rebuilt)
+void PaxPage::put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError) {
+	RecordView record((const char*)data.get_data(), data.get_size());
+	u_int32_t i = record_id - 1;
+	split(record);
+	u_int32_t grow = 0;
+	for (u_int32_t column = 0; column < this->columns.size(); column++)
+		if (this->layout.types[column] == ColumnAttribute::TEXT && this->columns[column].size > column_bytes(record_id, column).size)
+			grow += this->columns[column].size;
+	if (this->heap_start < minipage_end() + grow)
+		throw DbBlockNoRoomError("not enough room for enlarged record");
+
+	for (u_int32_t column = 0; column < this->columns.size(); column++) {
+		const RecordView &value = this->columns[column];
+		if (this->layout.types[column] == ColumnAttribute::INT) {
+			memcpy(address(minipage(column) + i * INT_WIDTH), value.data, INT_WIDTH);
+			continue;
+		}
+		char* entry = address(minipage(column) + i * TEXT_WIDTH);
+		u_int32_t offset = get_u32(entry);
+		if (value.size > get_u32(entry + sizeof(u_int32_t))) {
+			this->heap_start -= value.size;
+			offset = this->heap_start;
+		}
+		memmove(address(offset), value.data, value.size);
+		put_u32(entry, offset);
+		put_u32(entry + sizeof(u_int32_t), value.size);
+	}
+	put_header();
+}
+
+void PaxPage::del(RecordID record_id) {
+	if (record_id != 0 && record_id <= this->num_records)
+		deleted_flags()[record_id - 1] = 1;
+}
+
+RecordIDs* PaxPage::ids() {
+	RecordIDs* record_ids = new RecordIDs();
+	for (RecordID record_id = next_id(); record_id != 0; record_id = next_id(record_id))
+		record_ids->push_back(record_id);
+	return record_ids;
+}
+
+RecordID PaxPage::next_id(RecordID prev) {
+	for (RecordID record_id = prev + 1; record_id <= this->num_records; record_id++)
+		if (!is_deleted(record_id))
+			return record_id;
+	return 0;
+}
+
+//In RowCodec record terms: the fixed part always fits if there's a free slot, the TEXT needs heap
+u_int32_t PaxPage::free_space() {
+	if (this->capacity == 0)
+		return block_size() - HEADER_SZ - this->layout.row_width + this->codec.get_fixed_size();
+	if (this->num_records == this->capacity)
+		return 0;
+	return this->heap_start - minipage_end() + this->codec.get_fixed_size();
+}
+
+bool PaxPage::is_deleted(RecordID record_id) {
+	return deleted_flags()[record_id - 1] != 0;
+}
+
+RecordView PaxPage::column_bytes(RecordID record_id, u_int32_t column) {
+	u_int32_t i = record_id - 1;
+	if (this->layout.types[column] == ColumnAttribute::INT)
+		return RecordView(address(minipage(column) + i * INT_WIDTH), INT_WIDTH);
+	const char* entry = address(minipage(column) + i * TEXT_WIDTH);
+	return RecordView(address(get_u32(entry)), get_u32(entry + sizeof(u_int32_t)));
+}
+
+u_int32_t PaxPage::count_records() {
+	const u_int8_t* flags = deleted_flags();
+	u_int32_t count = 0;
+	for (u_int32_t i = 0; i < this->num_records; i++)
+		count += flags[i] == 0;
+	return count;
+}
+
+const int32_t* PaxPage::int_column(u_int32_t column) {
+	return (const int32_t*)address(minipage(column));
+}
+
+bool PaxPage::matches(RecordID record_id, const RowFilter& filter) {
+	for (auto const& equals : filter) {
+		RecordView bytes = column_bytes(record_id, equals.column);
+		if (bytes.size != equals.bytes.size() || memcmp(bytes.data, equals.bytes.data(), bytes.size) != 0)
+			return false;
+	}
+	return true;
+}
+
+void PaxPage::select(const RowFilter& filter, std::vector<u_int64_t>& mask) {
+	u_int32_t n = this->num_records;
+	mask.assign(IntFilter::mask_words(n), 0);
+	const u_int8_t* deleted = deleted_flags();
+	for (u_int32_t i = 0; i < n; i++)
+		mask[i / 64] |= (u_int64_t)(deleted[i] == 0) << (i % 64);
+
+	vector<u_int64_t> hits(mask.size());
+	for (auto const& equals : filter) {
+		if (this->layout.types[equals.column] != ColumnAttribute::INT)
+			continue;
+		int32_t value;
+		memcpy(&value, equals.bytes.data(), sizeof(value));
+		IntFilter::evaluate(IntPredicate(IntPredicate::EQ, value), int_column(equals.column), n, hits.data());
+		IntFilter::intersect(mask.data(), hits.data(), n);
+	}
+	for (auto const& equals : filter) {
+		if (this->layout.types[equals.column] != ColumnAttribute::TEXT)
+			continue;
+		for (u_int32_t i = 0; i < n; i++) {
+			if ((mask[i / 64] >> (i % 64) & 1) == 0)
+				continue;
+			RecordView bytes = column_bytes(i + 1, equals.column);
+			if (bytes.size != equals.bytes.size() || memcmp(bytes.data, equals.bytes.data(), bytes.size) != 0)
+				mask[i / 64] &= ~((u_int64_t)1 << (i % 64));
+		}
+	}
+}
+
+u_int8_t* PaxPage::deleted_flags() {
+	return (u_int8_t*)address(HEADER_SZ + this->capacity * (this->layout.row_width - 1));
+}
+
+u_int32_t PaxPage::text_size(const RecordView &record) {
+	return record.size - this->codec.get_fixed_size();
+}
+
+//Each column's bytes within a RowCodec record
+void PaxPage::split(const RecordView &record) {
+	this->columns.clear();
+	for (u_int32_t column = 0; column < this->layout.types.size(); column++)
+		this->columns.push_back(this->codec.column_bytes(record, column));
+}
@@ -0,0 +1,151 @@
+/**
+ * @file pax_page.h - Column-at-a-time (PAX) block layout for HeapTable.
+ * PaxLayout
+ * PaxPage: DbBlock
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <vector>
+#include "db_cxx.h"
+#include "storage_engine.h"
+#include "row_codec.h"
+#include "int_filter.h"
+
+/**
+ * @class PaxLayout - where each column's minipage goes, per record of capacity, for one table
+ *
+ * Worked out once from the table's columns. A block formatted for capacity records has
+ * column c's minipage at HEADER_SZ + capacity * prefix[c]; INTs take 4 bytes per record,
+ * TEXTs 8 (offset and size of the value in the block's heap). A 1-byte deleted flag per
+ * record comes last so the INT minipages stay 4-byte aligned.
+ */
+struct PaxLayout {
+	std::vector<ColumnAttribute::DataType> types;  // as stored (a dictionary-encoded TEXT is an INT code)
+	std::vector<u_int32_t> prefix;  // minipage bytes per record before column c
+	u_int32_t row_width;            // minipage bytes per record, all columns and the deleted flag
+
+	explicit PaxLayout(const RowCodec& codec);
+};
+
+/**
+ * @class PaxPage - DbBlock that keeps each column's values together
+ *
+ *      header: magic, num_records, capacity, heap_start (4 bytes each)
+ *      one minipage per column: capacity values (INT) or (offset, size) pairs (TEXT)
+ *      capacity deleted flags
+ *      free space
+ *      heap of TEXT bytes, growing down from the end of the block
+ *
+ * Records go in and come out (add/get/put) in RowCodec format, so a PaxPage can stand in for
+ * a SlottedPage anywhere records are handled whole; column_bytes(), int_column() and matches()
+ * read single columns without touching the rest of the record. RecordIDs are 1..num_records.
+ *
+ * A block is formatted on its first add(). capacity is fixed then, from the room left after
+ * the minipages for the expected TEXT bytes per record (set_expected_text), so when the
+ * guess is off one of the two runs out first. Blocks that have never been formatted (empty
+ * new blocks from the HeapFile) read as empty.
+ */
+class PaxPage : public DbBlock {
+public:
+	static const u_int32_t MAGIC = 0x31584150;  // "PAX1"
+	static const u_int32_t HEADER_SZ = 4 * sizeof(u_int32_t);
+
+	/**
+	 * @param bytes  start of a block
+	 * @returns      true if the block has been formatted as a PaxPage
+	 */
+	static bool is_pax(const void* bytes);
+
+	PaxPage(Dbt &block, BlockID block_id, const RowCodec &codec, const PaxLayout &layout, bool is_new=false);
+	virtual ~PaxPage() {}
+	PaxPage(const PaxPage& other) = delete;
+	PaxPage(PaxPage&& temp) = delete;
+	PaxPage& operator=(const PaxPage& other) = delete;
+	PaxPage& operator=(PaxPage&& temp) = delete;
+
+	virtual void initialize_new();
+	virtual RecordID add(const Dbt* data) throw(DbBlockNoRoomError);
+	virtual Dbt* get(RecordID record_id);  // record's memory is good until the next get()
+	virtual void put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomError);
+	virtual void del(RecordID record_id);
+	virtual RecordIDs* ids();
+	virtual RecordID next_id(RecordID prev=0);
+	virtual u_int32_t free_space();
+
+	/**
+	 * Point this page at another block's memory, as SlottedPage::load does.
+	 * @param block     the block's memory
+	 * @param block_id  which block it is
+	 */
+	virtual void load(Dbt &block, BlockID block_id);
+
+	/**
+	 * Lay out the minipages now, for set_expected_text() bytes of TEXT per record
+	 * (add() does this for a block's first record). Any records in the block are lost.
+	 * @param text  TEXT bytes of the record about to go in, which must fit whatever the guess
+	 */
+	void format(u_int32_t text=0);
+
+	/**
+	 * @param expected_text  TEXT bytes per record to plan for when this block is formatted
+	 */
+	void set_expected_text(u_int32_t expected_text) {this->expected_text = expected_text;}
+
+	u_int32_t get_num_records() {return num_records;}
+	bool is_deleted(RecordID record_id);
+
+	/**
+	 * @returns  how many records the block has, from its deleted flags alone
+	 */
+	u_int32_t count_records();
+
+	/**
+	 * @param record_id  which record
+	 * @param column     which column, by position
+	 * @returns          where the column's value is in the block (4 bytes for an INT)
+	 */
+	RecordView column_bytes(RecordID record_id, u_int32_t column);
+
+	/**
+	 * @param column  an INT column
+	 * @returns       its values for records 1..get_num_records(), back to back (check is_deleted)
+	 */
+	const int32_t* int_column(u_int32_t column);
+
+	/**
+	 * @param record_id  which record
+	 * @param filter     as from RowCodec::compile_filter()
+	 * @returns          true if the record satisfies every test
+	 */
+	bool matches(RecordID record_id, const RowFilter& filter);
+
+	/**
+	 * Test every record in the block at once: the INT tests with IntFilter over their minipages,
+	 * then the TEXT tests on just the records still in.
+	 * @param filter  as from RowCodec::compile_filter()
+	 * @param mask    set to IntFilter::mask_words(get_num_records()) words, bit record_id - 1 set
+	 *                for each live record that satisfies every test
+	 */
+	void select(const RowFilter& filter, std::vector<u_int64_t>& mask);
+
+protected:
+	const RowCodec &codec;
+	const PaxLayout &layout;
+	u_int32_t num_records;
+	u_int32_t capacity;
+	u_int32_t heap_start;
+	u_int32_t expected_text;
+	std::vector<char> gathered;  // get()'s record
+	std::vector<RecordView> columns;
+
+	u_int32_t block_size() {return block.get_size();}
+	void put_header();
+	u_int32_t minipage(u_int32_t column) {return HEADER_SZ + capacity * layout.prefix[column];}
+	u_int32_t minipage_end() {return HEADER_SZ + capacity * layout.row_width;}
+	u_int8_t* deleted_flags();
+	char* address(u_int32_t offset) {return (char*)block.get_data() + offset;}
+	u_int32_t text_size(const RecordView &record);
+	void split(const RecordView &record);
+};
@@ -0,0 +1,227 @@
+/**
+ * @file plan_cache.cpp - implementation of the plan cache.
+ * PlanCache
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "plan_cache.h"
+#include <cctype>
+#include <iostream>
+#include <limits>
+#include "heap_storage.h"
+using namespace std;
+
+static string upper(const string& word) {
+	string ret(word);
+	for (char& c : ret)
+		c = (char)toupper((unsigned char)c);
+	return ret;
+}
+
+static bool is_word_char(char c) {
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+
+/**************************PlanCache Implementation*********************/
+
+PlanCache::~PlanCache() {
+	clear();
+}
+
+//One pass over the text; anything it doesn't turn into a ? is copied as it was
+bool PlanCache::normalize(const string& query, string& shape, Parameters& literals) {
+	shape.clear();
+	literals.clear();
+	string first, word;  // the statement's first word, and the word just before the current token
+	bool space = false, ordering = false;  // ordering: in the ORDER BY, whose integers are positions
+	size_t i = 0, n = query.size();
+	while (i < n) {
+		char c = query[i];
+		if (isspace((unsigned char)c)) {
+			space = true;
+			i++;
+			continue;
+		}
+		if (space && !shape.empty())
+			shape += ' ';
+		space = false;
+
+		if (c == '?' || (c == '-' && i + 1 < n && query[i + 1] == '-') || (c == '/' && i + 1 < n && query[i + 1] == '*'))
+			return false;
+		if (c == ';') {  // only as the last thing in the query
+			for (i++; i < n; i++)
+				if (!isspace((unsigned char)query[i]))
+					return false;
+			break;
+		}
+		if (isalpha((unsigned char)c) || c == '_') {
+			size_t start = i;
+			while (i < n && is_word_char(query[i]))
+				i++;
+			string before = upper(word);
+			word = query.substr(start, i - start);
+			string keyword = upper(word);
+			if (before == "ORDER" && keyword == "BY")
+				ordering = true;
+			else if (keyword == "LIMIT" || keyword == "OFFSET")
+				ordering = false;
+			if (first.empty())
+				first = word;
+			shape += word;
+			continue;
+		}
+		if (c == '"') {  // a quoted name
+			size_t end = query.find('"', i + 1);
+			if (end == string::npos)
+				return false;
+			shape.append(query, i, end + 1 - i);
+			i = end + 1;
+			word.clear();
+			continue;
+		}
+		if (c == '\'') {  // '' inside a string isn't taken as a quote by every parser, so it's left alone
+			size_t end = query.find('\'', i + 1);
+			if (end == string::npos || (end + 1 < n && query[end + 1] == '\''))
+				return false;
+			literals.push_back(Value(query.substr(i + 1, end - i - 1)));
+			shape += '?';
+			i = end + 1;
+			word.clear();
+			continue;
+		}
+		if (isdigit((unsigned char)c) || (c == '.' && i + 1 < n && isdigit((unsigned char)query[i + 1]))) {
+			size_t start = i;
+			while (i < n && (is_word_char(query[i]) || query[i] == '.'))  // all of 1.5 or 1e3
+				i++;
+			string number = query.substr(start, i - start);
+			string before = upper(word);
+			bool digits = number.find_first_not_of("0123456789") == string::npos;
+			if (digits && number.size() <= 10 && stoll(number) <= numeric_limits<int32_t>::max()
+					&& before != "LIMIT" && before != "OFFSET" && !ordering) {
+				literals.push_back(Value((int32_t)stoll(number)));
+				shape += '?';
+			}
+			else {
+				shape += number;
+			}
+			word.clear();
+			continue;
+		}
+		shape += c;
+		i++;
+		word.clear();
+	}
+	first = upper(first);
+	return first == "SELECT" || first == "INSERT";
+}
+
+//The shape can't have a newline in it (white space is collapsed to blanks), so it ends the shape
+string PlanCache::key(const string& shape, const Parameters& literals) {
+	string ret(shape);
+	ret += '\n';
+	for (auto const& literal : literals)
+		ret += literal.data_type == ColumnAttribute::INT ? 'i' : 't';
+	return ret;
+}
+
+PreparedStatement* PlanCache::find(const string& key) {
+	auto found = this->index.find(key);
+	if (found != this->index.end() && found->second->second->is_stale()) {
+		delete found->second->second;
+		this->entries.erase(found->second);
+		this->index.erase(found);
+		found = this->index.end();
+	}
+	if (found == this->index.end()) {
+		this->misses++;
+		return nullptr;
+	}
+	this->hits++;
+	this->entries.splice(this->entries.begin(), this->entries, found->second);
+	return found->second->second;
+}
+
+void PlanCache::add(const string& key, PreparedStatement* statement) {
+	auto found = this->index.find(key);
+	if (found != this->index.end()) {
+		delete found->second->second;
+		found->second->second = statement;
+		this->entries.splice(this->entries.begin(), this->entries, found->second);
+		return;
+	}
+	this->entries.push_front(make_pair(key, statement));
+	this->index[key] = this->entries.begin();
+	if (this->entries.size() > this->capacity) {
+		delete this->entries.back().second;
+		this->index.erase(this->entries.back().first);
+		this->entries.pop_back();
+	}
+}
+
+void PlanCache::clear() {
+	for (auto const& entry : this->entries)
+		delete entry.second;
+	this->entries.clear();
+	this->index.clear();
+}
+
+
+// test function -- returns true if all tests pass
+bool test_plan_cache() {
+	string shape;
+	Parameters literals;
+	if (!PlanCache::normalize("  SELECT a FROM t1 WHERE a = 12 AND\tb = 'x  y'  LIMIT 5;", shape, literals)
+			|| shape != "SELECT a FROM t1 WHERE a = ? AND b = ? LIMIT 5" || literals.size() != 2
+			|| literals[0].n != 12 || literals[1].s != "x  y")
+		return false;
+	if (!PlanCache::normalize("insert into t values (-7, 3000000000, 1.5, .5, 'a')", shape, literals)
+			|| shape != "insert into t values (-?, 3000000000, 1.5, .5, ?)" || literals.size() != 2)
+		return false;
+	if (!PlanCache::normalize("SELECT a FROM t WHERE b = 2 ORDER BY 2, a + 1 DESC LIMIT 3", shape, literals)
+			|| shape != "SELECT a FROM t WHERE b = ? ORDER BY 2, a + 1 DESC LIMIT 3" || literals.size() != 1)
+		return false;
+	for (const char* other : {"CREATE TABLE t (a INT)", "SELECT ? FROM t", "SELECT 1; SELECT 2", "SELECT 'it''s'",
+			"SELECT 1 -- one", "SELECT 'open", ""})
+		if (PlanCache::normalize(other, shape, literals))
+			return false;
+	Parameters text{Value(string("1"))};
+	Parameters number{Value(1)};
+	if (PlanCache::key("SELECT ?", text) == PlanCache::key("SELECT ?", number))
+		return false;
+
+	// least recently used goes first
+	PlanCache cache(2);
+	cache.add("a", new PreparedStatement());
+	cache.add("b", new PreparedStatement());
+	if (cache.find("a") == nullptr)
+		return false;
+	cache.add("c", new PreparedStatement());
+	if (cache.size() != 2 || cache.find("b") != nullptr || cache.find("a") == nullptr || cache.find("c") == nullptr
+			|| cache.get_hits() != 3 || cache.get_misses() != 1)
+		return false;
+	cache.clear();
+	if (cache.size() != 0 || cache.find("a") != nullptr)
+		return false;
+
+	// a plan made for a table that has since doubled in size is planned again
+	HeapTable table("_test_plan_cache", {"a"}, {ColumnAttribute(ColumnAttribute::TEXT)});
+	table.create();
+	Row row(1);
+	row.set_text(0, string(1000, 'x'));
+	table.insert(&row);
+	PreparedStatement* planned = new PreparedStatement();
+	planned->planned_blocks.push_back(make_pair(&table, table.get_block_count()));
+	cache.add("a", planned);
+	while (table.get_block_count() <= planned->planned_blocks[0].second * PreparedStatement::REPLAN_FACTOR) {
+		if (cache.find("a") != planned)
+			return false;
+		table.insert(&row);
+	}
+	bool replanned = cache.find("a") == nullptr && cache.size() == 0;
+	table.drop();
+	if (!replanned)
+		return false;
+	cout << "plan cache ok" << endl;
+	return true;
+}
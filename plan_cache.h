@@ -0,0 +1,91 @@
+/**
+ * @file plan_cache.h - Plans kept for statements that differ only in their literals.
+ * PlanCache
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "executor.h"
+
+/**
+ * @class PlanCache - the most recently used prepared statements, by the shape of their SQL
+ *
+ * A statement's shape is its text with each INT and TEXT literal turned into a placeholder,
+ * so SELECT * FROM t WHERE a = 1 and SELECT * FROM t WHERE a = 2 share one plan, run with
+ * the literals bound as its parameters. The key a plan is kept under also says which of the
+ * literals were INT and which TEXT, as that can change the plan. A plan whose tables have
+ * grown or shrunk enough since it was made (see PreparedStatement::is_stale) isn't handed
+ * out again, so the statement is planned over for the tables as they are now.
+ *
+ * Plans refer to their tables, so the cache has to be cleared (or deleted) before the tables
+ * are closed.
+ */
+class PlanCache {
+public:
+	static const size_t DEFAULT_CAPACITY = 256;
+
+	explicit PlanCache(size_t capacity=DEFAULT_CAPACITY) : capacity(capacity), entries(), index(), hits(0), misses(0) {}
+	virtual ~PlanCache();
+	PlanCache(const PlanCache& other) = delete;
+	PlanCache(PlanCache&& temp) = delete;
+	PlanCache& operator=(const PlanCache& other) = delete;
+	PlanCache& operator=(PlanCache&& temp) = delete;
+
+	/**
+	 * Take the literals out of a single SELECT or INSERT, collapsing its white space too.
+	 * Literals that can't be parameters are left in: LIMIT and OFFSET counts, integers in an
+	 * ORDER BY (which can be positions), decimals and integers too big for an INT.
+	 * @param query     SQL as typed
+	 * @param shape     query with a ? where each literal was
+	 * @param literals  the literals, in order
+	 * @returns         false if query is something else (another kind of statement, more than
+	 *                  one, or one with placeholders or comments of its own)
+	 */
+	static bool normalize(const std::string& query, std::string& shape, Parameters& literals);
+
+	/**
+	 * @param shape     a shape from normalize
+	 * @param literals  its literals
+	 * @returns         the key its plan is kept under
+	 */
+	static std::string key(const std::string& shape, const Parameters& literals);
+
+	/**
+	 * Look up a plan, counting a hit or a miss. A stale plan is a miss, and is let go of.
+	 * @param key  from key()
+	 * @returns    the plan (still owned by the cache), or nullptr if there is none
+	 */
+	virtual PreparedStatement* find(const std::string& key);
+
+	/**
+	 * Keep a plan, letting go of the least recently used one if the cache is full.
+	 * @param key        from key()
+	 * @param statement  the plan (owned by the cache from now on)
+	 */
+	virtual void add(const std::string& key, PreparedStatement* statement);
+
+	/**
+	 * Let go of all the plans.
+	 */
+	virtual void clear();
+
+	size_t size() const {return entries.size();}
+	u_int64_t get_hits() const {return hits;}
+	u_int64_t get_misses() const {return misses;}
+
+protected:
+	typedef std::list<std::pair<std::string, PreparedStatement*>> Entries;  // most recently used first
+
+	size_t capacity;
+	Entries entries;
+	std::unordered_map<std::string, Entries::iterator> index;
+	u_int64_t hits;
+	u_int64_t misses;
+};
+
+bool test_plan_cache();
@@ -0,0 +1,736 @@
+/**
+ * @file query_planner.cpp - implementation of the SELECT and INSERT planner.
+ * QueryPlanner
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "query_planner.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <strings.h>
+using namespace std;
+using namespace hsql;
+
+static int32_t int_literal(const Expr* expr) {
+	if (expr->ival < numeric_limits<int32_t>::min() || expr->ival > numeric_limits<int32_t>::max())
+		throw DbRelationError(to_string(expr->ival) + " is too big for an INT");
+	return (int32_t)expr->ival;
+}
+
+//Where a column reference's column is among the columns of all the scope's tables, or -1 if none has it
+static int find_column(const Expr* expr, const QueryPlanner::Scope& scope) {
+	int position = -1;
+	bool table_found = expr->table == NULL;
+	for (auto const& source : scope) {
+		if (expr->table != NULL && source.table->get_table_name() != expr->table
+				&& (source.alias == nullptr || strcmp(source.alias, expr->table) != 0))
+			continue;
+		table_found = true;
+		const ColumnNames& column_names = source.table->get_column_names();
+		for (u_int32_t i = 0; i < column_names.size(); i++) {
+			if (column_names[i] != expr->name)
+				continue;
+			if (position >= 0)
+				throw DbRelationError(string("column ") + expr->name + " is ambiguous");
+			position = (int)(source.offset + i);
+		}
+	}
+	if (!table_found)
+		throw DbRelationError(string("unknown table ") + expr->table);
+	return position;
+}
+
+static u_int32_t source_of(u_int32_t position, const QueryPlanner::Scope& scope) {
+	u_int32_t i = (u_int32_t)scope.size() - 1;
+	while (scope[i].offset > position)
+		i--;
+	return i;
+}
+
+static ColumnAttribute::DataType column_type(u_int32_t position, const QueryPlanner::Scope& scope) {
+	const QueryPlanner::Source& source = scope[source_of(position, scope)];
+	return source.table->get_column_attributes()[position - source.offset].get_data_type();
+}
+
+static u_int32_t column_position(const Expr* expr, const QueryPlanner::Scope& scope) {
+	int position = find_column(expr, scope);
+	if (position < 0)
+		throw DbRelationError(string("unknown column ") + expr->name);
+	return (u_int32_t)position;
+}
+
+// an ORDER BY item that is a position in the select list, counting from 1
+static bool is_position(const Expr* expr) {
+	return expr->type == kExprLiteralInt;
+}
+
+//Which column of the select list an ORDER BY item sorts on: a position in it, an alias in it, or the
+//same column as one in it or added for an earlier item; otherwise the next one, to be added for it
+static u_int32_t order_column(const Expr* expr, const ColumnNames& names, const vector<bool>& aliased,
+		const vector<int>& origins, u_int32_t visible, const QueryPlanner::Scope& scope) {
+	if (is_position(expr)) {
+		if (expr->ival < 1 || expr->ival > visible)
+			throw DbRelationError("ORDER BY position " + to_string(expr->ival) + " is not in the select list");
+		return (u_int32_t)(expr->ival - 1);
+	}
+	if (expr->type != kExprColumnRef)
+		return (u_int32_t)names.size();
+	for (u_int32_t i = 0; i < visible && expr->table == NULL; i++)
+		if (aliased[i] && names[i] == expr->name)
+			return i;
+	int position = (int)column_position(expr, scope);
+	for (u_int32_t i = 0; i < origins.size(); i++)
+		if (origins[i] == position)
+			return i;
+	return (u_int32_t)names.size();
+}
+
+// COUNT, SUM, MIN or MAX, as a function of the select list (and where it is, in function)
+static bool is_aggregate(const Expr* expr, HashAggregate::Function* function=nullptr) {
+	if (expr->type != kExprFunctionRef || expr->name == NULL)
+		return false;
+	for (HashAggregate::Function f : {HashAggregate::COUNT, HashAggregate::SUM, HashAggregate::MIN, HashAggregate::MAX}) {
+		if (strcasecmp(expr->name, HashAggregate::function_name(f)) == 0) {
+			if (function != nullptr)
+				*function = f;
+			return true;
+		}
+	}
+	return false;
+}
+
+// the one argument of a function (the parser has it in expr, or in exprList)
+static const Expr* argument_of(const Expr* function) {
+	if (function->expr != NULL)
+		return function->expr;
+	if (function->exprList == NULL || function->exprList->size() != 1)
+		throw DbRelationError(string(function->name) + " takes one argument");
+	return (*function->exprList)[0];
+}
+
+static bool is_count_star(const Expr* expr) {
+	HashAggregate::Function function;
+	return is_aggregate(expr, &function) && function == HashAggregate::COUNT && argument_of(expr)->type == kExprStar;
+}
+
+static Expression::Op binary_op(const Expr* expr) {
+	switch (expr->opType) {
+	case Expr::SIMPLE_OP:
+		switch (expr->opChar) {
+		case '=':
+			return Expression::EQ;
+		case '<':
+			return Expression::LT;
+		case '>':
+			return Expression::GT;
+		case '+':
+			return Expression::PLUS;
+		case '-':
+			return Expression::MINUS;
+		case '*':
+			return Expression::TIMES;
+		case '/':
+			return Expression::DIVIDE;
+		case '%':
+			return Expression::MODULO;
+		default:
+			break;
+		}
+		break;
+	case Expr::NOT_EQUALS:
+		return Expression::NE;
+	case Expr::LESS_EQ:
+		return Expression::LE;
+	case Expr::GREATER_EQ:
+		return Expression::GE;
+	case Expr::AND:
+		return Expression::AND;
+	case Expr::OR:
+		return Expression::OR;
+	default:
+		break;
+	}
+	throw DbRelationError("operator not supported");
+}
+
+static void find_placeholders(const Expr* expr, vector<const Expr*>& found) {
+	if (expr == NULL)
+		return;
+	if (expr->type == kExprPlaceholder)
+		found.push_back(expr);
+	find_placeholders(expr->expr, found);
+	find_placeholders(expr->expr2, found);
+	if (expr->exprList != NULL)
+		for (const Expr* item : *expr->exprList)
+			find_placeholders(item, found);
+}
+
+static void find_placeholders(const TableRef* from, vector<const Expr*>& found) {
+	if (from == NULL)
+		return;
+	if (from->type == kTableJoin && from->join != NULL) {
+		find_placeholders(from->join->left, found);
+		find_placeholders(from->join->right, found);
+		find_placeholders(from->join->condition, found);
+	}
+	if (from->type == kTableCrossProduct && from->list != NULL)
+		for (const TableRef* item : *from->list)
+			find_placeholders(item, found);
+}
+
+static void split_conjuncts(const Expr* expr, vector<const Expr*>& conjuncts) {
+	if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+		split_conjuncts(expr->expr, conjuncts);
+		split_conjuncts(expr->expr2, conjuncts);
+		return;
+	}
+	conjuncts.push_back(expr);
+}
+
+
+/**************************QueryPlanner Implementation*********************/
+
+//The placeholders are numbered first, so each compiled parameter knows which value is its
+PreparedStatement* QueryPlanner::prepare(const SQLStatement* statement, const Parameters* hints) {
+	vector<const Expr*> found;
+	if (statement->type() == kStmtSelect) {
+		const SelectStatement* select = (const SelectStatement*) statement;
+		for (const Expr* expr : *select->selectList)
+			find_placeholders(expr, found);
+		find_placeholders(select->fromTable, found);
+		find_placeholders(select->whereClause, found);
+		for (u_int32_t i = 0; select->order != NULL && i < select->order->size(); i++)
+			find_placeholders((*select->order)[i]->expr, found);
+	}
+	else if (statement->type() == kStmtInsert) {
+		const InsertStatement* insert = (const InsertStatement*) statement;
+		for (u_int32_t i = 0; insert->values != NULL && i < insert->values->size(); i++)
+			find_placeholders((*insert->values)[i], found);
+	}
+	else {
+		throw DbRelationError("only SELECT and INSERT can be prepared");
+	}
+	sort(found.begin(), found.end(), [](const Expr* a, const Expr* b) {return a->ival < b->ival;});
+
+	PreparedStatement* prepared = new PreparedStatement();
+	prepared->parameters.resize(found.size());
+	prepared->parameter_types.resize(found.size(), ColumnAttribute::INT);
+	this->preparing = prepared;
+	this->hints = hints;
+	this->placeholders.clear();
+	for (u_int32_t i = 0; i < found.size(); i++)
+		this->placeholders[found[i]] = i;
+	try {
+		if (statement->type() == kStmtSelect)
+			prepared->plan = plan((const SelectStatement*) statement);
+		else
+			prepare_insert((const InsertStatement*) statement, prepared);
+	}
+	catch (...) {
+		this->preparing = nullptr;
+		this->hints = nullptr;
+		delete prepared;
+		throw;
+	}
+	this->preparing = nullptr;
+	this->hints = nullptr;
+	for (u_int32_t i = 0; i < found.size(); i++)  // unbound parameters read as 0 or ''
+		if (prepared->parameter_types[i] == ColumnAttribute::TEXT)
+			prepared->parameters[i] = Value(string());
+	return prepared;
+}
+
+//Each conjunct goes as far down the plan as it can: into a table's scan or the Filter over it, to a
+//join as its key, or else to the Filter on top of the joins
+Operator* QueryPlanner::plan(const SelectStatement* select) {
+	if (select->fromTable == NULL)
+		throw DbRelationError("SELECT needs a FROM clause");
+	if (select->selectDistinct || select->unionSelect != NULL)
+		throw DbRelationError("DISTINCT and UNION are not supported");
+	if (select->groupBy != NULL && select->groupBy->having != NULL)
+		throw DbRelationError("HAVING is not supported");
+	bool grouped = select->groupBy != NULL;
+	for (const Expr* expr : *select->selectList)
+		grouped = grouped || is_aggregate(expr);
+	Scope scope;
+	vector<const Expr*> conjuncts;
+	add_sources(select->fromTable, scope, conjuncts);
+	if (select->whereClause != NULL)
+		split_conjuncts(select->whereClause, conjuncts);
+
+	vector<vector<Equality>> pushed(scope.size());
+	vector<vector<const Expr*>> residual(scope.size());
+	vector<const Expr*> joining;
+	const Source& last = scope.back();
+	vector<bool> used(last.offset + last.table->get_column_names().size(), false);
+	for (const Expr* conjunct : conjuncts) {
+		vector<bool> columns(used.size(), false);
+		used_columns(conjunct, scope, columns);
+		vector<bool> sources(scope.size(), false);
+		for (u_int32_t i = 0; i < columns.size(); i++)
+			if (columns[i])
+				sources[source_of(i, scope)] = true;
+		if (count(sources.begin(), sources.end(), true) == 1) {
+			u_int32_t i = (u_int32_t)(find(sources.begin(), sources.end(), true) - sources.begin());
+			split_where(conjunct, scope[i], pushed[i], residual[i]);
+		}
+		else {
+			joining.push_back(conjunct);
+		}
+	}
+	for (const Expr* expr : *select->selectList)
+		used_columns(expr, scope, used);
+	for (auto const& filter : residual)
+		for (const Expr* expr : filter)
+			used_columns(expr, scope, used);
+	for (const Expr* expr : joining)
+		used_columns(expr, scope, used);
+	for (u_int32_t i = 0; select->groupBy != NULL && i < select->groupBy->columns->size(); i++)
+		used_columns((*select->groupBy->columns)[i], scope, used);
+	for (u_int32_t i = 0; select->order != NULL && i < select->order->size(); i++)
+		if (!is_position((*select->order)[i]->expr))
+			used_columns((*select->order)[i]->expr, scope, used);
+
+	Operator* plan = nullptr;
+	vector<Expression*> expressions;
+	try {
+		plan = plan_source(scope[0], pushed[0], residual[0], used);
+		u_int32_t blocks = scope[0].table->get_block_count();  // for the join so far, its biggest table's
+		for (u_int32_t i = 1; i < scope.size(); i++) {
+			// the key: column = column, one of the tables joined so far against this one
+			auto key = joining.end();
+			u_int32_t left_key = 0, right_key = 0;
+			for (auto it = joining.begin(); it != joining.end() && key == joining.end(); it++) {
+				const Expr* conjunct = *it;
+				if (conjunct->type != kExprOperator || conjunct->opType != Expr::SIMPLE_OP || conjunct->opChar != '='
+						|| conjunct->expr->type != kExprColumnRef || conjunct->expr2->type != kExprColumnRef)
+					continue;
+				u_int32_t first = column_position(conjunct->expr, scope);
+				u_int32_t second = column_position(conjunct->expr2, scope);
+				if (source_of(first, scope) > source_of(second, scope))
+					swap(first, second);
+				if (source_of(first, scope) < i && source_of(second, scope) == i) {
+					key = it;
+					left_key = first;
+					right_key = second - scope[i].offset;
+				}
+			}
+			if (key == joining.end())
+				throw DbRelationError("no column = column condition to join " + scope[i].table->get_table_name() + " on");
+			joining.erase(key);
+			Operator* right = plan_source(scope[i], pushed[i], residual[i], used);
+			u_int32_t right_blocks = scope[i].table->get_block_count();
+			Operator* left = plan;
+			plan = nullptr;  // HashJoin frees left and right if it throws
+			plan = new HashJoin(left, right, left_key, right_key, blocks < right_blocks);
+			blocks = max(blocks, right_blocks);
+		}
+
+		if (!joining.empty()) {
+			Expression* predicate = compile_conjunction(joining, scope);
+			Operator* input = plan;
+			plan = nullptr;  // Filter frees input and predicate if it throws
+			plan = new Filter(input, predicate);
+		}
+
+		// the select list (or the groups' rows), then any ORDER BY expressions that aren't in it, as hidden columns
+		bool just_star = select->selectList->size() == 1 && (*select->selectList)[0]->type == kExprStar;
+		ColumnNames names;
+		vector<int> origins;  // the join's column each is, or -1 for another expression
+		vector<bool> aliased;
+		if (grouped) {
+			Operator* input = plan;
+			plan = nullptr;  // plan_aggregate frees input if it throws
+			plan = plan_aggregate(select, scope, input, conjuncts.empty() && scope.size() == 1, names, origins, aliased);
+		}
+		for (const Expr* expr : *select->selectList) {
+			if (grouped)
+				break;
+			if (expr->type == kExprStar) {
+				for (u_int32_t i = 0; i < used.size(); i++) {
+					const Source& source = scope[source_of(i, scope)];
+					expressions.push_back(Expression::column(i, column_type(i, scope)));
+					names.push_back(source.table->get_column_names()[i - source.offset]);
+					origins.push_back((int)i);
+					aliased.push_back(false);
+				}
+				continue;
+			}
+			expressions.push_back(compile_as(expr, scope, nullptr));
+			names.push_back(expr->alias != NULL ? expr->alias : expr->type == kExprColumnRef ? expr->name : "?column?");
+			origins.push_back(expr->type == kExprColumnRef ? (int)column_position(expr, scope) : -1);
+			aliased.push_back(expr->alias != NULL);
+		}
+		u_int32_t visible = (u_int32_t)names.size();
+		Sort::Keys keys;
+		for (u_int32_t i = 0; select->order != NULL && i < select->order->size(); i++) {
+			const Expr* expr = (*select->order)[i]->expr;
+			keys.push_back(Sort::Key{order_column(expr, names, aliased, origins, visible, scope),
+				(*select->order)[i]->type == kOrderDesc});
+			if (keys.back().column == names.size()) {
+				if (grouped)
+					throw DbRelationError("with GROUP BY or aggregates, ORDER BY has to be by columns of the select list");
+				expressions.push_back(compile_as(expr, scope, nullptr));
+				names.push_back("?column?");
+				origins.push_back(expr->type == kExprColumnRef ? (int)column_position(expr, scope) : -1);
+			}
+		}
+
+		if (!grouped && (!just_star || expressions.size() > visible)) {
+			Operator* input = plan;
+			vector<Expression*> columns;
+			columns.swap(expressions);
+			plan = nullptr;  // Project frees input and columns if it throws
+			plan = new Project(input, columns, names);
+		}
+		else {
+			for (Expression* expression : expressions)
+				delete expression;
+			expressions.clear();
+		}
+
+		bool limited = select->limit != NULL && (select->limit->limit != kNoLimit || select->limit->offset > 0);
+		u_int64_t limit = !limited || select->limit->limit < 0 ? numeric_limits<u_int64_t>::max() : select->limit->limit;
+		u_int64_t offset = limited && select->limit->offset > 0 ? select->limit->offset : 0;
+		if (!keys.empty()) {
+			// only the first offset + limit rows have to be sorted
+			plan = new Sort(plan, keys, limit == numeric_limits<u_int64_t>::max() ? Sort::NO_LIMIT : limit + offset);
+			if (names.size() > visible) {
+				vector<Expression*> columns;
+				for (u_int32_t i = 0; i < visible; i++)
+					columns.push_back(Expression::column(i, plan->get_column_attributes()[i].get_data_type()));
+				names.resize(visible);
+				Operator* input = plan;
+				plan = nullptr;  // Project frees input and columns if it throws
+				plan = new Project(input, columns, names);
+			}
+		}
+		if (limited)
+			plan = new Limit(plan, limit, offset);
+	}
+	catch (...) {
+		delete plan;
+		for (Expression* expression : expressions)
+			delete expression;
+		throw;
+	}
+	return plan;
+}
+
+//The group columns and the aggregates' arguments are projected first, then aggregated, then put in the
+//select list's order. COUNT(*) of a whole table, alone, is a TableCount instead.
+Operator* QueryPlanner::plan_aggregate(const SelectStatement* select, const Scope& scope, Operator* input,
+		bool whole_table, ColumnNames& names, vector<int>& origins, vector<bool>& aliased) {
+	const vector<Expr*>& select_list = *select->selectList;
+	if (whole_table && select->groupBy == NULL && select_list.size() == 1 && is_count_star(select_list[0])) {
+		delete input;
+		names.push_back(select_list[0]->alias != NULL ? select_list[0]->alias : "count");
+		origins.push_back(-1);
+		aliased.push_back(select_list[0]->alias != NULL);
+		return new TableCount(*scope[0].table, names.back());
+	}
+
+	Operator* plan = input;
+	vector<Expression*> arguments;
+	try {
+		ColumnNames argument_names;
+		vector<int> group_origins;  // the join's column each group column is, or -1
+		u_int32_t group_count = select->groupBy == NULL ? 0 : (u_int32_t)select->groupBy->columns->size();
+		for (u_int32_t i = 0; i < group_count; i++) {
+			const Expr* expr = (*select->groupBy->columns)[i];
+			arguments.push_back(compile_as(expr, scope, nullptr));
+			argument_names.push_back(expr->type == kExprColumnRef ? expr->name : "?column?");
+			group_origins.push_back(expr->type == kExprColumnRef ? (int)column_position(expr, scope) : -1);
+		}
+		HashAggregate::Aggregates aggregates;
+		vector<u_int32_t> selected;  // where each item of the select list is in the groups' rows
+		for (const Expr* expr : select_list) {
+			HashAggregate::Function function;
+			if (is_aggregate(expr, &function)) {
+				if (expr->distinct)
+					throw DbRelationError(string(expr->name) + "(DISTINCT ...) is not supported");
+				u_int32_t column = 0;  // COUNT(*) reads no column
+				if (!is_count_star(expr)) {
+					const Expr* argument = argument_of(expr);
+					if (argument->type == kExprStar)
+						throw DbRelationError(string(expr->name) + "(*) is not supported");
+					column = (u_int32_t)arguments.size();
+					arguments.push_back(compile_as(argument, scope, nullptr));
+					argument_names.push_back(argument->type == kExprColumnRef ? argument->name : "?column?");
+				}
+				aggregates.push_back(HashAggregate::Aggregate{function, column});
+				selected.push_back(group_count + (u_int32_t)aggregates.size() - 1);
+				names.push_back(expr->alias != NULL ? expr->alias : HashAggregate::function_name(function));
+				origins.push_back(-1);
+				aliased.push_back(expr->alias != NULL);
+				continue;
+			}
+			int position = expr->type == kExprColumnRef ? (int)column_position(expr, scope) : -1;
+			auto group = find(group_origins.begin(), group_origins.end(), position);
+			if (position < 0 || group == group_origins.end())
+				throw DbRelationError(expr->type == kExprColumnRef ? string("column ") + expr->name
+					+ " has to be in the GROUP BY or in an aggregate" : "only GROUP BY columns and aggregates can be selected");
+			selected.push_back((u_int32_t)(group - group_origins.begin()));
+			names.push_back(expr->alias != NULL ? expr->alias : expr->name);
+			origins.push_back(position);
+			aliased.push_back(expr->alias != NULL);
+		}
+
+		vector<Expression*> columns;
+		columns.swap(arguments);
+		plan = nullptr;  // Project frees input and columns if it throws
+		plan = new Project(input, columns, argument_names);
+		vector<u_int32_t> group_by;
+		for (u_int32_t i = 0; i < group_count; i++)
+			group_by.push_back(i);
+		Operator* projected = plan;
+		plan = nullptr;  // HashAggregate frees its input if it throws
+		plan = new HashAggregate(projected, group_by, aggregates);
+		columns.clear();
+		for (u_int32_t column : selected)
+			columns.push_back(Expression::column(column, plan->get_column_attributes()[column].get_data_type()));
+		Operator* aggregated = plan;
+		plan = nullptr;
+		plan = new Project(aggregated, columns, names);
+	}
+	catch (...) {
+		delete plan;
+		for (Expression* argument : arguments)
+			delete argument;
+		throw;
+	}
+	return plan;
+}
+
+//Only a placeholder uses expected; everything else has a type of its own
+Expression* QueryPlanner::compile_as(const Expr* expr, const Scope& scope, const ColumnAttribute::DataType* expected) {
+	ColumnAttribute::DataType int_type = ColumnAttribute::INT;
+	switch (expr->type) {
+	case kExprLiteralInt:
+		return Expression::literal(int_literal(expr));
+	case kExprLiteralString:
+		return Expression::literal(string(expr->name));
+	case kExprColumnRef: {
+		u_int32_t position = column_position(expr, scope);
+		return Expression::column(position, column_type(position, scope));
+	}
+	case kExprPlaceholder:
+		return parameter(expr, expected);
+	case kExprOperator:
+		break;
+	default:
+		throw DbRelationError("only INT and TEXT literals, placeholders, columns and operators are supported in expressions");
+	}
+
+	if (expr->opType == Expr::NOT || expr->opType == Expr::UMINUS)
+		return Expression::unary(expr->opType == Expr::NOT ? Expression::NOT : Expression::NEGATE,
+			compile_as(expr->expr, scope, &int_type));
+	if (expr->opType == Expr::BETWEEN) {  // x BETWEEN lo AND hi is x >= lo AND x <= hi
+		if (expr->exprList == NULL || expr->exprList->size() != 2)
+			throw DbRelationError("BETWEEN needs two bounds");
+		Expression* low = compile_binary(Expression::GE, expr->expr, (*expr->exprList)[0], scope);
+		Expression* high;
+		try {
+			high = compile_binary(Expression::LE, expr->expr, (*expr->exprList)[1], scope);
+		}
+		catch (...) {
+			delete low;
+			throw;
+		}
+		return Expression::binary(Expression::AND, low, high);
+	}
+	return compile_binary(binary_op(expr), expr->expr, expr->expr2, scope);
+}
+
+//A placeholder compared with something has that thing's type, so the other side is compiled first
+Expression* QueryPlanner::compile_binary(Expression::Op op, const Expr* left, const Expr* right, const Scope& scope) {
+	ColumnAttribute::DataType int_type = ColumnAttribute::INT;
+	bool comparison = Expression::is_comparison(op);
+	bool swapped = comparison && left->type == kExprPlaceholder && right->type != kExprPlaceholder;
+	const Expr* first = swapped ? right : left;
+	const Expr* second = swapped ? left : right;
+	Expression* compiled = compile_as(first, scope, comparison ? nullptr : &int_type);
+	Expression* other;
+	try {
+		ColumnAttribute::DataType data_type = compiled->get_data_type();
+		other = compile_as(second, scope, comparison ? &data_type : &int_type);
+	}
+	catch (...) {
+		delete compiled;
+		throw;
+	}
+	return swapped ? Expression::binary(op, other, compiled) : Expression::binary(op, compiled, other);
+}
+
+Expression* QueryPlanner::compile_conjunction(const vector<const Expr*>& conjuncts, const Scope& scope) {
+	Expression* predicate = compile_as(conjuncts[0], scope, nullptr);
+	for (u_int32_t i = 1; i < conjuncts.size(); i++) {
+		Expression* conjunct;
+		try {
+			conjunct = compile_as(conjuncts[i], scope, nullptr);
+		}
+		catch (...) {
+			delete predicate;
+			throw;
+		}
+		predicate = Expression::binary(Expression::AND, predicate, conjunct);
+	}
+	return predicate;
+}
+
+//Its type comes from where it is, else from the hints; where both give one, they have to agree
+Expression* QueryPlanner::parameter(const Expr* placeholder, const ColumnAttribute::DataType* expected) {
+	auto found = this->placeholders.find(placeholder);
+	if (this->preparing == nullptr || found == this->placeholders.end())
+		throw DbRelationError("placeholders are only allowed in prepared statements");
+	u_int32_t index = found->second;
+	const Value* hint = this->hints != nullptr && index < this->hints->size() ? &(*this->hints)[index] : nullptr;
+	if (expected == nullptr && hint == nullptr)
+		throw DbRelationError("can't tell the type of parameter " + to_string(index + 1));
+	if (expected != nullptr && hint != nullptr && *expected != hint->data_type)
+		throw DbRelationError("wrong type of value for parameter " + to_string(index + 1));
+	ColumnAttribute::DataType data_type = expected != nullptr ? *expected : hint->data_type;
+	this->preparing->parameter_types[index] = data_type;
+	return Expression::parameter(&this->preparing->parameters, index, data_type);
+}
+
+//A value for every column, each a literal or placeholder of the column's type
+void QueryPlanner::prepare_insert(const InsertStatement* insert, PreparedStatement* prepared) {
+	if (insert->type != InsertStatement::kInsertValues)
+		throw DbRelationError("only INSERT ... VALUES is supported");
+	DbRelation& table = this->catalog.get_table(insert->tableName);
+	const ColumnNames& column_names = table.get_column_names();
+	vector<u_int32_t> positions;
+	vector<bool> given(column_names.size(), false);
+	for (u_int32_t i = 0; insert->columns == NULL && i < column_names.size(); i++)
+		positions.push_back(i);
+	for (u_int32_t i = 0; insert->columns != NULL && i < insert->columns->size(); i++) {
+		auto found = find(column_names.begin(), column_names.end(), (*insert->columns)[i]);
+		if (found == column_names.end())
+			throw DbRelationError(string("unknown column ") + (*insert->columns)[i]);
+		positions.push_back((u_int32_t)(found - column_names.begin()));
+	}
+	for (u_int32_t position : positions)
+		given[position] = true;
+	if (positions.size() != insert->values->size() || find(given.begin(), given.end(), false) != given.end())
+		throw DbRelationError("INSERT needs one value for each column of " + table.get_table_name());
+
+	prepared->table = &table;
+	prepared->values.resize(column_names.size(), nullptr);
+	for (u_int32_t i = 0; i < positions.size(); i++) {
+		ColumnAttribute::DataType data_type = table.get_column_attributes()[positions[i]].get_data_type();
+		Expression* value = compile_as((*insert->values)[i], Scope(), &data_type);
+		prepared->values[positions[i]] = value;  // freed with prepared
+		if (value->get_data_type() != data_type)
+			throw DbRelationError("wrong type of value for column " + column_names[positions[i]]);
+	}
+}
+
+//Tables in the order they are named, with the ON conditions of the joins among the conjuncts
+void QueryPlanner::add_sources(const TableRef* from, Scope& scope, vector<const Expr*>& conjuncts) {
+	switch (from->type) {
+	case kTableName: {
+		DbRelation& table = this->catalog.get_table(from->name);
+		u_int32_t offset = scope.empty() ? 0
+			: scope.back().offset + (u_int32_t)scope.back().table->get_column_names().size();
+		scope.push_back(Source{&table, from->alias, offset});
+		return;
+	}
+	case kTableCrossProduct:
+		for (const TableRef* item : *from->list)
+			add_sources(item, scope, conjuncts);
+		return;
+	case kTableJoin:
+		if (from->join->type != kJoinInner)
+			throw DbRelationError("only inner joins are supported");
+		add_sources(from->join->left, scope, conjuncts);
+		add_sources(from->join->right, scope, conjuncts);
+		if (from->join->condition != NULL)
+			split_conjuncts(from->join->condition, conjuncts);
+		return;
+	default:
+		throw DbRelationError("only tables and joins of them are supported in FROM");
+	}
+}
+
+//The scan and Filter for one table, on their own: the Filter's column positions are the table's
+Operator* QueryPlanner::plan_source(const Source& source, const vector<Equality>& pushed,
+		const vector<const Expr*>& residual, const vector<bool>& used) {
+	Scope scope(1, Source{source.table, source.alias, 0});
+	const ColumnNames& column_names = source.table->get_column_names();
+	ColumnNames columns;
+	for (u_int32_t i = 0; i < column_names.size(); i++)
+		if (used[source.offset + i])
+			columns.push_back(column_names[i]);
+	const ColumnNames* scanned = columns.size() == column_names.size() ? nullptr : &columns;
+	if (this->preparing != nullptr)  // the scan, and which side of a join it goes on, depend on this
+		this->preparing->planned_blocks.push_back(make_pair(source.table, source.table->get_block_count()));
+	TableScan* scan = this->workers > 1 && source.table->get_block_count() >= PARALLEL_BLOCKS
+		? new ParallelScan(*source.table, this->workers, scanned) : new TableScan(*source.table, scanned);
+	Operator* plan = scan;
+	try {
+		for (auto const& equality : pushed) {
+			ColumnAttribute::DataType data_type = column_type(column_position(equality.first, scope), scope);
+			scan->add_where(equality.first->name, compile_as(equality.second, Scope(), &data_type));
+		}
+		if (!residual.empty()) {
+			Expression* predicate = compile_conjunction(residual, scope);
+			plan = nullptr;  // Filter frees scan and predicate if it throws
+			plan = new Filter(scan, predicate);
+		}
+	}
+	catch (...) {
+		delete plan;
+		throw;
+	}
+	return plan;
+}
+
+//A conjunct of the form column = literal (either way around, and of the column's type) or column = placeholder
+//goes to the scan, one per column
+void QueryPlanner::split_where(const Expr* conjunct, const Source& source, vector<Equality>& pushed,
+		vector<const Expr*>& residual) {
+	if (conjunct->type == kExprOperator && conjunct->opType == Expr::SIMPLE_OP && conjunct->opChar == '=') {
+		const Expr* column = conjunct->expr->type == kExprColumnRef ? conjunct->expr : conjunct->expr2;
+		const Expr* value = column == conjunct->expr ? conjunct->expr2 : conjunct->expr;
+		if (column->type == kExprColumnRef && (value->type == kExprLiteralInt || value->type == kExprLiteralString
+				|| value->type == kExprPlaceholder)) {
+			Scope scope(1, Source{source.table, source.alias, 0});
+			ColumnAttribute::DataType data_type = column_type(column_position(column, scope), scope);
+			bool fits = value->type == kExprPlaceholder
+				|| data_type == (value->type == kExprLiteralInt ? ColumnAttribute::INT : ColumnAttribute::TEXT);
+			bool seen = false;
+			for (auto const& equality : pushed)
+				seen = seen || strcmp(equality.first->name, column->name) == 0;
+			if (fits && !seen) {
+				pushed.push_back(make_pair(column, value));
+				return;
+			}
+		}
+	}
+	residual.push_back(conjunct);
+}
+
+//Unknown columns are left for compiling to report
+void QueryPlanner::used_columns(const Expr* expr, const Scope& scope, vector<bool>& used) {
+	if (expr == NULL)
+		return;
+	if (expr->type == kExprStar) {
+		used.assign(used.size(), true);
+		return;
+	}
+	if (is_count_star(expr))
+		return;
+	if (expr->type == kExprColumnRef) {
+		int position = find_column(expr, scope);
+		if (position >= 0)
+			used[position] = true;
+		return;
+	}
+	used_columns(expr->expr, scope, used);
+	used_columns(expr->expr2, scope, used);
+	if (expr->exprList != NULL)
+		for (const Expr* item : *expr->exprList)
+			used_columns(item, scope, used);
+}
@@ -0,0 +1,122 @@
+/**
+ * @file query_planner.h - Turns the parser's SELECT and INSERT statements into plans.
+ * QueryPlanner
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <map>
+#include <utility>
+#include <vector>
+#include "SQLParser.h"
+#include "catalog.h"
+#include "executor.h"
+
+/**
+ * @class QueryPlanner - builds the plan for a statement from its hsql AST
+ *
+ * A SELECT's plan is Limit(Project(Sort(Project(Filter(joins))))), leaving out whatever the
+ * statement doesn't need. Each table of the FROM clause is a TableScan, under a Filter of its own if the WHERE
+ * clause (or an ON condition) has conjuncts about that table alone; conjuncts of the form
+ * column = literal (or placeholder) go into the scan itself, which tests them on the records'
+ * bytes. The tables are then hash joined left to right, each on a column = column conjunct
+ * between it and the tables before it, building on whichever side has fewer blocks. The
+ * conjuncts left over are the top Filter's. Only the columns the statement uses are decoded.
+ * A table of PARALLEL_BLOCKS blocks or more is scanned by a ParallelScan, when the planner has
+ * more than one worker thread to give it, so its rows come up in no particular order. A
+ * PreparedStatement keeps the block counts these choices were made on (see is_stale).
+ * With GROUP BY or aggregates (COUNT, SUM, MIN, MAX) in the select list, the group columns and
+ * the aggregates' arguments are projected, then a HashAggregate takes the place of the first
+ * Project, and what is selected has to be a GROUP BY column or an aggregate. COUNT(*) alone of
+ * one table with no WHERE is a TableCount, which counts the table's records without reading them.
+ * ORDER BY items are positions in the select list, its aliases, or expressions; those not in
+ * it are projected as extra columns for the Sort, and projected away after it. With a LIMIT,
+ * the Sort keeps only the first OFFSET + LIMIT rows.
+ *
+ * Placeholders (?) become the parameters of a PreparedStatement, numbered in the order they
+ * appear. Each takes its type from where it is: the column it is compared with or inserted
+ * into, the other side of a comparison, or INT in arithmetic and logic.
+ */
+class QueryPlanner {
+public:
+	/**
+	 * A table of the FROM clause, and where its columns start in the rows of the join of them all.
+	 */
+	struct Source {
+		DbRelation* table;
+		const char* alias;  // another name column references may qualify its columns with (nullptr for none)
+		u_int32_t offset;
+	};
+	typedef std::vector<Source> Scope;
+
+	static const u_int32_t PARALLEL_BLOCKS = 64;  // smaller tables aren't worth starting threads for
+
+	/**
+	 * @param catalog  where the tables are
+	 * @param workers  threads a ParallelScan may use (1 for none)
+	 */
+	explicit QueryPlanner(Catalog& catalog, u_int32_t workers=ParallelScan::default_workers())
+		: catalog(catalog), workers(workers), preparing(nullptr), placeholders(), hints(nullptr) {}
+	virtual ~QueryPlanner() {}
+	QueryPlanner(const QueryPlanner& other) = delete;
+	QueryPlanner(QueryPlanner&& temp) = delete;
+	QueryPlanner& operator=(const QueryPlanner& other) = delete;
+	QueryPlanner& operator=(QueryPlanner&& temp) = delete;
+
+	/**
+	 * @param statement  a SELECT or INSERT, which may have placeholders
+	 * @param hints      values whose types are the placeholders' where nothing else gives them one (nullptr for none)
+	 * @returns          the statement, planned (freed by caller)
+	 * @throws           DbRelationError for an unknown table or column, a type error (a hint of the wrong
+	 *                   type is one), a placeholder of no known type, or SQL the executor can't run
+	 */
+	virtual PreparedStatement* prepare(const hsql::SQLStatement* statement, const Parameters* hints=nullptr);
+
+	/**
+	 * @param select  a SELECT statement (with placeholders only when called by prepare)
+	 * @returns       its plan, not yet opened (freed by caller)
+	 * @throws        DbRelationError for an unknown table or column, a type error, tables with no
+	 *                column = column condition to join them on, a selected column that isn't
+	 *                grouped by, or SQL the executor can't run yet
+	 */
+	virtual Operator* plan(const hsql::SelectStatement* select);
+
+	/**
+	 * @param expr   an expression from the AST
+	 * @param table  the table its column references are to, whose column positions they get (nullptr for none)
+	 * @param alias  another name the references may qualify columns with (nullptr for none)
+	 * @returns      the compiled expression (freed by caller)
+	 * @throws       DbRelationError for an unknown column, a type error, or an expression the executor can't do
+	 */
+	virtual Expression* compile(const hsql::Expr* expr, DbRelation* table, const char* alias=nullptr) {
+		Scope scope;
+		if (table != nullptr)
+			scope.push_back(Source{table, alias, 0});
+		return compile_as(expr, scope, nullptr);
+	}
+
+protected:
+	typedef std::pair<const hsql::Expr*, const hsql::Expr*> Equality;  // column = literal or placeholder
+
+	Catalog& catalog;
+	u_int32_t workers;
+	PreparedStatement* preparing;                         // while prepare is at work, the statement,
+	std::map<const hsql::Expr*, u_int32_t> placeholders;  // the parameter number of each of its placeholders,
+	const Parameters* hints;                              // and the hints it was given
+
+	virtual Expression* compile_as(const hsql::Expr* expr, const Scope& scope, const ColumnAttribute::DataType* expected);
+	virtual Expression* compile_binary(Expression::Op op, const hsql::Expr* left, const hsql::Expr* right,
+		const Scope& scope);
+	virtual Expression* compile_conjunction(const std::vector<const hsql::Expr*>& conjuncts, const Scope& scope);
+	virtual Expression* parameter(const hsql::Expr* placeholder, const ColumnAttribute::DataType* expected);
+	virtual void prepare_insert(const hsql::InsertStatement* insert, PreparedStatement* prepared);
+	virtual void add_sources(const hsql::TableRef* from, Scope& scope, std::vector<const hsql::Expr*>& conjuncts);
+	virtual Operator* plan_source(const Source& source, const std::vector<Equality>& pushed,
+		const std::vector<const hsql::Expr*>& residual, const std::vector<bool>& used);
+	virtual void split_where(const hsql::Expr* conjunct, const Source& source, std::vector<Equality>& pushed,
+		std::vector<const hsql::Expr*>& residual);
+	virtual void used_columns(const hsql::Expr* expr, const Scope& scope, std::vector<bool>& used);
+	virtual Operator* plan_aggregate(const hsql::SelectStatement* select, const Scope& scope, Operator* input,
+		bool whole_table, ColumnNames& names, std::vector<int>& origins, std::vector<bool>& aliased);
+};
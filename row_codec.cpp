@@ -0,0 +1,309 @@
+/**
+ * @file row_codec.cpp - implementation of the HeapTable record format.
+ * RowCodec
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "row_codec.h"
+#include "text_dictionary.h"
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+static u_int32_t get_u32(const char* p) {
+	u_int32_t n;
+	memcpy(&n, p, sizeof(n));
+	return n;
+}
+
+static void put_u32(char* p, u_int32_t n) {
+	memcpy(p, &n, sizeof(n));
+}
+
+
+/**************************RowCodec Implementation*********************/
+
+RowCodec::RowCodec(const ColumnNames& column_names, const ColumnAttributes& column_attributes)
+	: column_names(column_names), types(), stored(), dictionary(nullptr), offsets(), by_name(), table_start(0),
+	  text_start(0) {
+	for (ColumnAttribute ca : column_attributes) {
+		if (ca.get_data_type() != ColumnAttribute::INT && ca.get_data_type() != ColumnAttribute::TEXT)
+			throw DbRelationError("Only know how to marshal INT and TEXT");
+		this->types.push_back(ca.get_data_type());
+	}
+	this->stored = this->types;
+	lay_out();
+
+	for (u_int32_t column = 0; column < this->column_names.size(); column++)
+		this->by_name.push_back(column);
+	sort(this->by_name.begin(), this->by_name.end(), [this](u_int32_t a, u_int32_t b) {
+		return this->column_names[a] < this->column_names[b];
+	});
+}
+
+//Lay out the INTs (and codes), then the TEXT end-offset table, then room for the TEXT bytes
+void RowCodec::lay_out() {
+	u_int32_t num_ints = 0;
+	for (ColumnAttribute::DataType type : this->stored)
+		if (type == ColumnAttribute::INT)
+			num_ints++;
+	u_int32_t int_offset = 0;
+	this->table_start = num_ints * sizeof(int32_t);
+	u_int32_t text_offset = this->table_start;
+	this->offsets.clear();
+	for (ColumnAttribute::DataType type : this->stored) {
+		u_int32_t &next = type == ColumnAttribute::INT ? int_offset : text_offset;
+		this->offsets.push_back(next);
+		next += sizeof(u_int32_t);
+	}
+	this->text_start = text_offset;
+}
+
+void RowCodec::use_dictionary(TextDictionary* dictionary, const std::vector<u_int32_t>& columns) {
+	this->stored = this->types;
+	this->dictionary = dictionary;
+	if (dictionary != nullptr) {
+		for (u_int32_t column : columns) {
+			if (column >= this->types.size() || this->types[column] != ColumnAttribute::TEXT)
+				throw DbRelationError("only TEXT columns can be dictionary encoded");
+			this->stored[column] = ColumnAttribute::INT;
+		}
+	}
+	lay_out();
+}
+
+u_int32_t RowCodec::code(const std::string& s) const {
+	return this->dictionary->code(RecordView(s.data(), (u_int32_t)s.length()));
+}
+
+int RowCodec::column_index(const Identifier& column_name) const {
+	for (u_int32_t column = 0; column < this->column_names.size(); column++)
+		if (this->column_names[column] == column_name)
+			return (int)column;
+	return -1;
+}
+
+//Walk the row and our name-ordered columns side by side, like a merge, instead of a find() per column
+u_int32_t RowCodec::bind(const ValueDict* row, const Value** values) const {
+	u_int32_t size = this->text_start;
+	ValueDict::const_iterator it = row->begin();
+	for (u_int32_t column : this->by_name) {
+		const Identifier &column_name = this->column_names[column];
+		while (it != row->end() && it->first < column_name)
+			++it;
+		if (it == row->end() || it->first != column_name)
+			throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+		values[column] = &it->second;
+		if (this->stored[column] == ColumnAttribute::TEXT)
+			size += (u_int32_t)it->second.s.length();
+	}
+	return size;
+}
+
+void RowCodec::encode(const Value* const* values, char* bytes) const {
+	u_int32_t end = this->text_start;
+	for (u_int32_t column = 0; column < this->types.size(); column++) {
+		const Value &value = *values[column];
+		if (this->stored[column] != this->types[column]) {
+			u_int32_t n = code(value.s);
+			memcpy(bytes + this->offsets[column], &n, sizeof(n));
+		}
+		else if (this->types[column] == ColumnAttribute::INT) {
+			memcpy(bytes + this->offsets[column], &value.n, sizeof(int32_t));
+		}
+		else {
+			u_int32_t length = (u_int32_t)value.s.length();
+			memcpy(bytes + end, value.s.data(), length); // assume ascii for now
+			end += length;
+			put_u32(bytes + this->offsets[column], end);
+		}
+	}
+}
+
+u_int32_t RowCodec::columns_size(const RecordView* columns) const {
+	u_int32_t size = this->text_start;
+	for (u_int32_t column = 0; column < this->stored.size(); column++)
+		if (this->stored[column] == ColumnAttribute::TEXT)
+			size += columns[column].size;
+	return size;
+}
+
+void RowCodec::encode_columns(const RecordView* columns, char* bytes) const {
+	u_int32_t end = this->text_start;
+	for (u_int32_t column = 0; column < this->types.size(); column++) {
+		const RecordView &value = columns[column];
+		if (this->stored[column] == ColumnAttribute::INT) {
+			memcpy(bytes + this->offsets[column], value.data, sizeof(int32_t));
+		}
+		else {
+			memcpy(bytes + end, value.data, value.size);
+			end += value.size;
+			put_u32(bytes + this->offsets[column], end);
+		}
+	}
+}
+
+u_int32_t RowCodec::size(const ValueDict* row) const {
+	vector<const Value*> values(this->types.size());
+	return bind(row, values.data());
+}
+
+void RowCodec::encode(const ValueDict* row, char* bytes) const {
+	vector<const Value*> values(this->types.size());
+	bind(row, values.data());
+	encode(values.data(), bytes);
+}
+
+//Same merge walk as bind(), copying the values instead of pointing at them
+void RowCodec::to_row(const ValueDict* row, Row& values) const {
+	values.resize(get_num_columns());
+	values.clear();
+	ValueDict::const_iterator it = row->begin();
+	for (u_int32_t column : this->by_name) {
+		const Identifier &column_name = this->column_names[column];
+		while (it != row->end() && it->first < column_name)
+			++it;
+		if (it == row->end() || it->first != column_name)
+			throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+		if (this->types[column] == ColumnAttribute::INT)
+			values.set_int(column, it->second.n);
+		else
+			values.set_text(column, it->second.s);
+	}
+}
+
+ValueDict* RowCodec::to_dict(const Row& row) const {
+	ValueDict* values = new ValueDict();
+	for (u_int32_t column : this->by_name)
+		values->emplace_hint(values->end(), this->column_names[column], row.get(column));
+	return values;
+}
+
+void RowCodec::check(const Row& row) const {
+	if (row.size() != get_num_columns())
+		throw DbRelationError("row has " + to_string(row.size()) + " columns, table has " + to_string(get_num_columns()));
+	for (u_int32_t column = 0; column < row.size(); column++)
+		if (row.get_data_type(column) != this->types[column])
+			throw DbRelationError("wrong type of value for column " + this->column_names[column]);
+}
+
+u_int32_t RowCodec::size(const Row& row) const {
+	u_int32_t size = this->text_start;
+	for (u_int32_t column = 0; column < this->stored.size(); column++)
+		if (this->stored[column] == ColumnAttribute::TEXT)
+			size += row.get_text(column).size;
+	return size;
+}
+
+void RowCodec::encode(const Row& row, char* bytes) const {
+	u_int32_t end = this->text_start;
+	for (u_int32_t column = 0; column < this->types.size(); column++) {
+		if (this->stored[column] != this->types[column]) {
+			u_int32_t n = this->dictionary->code(row.get_text(column));
+			memcpy(bytes + this->offsets[column], &n, sizeof(n));
+		}
+		else if (this->types[column] == ColumnAttribute::INT) {
+			int32_t n = row.get_int(column);
+			memcpy(bytes + this->offsets[column], &n, sizeof(int32_t));
+		}
+		else {
+			RecordView text = row.get_text(column);
+			memcpy(bytes + end, text.data, text.size);
+			end += text.size;
+			put_u32(bytes + this->offsets[column], end);
+		}
+	}
+}
+
+//Values go in in name order so every insert lands at the end of the map
+ValueDict* RowCodec::decode(const RecordView& data) const {
+	ValueDict* row = new ValueDict();
+	for (u_int32_t column : this->by_name)
+		row->emplace_hint(row->end(), this->column_names[column], decode_column(data, column));
+	return row;
+}
+
+void RowCodec::decode(const RecordView& data, Row& row) const {
+	row.resize(get_num_columns());
+	row.clear();
+	for (u_int32_t column = 0; column < this->types.size(); column++)
+		decode_value(column_bytes(data, column), column, row);
+}
+
+void RowCodec::decode_value(const RecordView& bytes, u_int32_t column, Row& row) const {
+	if (this->types[column] == ColumnAttribute::INT) {
+		int32_t n;
+		memcpy(&n, bytes.data, sizeof(n));
+		row.set_int(column, n);
+	}
+	else {
+		RecordView text = value_bytes(bytes, column);
+		row.set_text(column, text.data, text.size);
+	}
+}
+
+Value RowCodec::decode_column(const RecordView& data, u_int32_t column) const {
+	return decode_value(column_bytes(data, column), column);
+}
+
+Value RowCodec::decode_value(const RecordView& bytes, u_int32_t column) const {
+	if (this->types[column] == ColumnAttribute::INT) {
+		int32_t n;
+		memcpy(&n, bytes.data, sizeof(n));
+		return Value(n);
+	}
+	RecordView text = value_bytes(bytes, column);
+	return Value(string(text.data, text.size));
+}
+
+RecordView RowCodec::value_bytes(const RecordView& bytes, u_int32_t column) const {
+	if (this->stored[column] == this->types[column])
+		return bytes;
+	u_int32_t n;
+	memcpy(&n, bytes.data, sizeof(n));
+	return this->dictionary->text(n);
+}
+
+//A TEXT column starts where the one before it in the offset table ends
+RecordView RowCodec::column_bytes(const RecordView& data, u_int32_t column) const {
+	u_int32_t offset = this->offsets[column];
+	if (this->stored[column] == ColumnAttribute::INT)
+		return RecordView(data.data + offset, sizeof(int32_t));
+	u_int32_t start = offset == this->table_start ? this->text_start : get_u32(data.data + offset - sizeof(u_int32_t));
+	return RecordView(data.data + start, get_u32(data.data + offset) - start);
+}
+
+//Encode each value the way the column stores it, so matching is a memcmp
+RowFilter RowCodec::compile_filter(const ValueDict* where) const {
+	RowFilter filter;
+	for (auto const& test : *where) {
+		int column = column_index(test.first);
+		if (column < 0)
+			throw DbRelationError("unknown column " + test.first);
+		if (test.second.data_type != this->types[column])
+			throw DbRelationError("wrong type of value for column " + test.first);
+		ColumnEquals equals;
+		equals.column = (u_int32_t)column;
+		if (test.second.data_type == ColumnAttribute::INT) {
+			equals.bytes.assign((const char*)&test.second.n, sizeof(int32_t));
+		}
+		else if (this->stored[column] == ColumnAttribute::INT) {  // NO_CODE for a string never stored: matches nothing
+			u_int32_t n = this->dictionary->find(RecordView(test.second.s.data(), (u_int32_t)test.second.s.length()));
+			equals.bytes.assign((const char*)&n, sizeof(n));
+		}
+		else {
+			equals.bytes = test.second.s;
+		}
+		filter.push_back(equals);
+	}
+	return filter;
+}
+
+bool RowCodec::matches(const RecordView& data, const RowFilter& filter) const {
+	for (auto const& equals : filter) {
+		RecordView bytes = column_bytes(data, equals.column);
+		if (bytes.size != equals.bytes.size() || memcmp(bytes.data, equals.bytes.data(), bytes.size) != 0)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,229 @@
+/**
+ * @file row_codec.h - Record format for HeapTable rows, compiled once from the table's columns.
+ * RowCodec
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include "storage_engine.h"
+
+class TextDictionary;
+
+/**
+ * @class ColumnEquals - one "column = value" test, compiled to the value's encoded bytes
+ */
+struct ColumnEquals {
+	u_int32_t column;
+	std::string bytes;
+};
+typedef std::vector<ColumnEquals> RowFilter;  // all of them have to hold (empty passes everything)
+
+/**
+ * @class RowCodec - marshals rows to and from their bytes in a block
+ *
+ * A record is laid out as:
+ *     the INT columns, 4 bytes each, in column order
+ *     for each TEXT column, a 4-byte offset (from the start of the record) to the end of its bytes
+ *     the TEXT columns' bytes, back to back in column order
+ * so every column's position is known from the schema plus at most two offset-table lookups,
+ * and a single column can be read without decoding the ones before it.
+ *
+ * Encoding is split in two so a caller can size the record, reserve exactly that much room in
+ * a block, and then encode straight into it: bind() finds each column's Value (one pass over the
+ * ValueDict, which is in name order like the codec's own lookup table) and returns the size,
+ * and encode() writes the bound values.
+ *
+ * TEXT columns can be dictionary encoded (use_dictionary): such a column is stored as its
+ * 4-byte code among the INTs, and its column_bytes() are the code, so equality tests compare
+ * codes. Values still go in and come out as strings.
+ */
+class RowCodec {
+public:
+	RowCodec(const ColumnNames& column_names, const ColumnAttributes& column_attributes);
+	virtual ~RowCodec() {}
+	RowCodec(const RowCodec& other) = delete;
+	RowCodec(RowCodec&& temp) = delete;
+	RowCodec& operator=(const RowCodec& other) = delete;
+	RowCodec& operator=(RowCodec&& temp) = delete;
+
+	u_int32_t get_num_columns() const {return (u_int32_t)column_names.size();}
+	const Identifier& get_column_name(u_int32_t column) const {return column_names[column];}
+	ColumnAttribute::DataType get_data_type(u_int32_t column) const {return types[column];}
+
+	/**
+	 * @param column  which column, by position
+	 * @returns       how its bytes are stored: INT for a dictionary-encoded TEXT column
+	 */
+	ColumnAttribute::DataType get_stored_type(u_int32_t column) const {return stored[column];}
+
+	/**
+	 * Store the given TEXT columns as codes from a dictionary (or, with nullptr, none of them).
+	 * Changes the record format, so only for a table that's empty or was always encoded this way.
+	 * @param dictionary  codes for the strings, not owned
+	 * @param columns     positions of the TEXT columns to encode
+	 * @throws            DbRelationError if one of them isn't a TEXT column
+	 */
+	void use_dictionary(TextDictionary* dictionary, const std::vector<u_int32_t>& columns);
+
+	/**
+	 * @param column_name  name of a column
+	 * @returns            its position in the table, or -1 if the table has no such column
+	 */
+	int column_index(const Identifier& column_name) const;
+
+	/**
+	 * Find the value for each column of a row.
+	 * @param row     the row to encode (extra entries are ignored)
+	 * @param values  room for get_num_columns() pointers, set to the row's values in column order
+	 * @returns       size of the encoded record
+	 * @throws        DbRelationError if a column is missing
+	 */
+	u_int32_t bind(const ValueDict* row, const Value** values) const;
+
+	/**
+	 * Write a record from values found by bind().
+	 * @param values  as set by bind()
+	 * @param bytes   room for the size bind() returned
+	 */
+	void encode(const Value* const* values, char* bytes) const;
+
+	/**
+	 * @param row  the row to encode
+	 * @returns    size of its encoded record
+	 */
+	u_int32_t size(const ValueDict* row) const;
+
+	/**
+	 * bind() and encode() in one go.
+	 * @param row    the row to encode
+	 * @param bytes  room for size(row)
+	 */
+	void encode(const ValueDict* row, char* bytes) const;
+
+	/**
+	 * Copy a ValueDict's values into a Row (the ValueDict to Row adapter).
+	 * @param row     the row (extra entries are ignored)
+	 * @param values  resized to get_num_columns() and set
+	 * @throws        DbRelationError if a column is missing
+	 */
+	void to_row(const ValueDict* row, Row& values) const;
+
+	/**
+	 * @param row  a row of this table
+	 * @returns    its values keyed by column name (freed by caller)
+	 */
+	ValueDict* to_dict(const Row& row) const;
+
+	/**
+	 * @param row  a row to be encoded
+	 * @throws     DbRelationError if it doesn't have this table's columns and types
+	 */
+	void check(const Row& row) const;
+
+	/**
+	 * @param row  a row of this table
+	 * @returns    size of its encoded record
+	 */
+	u_int32_t size(const Row& row) const;
+
+	/**
+	 * @param row    a row of this table
+	 * @param bytes  room for size(row)
+	 */
+	void encode(const Row& row, char* bytes) const;
+
+	/**
+	 * @param columns  each column's encoded bytes (as from column_bytes), in column order
+	 * @returns        size of the record they make up
+	 */
+	u_int32_t columns_size(const RecordView* columns) const;
+
+	/**
+	 * Put a record back together from its columns' bytes.
+	 * @param columns  each column's encoded bytes (as from column_bytes), in column order
+	 * @param bytes    room for columns_size(columns)
+	 */
+	void encode_columns(const RecordView* columns, char* bytes) const;
+
+	/**
+	 * @returns  size of a record before its TEXT bytes (INTs and the TEXT offset table)
+	 */
+	u_int32_t get_fixed_size() const {return text_start;}
+
+	/**
+	 * @param data  an encoded record
+	 * @returns     all of its columns (freed by caller)
+	 */
+	ValueDict* decode(const RecordView& data) const;
+
+	/**
+	 * @param data  an encoded record
+	 * @param row   resized to get_num_columns() and set to all of its columns
+	 */
+	void decode(const RecordView& data, Row& row) const;
+
+	/**
+	 * @param bytes   one column's encoded bytes, wherever they are (as from column_bytes)
+	 * @param column  which column they belong to
+	 * @param row     gets the value at that column's position
+	 */
+	void decode_value(const RecordView& bytes, u_int32_t column, Row& row) const;
+
+	/**
+	 * @param data    an encoded record
+	 * @param column  which column, by position
+	 * @returns       that column's value
+	 */
+	Value decode_column(const RecordView& data, u_int32_t column) const;
+
+	/**
+	 * @param bytes   one column's encoded bytes, wherever they are (as from column_bytes)
+	 * @param column  which column they belong to
+	 * @returns       the value
+	 */
+	Value decode_value(const RecordView& bytes, u_int32_t column) const;
+
+	/**
+	 * @param data    an encoded record
+	 * @param column  which column, by position
+	 * @returns       where that column's bytes are within the record (4 bytes for an INT)
+	 */
+	RecordView column_bytes(const RecordView& data, u_int32_t column) const;
+
+	/**
+	 * @param bytes   one column's encoded bytes (as from column_bytes)
+	 * @param column  which column they belong to
+	 * @returns       the value's own bytes: the string for a dictionary-encoded column, else bytes
+	 */
+	RecordView value_bytes(const RecordView& bytes, u_int32_t column) const;
+
+	/**
+	 * Compile a WHERE clause of column = value pairs into byte comparisons.
+	 * @param where  column name to the value it has to equal
+	 * @returns      the filter for matches()
+	 * @throws       DbRelationError for an unknown column or a value of the wrong type
+	 */
+	RowFilter compile_filter(const ValueDict* where) const;
+
+	/**
+	 * @param data    an encoded record
+	 * @param filter  as from compile_filter()
+	 * @returns       true if the record satisfies every test, looking only at the columns tested
+	 */
+	bool matches(const RecordView& data, const RowFilter& filter) const;
+
+protected:
+	ColumnNames column_names;
+	std::vector<ColumnAttribute::DataType> types;
+	std::vector<ColumnAttribute::DataType> stored;   // types, with INT for dictionary-encoded TEXT
+	TextDictionary* dictionary;
+	std::vector<u_int32_t> offsets;  // INT: where it is; TEXT: where its end offset is
+	std::vector<u_int32_t> by_name;  // column positions in name (ValueDict) order
+	u_int32_t table_start;           // where the TEXT end-offset table is
+	u_int32_t text_start;            // where the first TEXT column's bytes go
+	void lay_out();
+	u_int32_t code(const std::string& s) const;
+};
@@ -7,12 +7,19 @@
 #include <stdlib.h>
 #include <cstring>
 #include <iostream>
+#include <map>
 #include <string>
 #include <cassert>
 #include "db_cxx.h"
 #include "SQLParser.h"
 #include "sqlhelper.h"
 #include "heap_storage.h"
+#include "buffer_pool.h"
+#include "arena.h"
+#include "catalog.h"
+#include "executor.h"
+#include "query_planner.h"
+#include "plan_cache.h"
 using namespace std;
 using namespace hsql;
 
@@ -21,6 +28,18 @@ using namespace hsql;
  */
 DbEnv* _DB_ENV;
 
+/*
+ * the tables made with CREATE TABLE (opened in main, once the environment is)
+ */
+static Catalog* catalog = nullptr;
+
+/*
+ * plans for statements seen before but for their literals, and the statements made with PREPARE
+ * (all of them let go of before the catalog is closed)
+ */
+static PlanCache* plans = nullptr;
+static map<string, PreparedStatement*> prepared_statements;
+
 // forward declare
 string operatorExpressionToString(const Expr* expr);
 
@@ -48,7 +67,7 @@ string expressionToString(const Expr *expr) {
 		ret += to_string(expr->ival);
 		break;
 	case kExprFunctionRef:
-		ret += string(expr->name) + "?" + expr->expr->name;
+		ret += string(expr->name) + "(" + expressionToString(expr->expr) + ")";
 		break;
 	case kExprOperator:
 		ret += operatorExpressionToString(expr);
@@ -178,68 +197,186 @@ string columnDefinitionToString(const ColumnDefinition *col) {
 }
 
 /**
- * Execute an SQL select statement (but for now, just spit back the SQL)
- * @param stmt  Hyrise AST for the select statement
- * @returns     a string (for now) of the SQL statment
+ * Print the rows of a plan as it hands them back, a batch at a time
+ * @param plan  plan to run
+ * @returns     how many rows it handed back
  */
-string executeSelect(const SelectStatement *stmt) {
-	string ret("SELECT ");
-	bool doComma = false;
-	for (Expr* expr : *stmt->selectList) {
-		if(doComma)
-			ret += ", ";
-		ret += expressionToString(expr);
-		doComma = true;
+u_int64_t printRows(Operator* plan) {
+	const ColumnNames& column_names = plan->get_column_names();
+	const ColumnAttributes& column_attributes = plan->get_column_attributes();
+	for (auto const& column_name : column_names)
+		cout << column_name << " ";
+	cout << endl << "+";
+	for (size_t i = 0; i < column_names.size(); i++)
+		cout << "----------+";
+	cout << endl;
+
+	u_int64_t count = 0;
+	RowBatch batch;
+	plan->open();
+	while (plan->next(batch)) {
+		for (u_int32_t i = 0; i < batch.size; i++) {
+			const Row& row = batch.rows[i];
+			for (u_int32_t column = 0; column < column_names.size(); column++) {
+				if (column_attributes[column].get_data_type() == ColumnAttribute::INT) {
+					cout << row.get_int(column) << " ";
+				}
+				else {
+					RecordView text = row.get_text(column);
+					cout << "\"";
+					cout.write(text.data, text.size);
+					cout << "\" ";
+				}
+			}
+			cout << "\n";
+		}
+		count += batch.size;
 	}
-	ret += " FROM " + tableRefInfoToString(stmt->fromTable);
-	if (stmt->whereClause != NULL)
-		ret += " WHERE " + expressionToString(stmt->whereClause);
+	plan->close();
+	return count;
+}
+
+/**
+ * Run a prepared statement with the parameters it has been bound to, streaming a SELECT's rows to the shell
+ * @param prepared  the statement
+ * @returns         how many rows it returned or inserted
+ */
+string runPrepared(PreparedStatement* prepared) {
+	if (prepared->is_select())
+		return "successfully returned " + to_string(printRows(prepared->plan)) + " rows";
+	prepared->insert();
+	return "successfully inserted 1 row into " + prepared->table->get_table_name();
+}
+
+/**
+ * Execute an SQL select or insert statement (INSERT INTO ... VALUES, with a value for every column)
+ * @param stmt  Hyrise AST for the statement
+ * @returns     what the statement did
+ */
+string executePlanned(const SQLStatement *stmt) {
+	QueryPlanner planner(*catalog);
+	PreparedStatement* prepared = planner.prepare(stmt);
+	string ret;
+	try {
+		prepared->bind(Parameters());
+		ret = runPrepared(prepared);
+	}
+	catch (...) {
+		delete prepared;
+		throw;
+	}
+	delete prepared;
 	return ret;
 }
 
 /**
- * Execute an SQL insert statement (but for now, just spit back the SQL)
- * @param stmt  Hyrise AST for the insert statement
- * @returns     a string (for now) of the SQL statment
+ * Execute an SQL prepare statement (PREPARE name: statement, with ? for its parameters)
+ * @param stmt  Hyrise AST for the prepare statement
+ * @returns     what was prepared
  */
-string executeInsert(const InsertStatement *stmt) {
-	return "INSERT ...";
+string executePrepare(const PrepareStatement *stmt) {
+	if (stmt->query == NULL || stmt->query->size() != 1)
+		throw DbRelationError("PREPARE takes a single statement");
+	QueryPlanner planner(*catalog);
+	PreparedStatement* prepared = planner.prepare(stmt->query->getStatement(0));
+	auto found = prepared_statements.find(stmt->name);
+	if (found != prepared_statements.end())
+		delete found->second;
+	prepared_statements[stmt->name] = prepared;
+	return string("prepared ") + stmt->name + " with " + to_string(prepared->parameter_types.size()) + " parameters";
 }
 
 /**
- * Execute an SQL create statement (but for now, just spit back the SQL)
+ * Execute an SQL execute statement (EXECUTE name, or EXECUTE name(value, ...) with a value for each parameter)
+ * @param stmt  Hyrise AST for the execute statement
+ * @returns     what the prepared statement did
+ */
+string executeExecute(const ExecuteStatement *stmt) {
+	auto found = prepared_statements.find(stmt->name);
+	if (found == prepared_statements.end())
+		throw DbRelationError(string("no prepared statement named ") + stmt->name);
+	QueryPlanner planner(*catalog);
+	Parameters parameters;
+	Row none;
+	for (u_int32_t i = 0; stmt->parameters != NULL && i < stmt->parameters->size(); i++) {
+		Expression* value = planner.compile((*stmt->parameters)[i], nullptr);
+		parameters.push_back(value->get(none));
+		delete value;
+	}
+	found->second->bind(parameters);
+	return runPrepared(found->second);
+}
+
+/**
+ * Execute a SELECT or INSERT on the plan made for the first statement of its shape (see PlanCache)
+ * @param query  the statement as typed
+ * @param ret    what the statement did, if it was run
+ * @returns      false if it has to go the usual way: it isn't one the cache takes, or its shape
+ *               can't be planned (so the usual way reports why)
+ */
+bool executeCached(const string& query, string& ret) {
+	string shape;
+	Parameters literals;
+	if (!PlanCache::normalize(query, shape, literals))
+		return false;
+	string key = PlanCache::key(shape, literals);
+	PreparedStatement* prepared = plans->find(key);
+	if (prepared == nullptr) {
+		SQLParserResult* result = SQLParser::parseSQLString(shape);
+		try {
+			if (result->isValid() && result->size() == 1) {
+				QueryPlanner planner(*catalog);
+				prepared = planner.prepare(result->getStatement(0), &literals);
+			}
+		}
+		catch (DbRelationError& e) {}
+		delete result;
+		if (prepared == nullptr)
+			return false;
+		plans->add(key, prepared);
+	}
+	prepared->bind(literals);
+	ret = runPrepared(prepared);
+	return true;
+}
+
+/**
+ * Execute an SQL create statement (CREATE TABLE, with INT and TEXT columns)
  * @param stmt  Hyrise AST for the create statement
- * @returns     a string (for now) of the SQL statment
+ * @returns     what was created
  */
 string executeCreate(const CreateStatement *stmt) {
-	string ret("CREATE TABLE ");
-	if (stmt->type != CreateStatement::kTable )
-		return ret + "...";
-	if (stmt->ifNotExists)
-		ret += "IF NOT EXISTS ";
-	ret += string(stmt->tableName) + " (";
-	bool doComma = false;
+	if (stmt->type != CreateStatement::kTable)
+		return "only CREATE TABLE is implemented";
+	ColumnNames column_names;
+	ColumnAttributes column_attributes;
 	for (ColumnDefinition *col : *stmt->columns) {
-		if(doComma)
-			ret += ", ";
-		ret += columnDefinitionToString(col);
-		doComma = true;
+		if (col->type != ColumnDefinition::INT && col->type != ColumnDefinition::TEXT)
+			throw DbRelationError("unsupported type: " + columnDefinitionToString(col));
+		column_names.push_back(col->name);
+		column_attributes.push_back(ColumnAttribute(col->type == ColumnDefinition::INT ? ColumnAttribute::INT
+			: ColumnAttribute::TEXT));
 	}
-	ret += ")";
-	return ret;
+	if (stmt->ifNotExists && catalog->has_table(stmt->tableName))
+		return string("table ") + stmt->tableName + " already exists";
+	catalog->create_table(stmt->tableName, column_names, column_attributes);
+	return string("created ") + stmt->tableName;
 }
 
 /**
- * Execute an SQL statement (but for now, just spit back the SQL)
+ * Execute an SQL statement
  * @param stmt  Hyrise AST for the statement
- * @returns     a string (for now) of the SQL statment
+ * @returns     what the statement did
  */
 string execute(const SQLStatement *stmt) {
 	switch (stmt->type()) {
 	case kStmtSelect:
-		return executeSelect((const SelectStatement*) stmt);
 	case kStmtInsert:
-		return executeInsert((const InsertStatement*) stmt);
+		return executePlanned(stmt);
+	case kStmtPrepare:
+		return executePrepare((const PrepareStatement*) stmt);
+	case kStmtExecute:
+		return executeExecute((const ExecuteStatement*) stmt);
 	case kStmtCreate:
 		return executeCreate((const CreateStatement*) stmt);
 	default:
@@ -247,6 +384,31 @@ string execute(const SQLStatement *stmt) {
 	}
 }
 
+/**
+ * Report the storage engine's counters (buffer pool, page maintenance, statement memory and plan cache)
+ * @returns  a few lines of stats for the shell
+ */
+string storageStats() {
+	BufferPool &pool = BufferPool::instance();
+	u_int64_t requests = pool.get_hits() + pool.get_misses();
+	string ret("buffer pool: " + to_string(pool.get_num_frames()) + " frames, ");
+	ret += to_string(pool.get_hits()) + " hits, " + to_string(pool.get_misses()) + " misses";
+	if (requests > 0)
+		ret += " (" + to_string(100 * pool.get_hits() / requests) + "% hit rate)";
+	ret += ", " + to_string(pool.get_evictions()) + " evictions, " + to_string(pool.get_writes()) + " writes\n";
+	ret += "slotted pages: " + to_string(SlottedPage::compactions) + " compactions, ";
+	ret += to_string(SlottedPage::compactions_avoided) + " compactions avoided\n";
+	ret += "statement memory: last " + to_string(StatementArena::last_peak) + " bytes peak in ";
+	ret += to_string(StatementArena::last_allocations) + " allocations, ";
+	ret += "largest " + to_string(StatementArena::max_peak) + " bytes peak\n";
+	u_int64_t lookups = plans->get_hits() + plans->get_misses();
+	ret += "plan cache: " + to_string(plans->size()) + " plans, " + to_string(plans->get_hits()) + " hits, ";
+	ret += to_string(plans->get_misses()) + " misses";
+	if (lookups > 0)
+		ret += " (" + to_string(100 * plans->get_hits() / lookups) + "% hit rate)";
+	return ret;
+}
+
 /**
  * Main entry point of the sql5300 program
  * @args dbenvpath  the path to the BerkeleyDB database environment
@@ -264,12 +426,18 @@ int main(int argc, char *argv[]) {
 	env.set_message_stream(&cout);
 	env.set_error_stream(&cerr);
 	try {
-		env.open(envHome, DB_CREATE | DB_INIT_MPOOL, 0);
+		env.open(envHome, DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);  // parallel scans share table handles
 	} catch (DbException& exc) {
 		cerr << "(sql5300: " << exc.what() << ")";
 		exit(1);
 	}
 	_DB_ENV = &env;
+	Arena statement_memory;  // reused by every statement, released after each one
+	Catalog tables;          // closed before the environment is
+	tables.open();
+	catalog = &tables;
+	PlanCache cache;         // deleted before the catalog is
+	plans = &cache;
 
 	// Enter the SQL shell loop
 	while (true) {
@@ -282,6 +450,40 @@ int main(int argc, char *argv[]) {
 			break;  // only way to get out
 		if (query == "test") {
 			cout << "test_heap_storage: " << (test_heap_storage() ? "ok" : "failed") << endl;
+			cout << "test_executor: " << (test_executor() ? "ok" : "failed") << endl;
+			cout << "test_plan_cache: " << (test_plan_cache() ? "ok" : "failed") << endl;
+			continue;
+		}
+		if (query == "bench") {
+			bench_heap_storage();
+			bench_executor();
+			bench_join();
+			bench_sort();
+			bench_aggregate();
+			bench_parallel_scan();
+			continue;
+		}
+		if (query == "stats") {
+			cout << storageStats() << endl;
+			continue;
+		}
+		if (query == "checkpoint") {
+			BufferPool::instance().checkpoint();
+			cout << "checkpoint ok" << endl;
+			continue;
+		}
+
+		// a SELECT or INSERT like one seen before runs on the plan made then, without parsing
+		try {
+			StatementArena statement(statement_memory);
+			string ret;
+			if (executeCached(query, ret)) {
+				cout << ret << endl;
+				continue;
+			}
+		}
+		catch (DbRelationError& e) {
+			cout << "Error: DbRelationError: " << e.what() << endl;
 			continue;
 		}
 
@@ -293,12 +495,21 @@ int main(int argc, char *argv[]) {
 			continue;
 		}
 
-		// execute the statement
+		// execute the statement, its temporaries all coming from (and going back to) the arena
 		for (uint i = 0; i < result->size(); ++i) {
-			cout << execute(result->getStatement(i)) << endl;
+			StatementArena statement(statement_memory);
+			try {
+				cout << execute(result->getStatement(i)) << endl;
+			}
+			catch (DbRelationError& e) {
+				cout << "Error: DbRelationError: " << e.what() << endl;
+			}
 		}
 		delete result;
 	}
+	for (auto const& prepared : prepared_statements)
+		delete prepared.second;
+	prepared_statements.clear();
 	return EXIT_SUCCESS;
 }
 
@@ -9,11 +9,14 @@
  */
 #pragma once
 
+#include <cstring>
 #include <exception>
 #include <map>
+#include <string>
 #include <utility>
 #include <vector>
 #include "db_cxx.h"
+#include "arena.h"
 
 /**
  * Global variable to hold dbenv.
@@ -25,9 +28,24 @@ extern DbEnv* _DB_ENV;
  */
 typedef u_int16_t RecordID;
 typedef u_int32_t BlockID;
-typedef std::vector<RecordID> RecordIDs;
+typedef std::vector<RecordID, ArenaAllocator<RecordID>> RecordIDs;  // from the statement's Arena, if any
 typedef std::length_error DbBlockNoRoomError;
 
+/**
+ * @class RecordView - non-owning window onto a record's bytes inside a block
+ *
+ * Cheap to copy and meant to live on the stack. Only valid while the block it
+ * came from stays in memory and unchanged.
+ */
+struct RecordView {
+	const char* data;
+	u_int32_t size;
+
+	RecordView() : data(nullptr), size(0) {}
+	RecordView(const char* data, u_int32_t size) : data(data), size(size) {}
+	bool is_null() const {return data == nullptr;}
+};
+
 /**
  * @class DbBlock - abstract base class for blocks in our database files 
  * (DbBlock's belong to DbFile's.)
@@ -47,10 +65,24 @@ typedef std::length_error DbBlockNoRoomError;
 class DbBlock {
 public:
 	/**
-	 * our blocks are 4kB
+	 * our blocks are 4kB unless the file was created with a different size
 	 */ 
 	static const uint BLOCK_SZ = 4096;
 
+	/**
+	 * biggest block size a file can be created with (1MB)
+	 */
+	static const uint MAX_BLOCK_SZ = 1 << 20;
+
+	/**
+	 * Check a requested block size: a power of two from BLOCK_SZ up to MAX_BLOCK_SZ.
+	 * @param block_sz  proposed block size in bytes
+	 * @returns         true if files can use it
+	 */
+	static bool valid_block_size(u_int32_t block_sz) {
+		return block_sz >= BLOCK_SZ && block_sz <= MAX_BLOCK_SZ && (block_sz & (block_sz - 1)) == 0;
+	}
+
 	/**
 	 * ctor/dtor (subclasses should handle the big-5)
 	 */ 
@@ -98,6 +130,19 @@ public:
 	 */ 
 	virtual RecordIDs* ids() = 0;
 
+	/**
+	 * Walk the live record ids in this block one at a time without building a list.
+	 * @param prev  the record id returned last time (0 to start from the beginning)
+	 * @returns     the next non-deleted record id after prev, or 0 if there are no more
+	 */
+	virtual RecordID next_id(RecordID prev=0) = 0;
+
+	/**
+	 * How much room is left in this block.
+	 * @returns  the size of the largest record that add() could take right now
+	 */
+	virtual u_int32_t free_space() = 0;
+
 	/**
 	 * Access the whole block's memory as a BerkeleyDB Dbt pointer.
 	 * @returns  Dbt used by this block
@@ -122,7 +167,27 @@ protected:
 };
 
 // convenience type alias
-typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an iterator at some point
+typedef std::vector<BlockID> BlockIDs;  // materialized form of a BlockCursor -- prefer the cursor for big files
+
+/**
+ * @class BlockCursor - lazy walk over the BlockIDs of a DbFile
+ *
+ * Usage:
+ *	BlockID block_id;
+ *	while (cursor->next(block_id))
+ *		...
+ */
+class BlockCursor {
+public:
+	virtual ~BlockCursor() {}
+
+	/**
+	 * Advance to the next block.
+	 * @param block_id  set to the next BlockID when there is one
+	 * @returns         false once the cursor is exhausted
+	 */
+	virtual bool next(BlockID &block_id) = 0;
+};
 
 /**
  * @class DbFile - abstract base class which represents a disk-based collection of DbBlocks
@@ -134,6 +199,7 @@ typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an
  *	get(block_id)
  *	put(block)
  *	block_ids()
+ *	block_cursor()
  */
 class DbFile {
 public:
@@ -182,11 +248,18 @@ public:
 
 	/**
 	 * Get a list of all the valid BlockID's in the file
-	 * FIXME - not a good long-term approach, but we'll do this until we put in iterators
+	 * Materializes the whole list -- use block_cursor() for big files.
 	 * @returns  a pointer to vector of BlockIDs (freed by caller)
 	 */ 
 	virtual BlockIDs* block_ids() = 0;
 
+	/**
+	 * Get a cursor over all the valid BlockID's in the file.
+	 * Uses constant memory regardless of the size of the file.
+	 * @returns  a pointer to a new BlockCursor (freed by caller)
+	 */
+	virtual BlockCursor* block_cursor() = 0;
+
 protected:
 	std::string name;  // filename (or part of it)
 };
@@ -204,7 +277,7 @@ public:
 	ColumnAttribute(DataType data_type) : data_type(data_type) {}
 	virtual ~ColumnAttribute() {}
 
-	virtual DataType get_data_type() { return data_type; }
+	virtual DataType get_data_type() const { return data_type; }
 	virtual void set_data_type(DataType data_type) {this->data_type = data_type;}
 
 protected:
@@ -231,8 +304,103 @@ typedef std::string Identifier;
 typedef std::vector<Identifier> ColumnNames;
 typedef std::vector<ColumnAttribute> ColumnAttributes;
 typedef std::pair<BlockID, RecordID> Handle;
-typedef std::vector<Handle> Handles;  // FIXME: will need to turn this into an iterator at some point
-typedef std::map<Identifier, Value> ValueDict;
+typedef std::vector<Handle, ArenaAllocator<Handle>>
+	Handles;  // materialized form of a HandleCursor, from the statement's Arena if any -- prefer the cursor for big tables
+typedef std::map<Identifier, Value, std::less<Identifier>, ArenaAllocator<std::pair<const Identifier, Value>>>
+	ValueDict;  // nodes from the statement's Arena, if any
+typedef std::vector<ValueDict> ValueDicts;
+
+/**
+ * @class ColumnVector - one column's values for every row of a ColumnBatch
+ *
+ * INTs are in ints. TEXTs are back to back in text, row r's being text_sizes[r] bytes
+ * from text_offsets[r], so a column of strings takes a few allocations, not one per row.
+ */
+class ColumnVector {
+public:
+	Identifier column_name;
+	ColumnAttribute::DataType data_type;
+	std::vector<int32_t> ints;
+	std::string text;
+	std::vector<u_int32_t> text_offsets;
+	std::vector<u_int32_t> text_sizes;
+
+	ColumnVector(const Identifier& column_name, ColumnAttribute::DataType data_type)
+		: column_name(column_name), data_type(data_type), ints(), text(), text_offsets(), text_sizes() {}
+
+	/**
+	 * @param row  which row of the batch
+	 * @returns    its value in this column
+	 */
+	Value get(size_t row) const {
+		if (data_type == ColumnAttribute::INT)
+			return Value(ints[row]);
+		return Value(text.substr(text_offsets[row], text_sizes[row]));
+	}
+};
+
+/**
+ * @class ColumnBatch - rows handed back a column at a time (see DbRelation::project_many)
+ */
+class ColumnBatch {
+public:
+	std::vector<ColumnVector> columns;  // in the order they were asked for
+	size_t num_rows;
+
+	ColumnBatch() : columns(), num_rows(0) {}
+
+	/**
+	 * @param column_name  name of a column in the batch
+	 * @returns            that column, or nullptr if the batch doesn't have it
+	 */
+	const ColumnVector* get_column(const Identifier& column_name) const {
+		for (auto const& column : columns)
+			if (column.column_name == column_name)
+				return &column;
+		return nullptr;
+	}
+
+	/**
+	 * @param row  which row of the batch
+	 * @returns    its values keyed by column name, as project() would have returned them
+	 */
+	ValueDict get_row(size_t row) const {
+		ValueDict values;
+		for (auto const& column : columns)
+			values[column.column_name] = column.get(row);
+		return values;
+	}
+};
+
+
+class Row;
+
+/**
+ * @class HandleCursor - lazy walk over the handles of the rows in a DbRelation
+ *
+ * Blocks are fetched one at a time as the cursor reaches them, so the first
+ * handle is available without walking the whole relation.
+ */
+class HandleCursor {
+public:
+	virtual ~HandleCursor() {}
+
+	/**
+	 * Advance to the next row.
+	 * @param handle  set to the handle of the next row when there is one
+	 * @returns       false once the cursor is exhausted
+	 */
+	virtual bool next(Handle &handle) = 0;
+
+	/**
+	 * Decode the row next() just returned from the cursor's own copy of its block. Unlike
+	 * DbRelation::project, this shares nothing with other cursors, so cursors on different
+	 * threads can each do it at the same time.
+	 * @param columns  positions of the columns wanted (nullptr for all of them)
+	 * @param row      where they go, by position; the others are left as they were
+	 */
+	virtual void project(const std::vector<u_int32_t>* columns, Row* row) = 0;
+};
 
 
 /**
@@ -244,6 +412,111 @@ public:
 };
 
 
+/**
+ * @class Row - one row's values by column position in its table
+ *
+ * The flat alternative to ValueDict for paths that handle rows in bulk: no tree nodes, no
+ * key strings, and no std::string per value. Each column is a fixed-size cell holding an INT,
+ * or a TEXT of up to INLINE_TEXT bytes; longer TEXTs go in one buffer shared by the row.
+ * clear() keeps that buffer, so a Row reused row after row stops allocating once it has seen
+ * its longest row. Column positions, and which are INT or TEXT, are the table's.
+ */
+class Row {
+public:
+	static const u_int32_t INLINE_TEXT = 16;
+
+	Row() : cells(), overflow() {}
+	explicit Row(u_int32_t num_columns) : cells(num_columns), overflow() {}
+
+	u_int32_t size() const {return (u_int32_t)cells.size();}
+
+	/**
+	 * @returns  bytes the row takes up in memory, the row itself included
+	 */
+	size_t memory_size() const {return sizeof(Row) + cells.capacity() * sizeof(Cell) + overflow.capacity();}
+
+	/**
+	 * Change the number of columns; new ones are INT 0.
+	 */
+	void resize(u_int32_t num_columns) {cells.resize(num_columns);}
+
+	/**
+	 * Set every column to INT 0, keeping the memory for the next row.
+	 */
+	void clear() {
+		for (Cell &cell : cells)
+			cell = Cell();
+		overflow.clear();
+	}
+
+	ColumnAttribute::DataType get_data_type(u_int32_t column) const {return cells[column].data_type;}
+	int32_t get_int(u_int32_t column) const {return cells[column].n;}
+
+	/**
+	 * @param column  a TEXT column
+	 * @returns       its bytes, good until the row is changed
+	 */
+	RecordView get_text(u_int32_t column) const {
+		const Cell &cell = cells[column];
+		return RecordView(cell.size <= INLINE_TEXT ? cell.text : overflow.data() + cell.offset, cell.size);
+	}
+
+	void set_int(u_int32_t column, int32_t n) {
+		cells[column].data_type = ColumnAttribute::INT;
+		cells[column].n = n;
+	}
+
+	/**
+	 * @param column  which column
+	 * @param data    the TEXT's bytes (not from this row's own get_text)
+	 * @param size    how many
+	 */
+	void set_text(u_int32_t column, const char* data, u_int32_t size) {
+		Cell &cell = cells[column];
+		cell.data_type = ColumnAttribute::TEXT;
+		cell.size = size;
+		if (size <= INLINE_TEXT) {
+			memcpy(cell.text, data, size);
+		}
+		else {
+			cell.offset = (u_int32_t)overflow.size();
+			overflow.append(data, size);
+		}
+	}
+	void set_text(u_int32_t column, const std::string& s) {set_text(column, s.data(), (u_int32_t)s.length());}
+
+	Value get(u_int32_t column) const {
+		if (get_data_type(column) == ColumnAttribute::INT)
+			return Value(get_int(column));
+		RecordView text = get_text(column);
+		return Value(std::string(text.data, text.size));
+	}
+
+	void set(u_int32_t column, const Value& value) {
+		if (value.data_type == ColumnAttribute::INT)
+			set_int(column, value.n);
+		else
+			set_text(column, value.s);
+	}
+
+protected:
+	struct Cell {
+		ColumnAttribute::DataType data_type;
+		u_int32_t size;                 // TEXT bytes
+		union {
+			int32_t n;
+			char text[INLINE_TEXT];     // TEXT of up to INLINE_TEXT bytes
+			u_int32_t offset;           // longer TEXT: where it is in overflow
+		};
+
+		Cell() : data_type(ColumnAttribute::INT), size(0), n(0) {}
+	};
+	std::vector<Cell> cells;
+	std::string overflow;
+};
+typedef std::vector<Row> Rows;
+
+
 /**
  * @class DbRelation - top-level object handling a physical database relation
  * 
@@ -255,13 +528,19 @@ public:
  * 	open()
  * 	close()
  * 	
- *	insert(row)
+ *	insert(row)  (ValueDict or Row)
+ *	insert_batch(rows)
  *	update(handle, new_values)
  *	del(handle)
  *	select()
  *	select(where)
+ *	select_cursor()
+ *	select_cursor(where)
+ *	select_cursor(where, first, last)
  *	project(handle)
  *	project(handle, column_names)
+ *	project(handle, column_names, row)
+ *	project_many(handles, column_names)
  */
 class DbRelation {
 public:
@@ -306,6 +585,21 @@ public:
 	 */
 	virtual Handle insert(const ValueDict* row) = 0;
 
+	/**
+	 * Same as insert(ValueDict), from a Row.
+	 * @param row  a value for every column, in the table's column order
+	 * @returns    a handle to the new row
+	 */
+	virtual Handle insert(const Row* row) = 0;
+
+	/**
+	 * Execute: INSERT INTO <table_name> ( <row_keys> ) VALUES ( <row_values> ), ( <row_values> ), ...
+	 * Meant for bulk loads: implementations should amortize per-row overhead across the batch.
+	 * @param rows  dictionaries keyed by column names, one per row
+	 * @returns     handles to the new rows, in the same order (freed by caller)
+	 */
+	virtual Handles* insert_batch(const ValueDicts* rows) = 0;
+
 	/**
 	 * Conceptually, execute: UPDATE INTO <table_name> SET <new_valus> WHERE <handle>
 	 * where handle is sufficient to identify one specific record (e.g., returned
@@ -336,6 +630,33 @@ public:
 	 */
 	virtual Handles* select(const ValueDict* where) = 0;
 
+	/**
+	 * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE 1
+	 * but hand back the handles lazily instead of as a list.
+	 * @returns  a pointer to a new HandleCursor over all the rows (freed by caller)
+	 */
+	virtual HandleCursor* select_cursor() = 0;
+
+	/**
+	 * Same as select(where), but the handles come back lazily one block at a time.
+	 * @param where  column name to the value it has to equal
+	 * @returns      cursor over the matching rows (freed by caller)
+	 * @throws       DbRelationError for an unknown column or a value of the wrong type
+	 */
+	virtual HandleCursor* select_cursor(const ValueDict* where) = 0;
+
+	/**
+	 * Same as select_cursor(where), over just the rows in blocks first through last, so a
+	 * scan can be split up among threads, each with a cursor of its own. Make the cursors on
+	 * one thread; each can then be used on a thread of its own.
+	 * @param where  column name to the value it has to equal (nullptr for every row)
+	 * @param first  first block to look in
+	 * @param last   last block to look in (past get_block_count() is the same as up to it)
+	 * @returns      cursor over the matching rows in those blocks (freed by caller)
+	 * @throws       DbRelationError for an unknown column or a value of the wrong type
+	 */
+	virtual HandleCursor* select_cursor(const ValueDict* where, BlockID first, BlockID last) = 0;
+
 	/**
 	 * Return a sequence of all values for handle (SELECT *).
 	 * @param handle  row to get values from
@@ -352,6 +673,38 @@ public:
 	 */
 	virtual ValueDict* project(Handle handle, const ColumnNames* column_names) = 0;
 
+	/**
+	 * Same as project(handle, column_names), into a Row that can be reused from one call to the next.
+	 * @param handle        row to get values from
+	 * @param column_names  list of column names to project (all of them for nullptr)
+	 * @param row           resized to the table's columns if need be; the projected ones are set, at their positions
+	 */
+	virtual void project(Handle handle, const ColumnNames* column_names, Row* row) = 0;
+
+	/**
+	 * Project many rows at once (SELECT <column_names> for each handle), fetching each
+	 * block only once however many of the handles are in it.
+	 * @param handles       rows to project, in the order the results should come back
+	 * @param column_names  list of column names to project (all of them for nullptr)
+	 * @returns             a column at a time, row i being handles[i] (freed by caller)
+	 */
+	virtual ColumnBatch* project_many(const Handles& handles, const ColumnNames* column_names) = 0;
+
+	/**
+	 * @returns  how many blocks the relation takes up, for telling a big one from a small one
+	 */
+	virtual u_int32_t get_block_count() = 0;
+
+	/**
+	 * Count the rows (SELECT COUNT(*)) without looking at any of them.
+	 * @returns  how many rows the relation has
+	 */
+	virtual u_int64_t count() = 0;
+
+	const Identifier& get_table_name() const {return table_name;}
+	const ColumnNames& get_column_names() const {return column_names;}
+	const ColumnAttributes& get_column_attributes() const {return column_attributes;}
+
 protected:
 	Identifier table_name;
 	ColumnNames column_names;
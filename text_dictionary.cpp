@@ -0,0 +1,111 @@
+/**
+ * @file text_dictionary.cpp - implementation of the TEXT dictionary.
+ * TextDictionary
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "text_dictionary.h"
+#include <unistd.h>
+using namespace std;
+
+static const u_int32_t MAGIC = 0x31434944;  // "DIC1"
+
+static void write_u32(ostream& out, u_int32_t n) {
+	out.write((const char*)&n, sizeof(n));
+}
+
+static bool read_u32(istream& in, u_int32_t& n) {
+	return (bool)in.read((char*)&n, sizeof(n));
+}
+
+
+/**************************TextDictionary Implementation*********************/
+
+//Header is the magic, the number of encoded columns and their positions
+void TextDictionary::create(std::string path, const std::vector<u_int32_t>& columns) {
+	close();
+	this->path = path;
+	this->columns = columns;
+	if (path.empty())
+		return;
+	this->log.open(path.c_str(), ios::binary | ios::trunc);
+	write_u32(this->log, MAGIC);
+	write_u32(this->log, (u_int32_t)columns.size());
+	for (u_int32_t column : columns)
+		write_u32(this->log, column);
+	this->log.flush();
+	if (!this->log)
+		throw DbRelationError("can't write dictionary " + path);
+}
+
+//Then each string as its length and bytes, in code order
+bool TextDictionary::load(std::string path) {
+	close();
+	ifstream in(path.c_str(), ios::binary);
+	if (!in)
+		return false;
+	u_int32_t magic, num_columns;
+	if (!read_u32(in, magic) || magic != MAGIC || !read_u32(in, num_columns))
+		throw DbRelationError("not a dictionary: " + path);
+	for (u_int32_t i = 0; i < num_columns; i++) {
+		u_int32_t column;
+		if (!read_u32(in, column))
+			throw DbRelationError("dictionary is truncated: " + path);
+		this->columns.push_back(column);
+	}
+	streamoff good = in.tellg();
+	u_int32_t length;
+	while (read_u32(in, length)) {
+		string text(length, '\0');
+		if (length > 0 && !in.read(&text[0], length))
+			break;
+		this->codes.emplace(text, (u_int32_t)this->texts.size());
+		this->texts.push_back(text);
+		good = in.tellg();
+	}
+	in.close();
+	if (truncate(path.c_str(), good) != 0)  // drop a torn last append: its code can't be in any block yet
+		throw DbRelationError("can't repair dictionary " + path);
+	this->path = path;
+	this->log.open(path.c_str(), ios::binary | ios::app);
+	return true;
+}
+
+void TextDictionary::close() {
+	if (this->log.is_open())
+		this->log.close();
+	this->path = "";
+	this->columns.clear();
+	this->texts.clear();
+	this->codes.clear();
+}
+
+u_int32_t TextDictionary::code(const RecordView& text) {
+	u_int32_t found = find(text);
+	if (found != NO_CODE)
+		return found;
+	u_int32_t code = (u_int32_t)this->texts.size();
+	this->texts.push_back(this->probe);
+	this->codes.emplace(this->probe, code);
+	if (this->log.is_open()) {
+		write_u32(this->log, text.size);
+		this->log.write(text.data, text.size);
+		this->log.flush();
+		if (!this->log)
+			throw DbRelationError("can't write dictionary " + this->path);
+	}
+	return code;
+}
+
+u_int32_t TextDictionary::find(const RecordView& text) const {
+	this->probe.assign(text.data, text.size);
+	auto it = this->codes.find(this->probe);
+	return it == this->codes.end() ? NO_CODE : it->second;
+}
+
+RecordView TextDictionary::text(u_int32_t code) const {
+	if (code >= this->texts.size())
+		throw DbRelationError("unknown dictionary code " + to_string(code));
+	const string &text = this->texts[code];
+	return RecordView(text.data(), (u_int32_t)text.size());
+}
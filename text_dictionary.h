@@ -0,0 +1,95 @@
+/**
+ * @file text_dictionary.h - Codes for the TEXT values of a table's dictionary-encoded columns.
+ * TextDictionary
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <deque>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "storage_engine.h"
+
+/**
+ * @class TextDictionary - string-to-code dictionary shared by a table's encoded TEXT columns
+ *
+ * Each distinct string gets the next code (0, 1, 2, ...), and the row stores the 4-byte code
+ * instead of the string, so equal strings compare as equal codes. Meant for columns with few
+ * distinct values: the whole dictionary lives in memory while the table is open.
+ *
+ * The side file next to the table's file starts with which columns are encoded, followed by
+ * the strings in code order. It is only ever appended to, and a new string goes out (and is
+ * flushed) as soon as its code is handed out, before any block holding the code can be
+ * written, so the file never falls behind the blocks.
+ */
+class TextDictionary {
+public:
+	static const u_int32_t NO_CODE = 0xffffffff;  // find() for a string that has no code
+
+	TextDictionary() : path(""), log(), columns(), texts(), codes(), probe() {}
+	virtual ~TextDictionary() {}
+	TextDictionary(const TextDictionary& other) = delete;
+	TextDictionary(TextDictionary&& temp) = delete;
+	TextDictionary& operator=(const TextDictionary& other) = delete;
+	TextDictionary& operator=(TextDictionary&& temp) = delete;
+
+	/**
+	 * Start an empty dictionary and write its side file.
+	 * @param path     where the dictionary lives on disk ("" to keep it in memory only)
+	 * @param columns  positions of the TEXT columns it encodes
+	 */
+	virtual void create(std::string path, const std::vector<u_int32_t>& columns);
+
+	/**
+	 * Read the dictionary back from its side file.
+	 * @param path  where the dictionary lives on disk
+	 * @returns     false if there is no side file (the dictionary is left empty, encoding nothing)
+	 * @throws      DbRelationError if the side file is damaged
+	 */
+	virtual bool load(std::string path);
+
+	/**
+	 * Stop appending to the side file and forget the strings.
+	 */
+	virtual void close();
+
+	/**
+	 * @returns  positions of the columns this dictionary encodes (empty when there is none)
+	 */
+	virtual const std::vector<u_int32_t>& get_columns() const {return columns;}
+
+	/**
+	 * @param text  a string
+	 * @returns     its code, given it now (and written to the side file) if it didn't have one
+	 */
+	virtual u_int32_t code(const RecordView& text);
+
+	/**
+	 * @param text  a string
+	 * @returns     its code, or NO_CODE if it hasn't got one
+	 */
+	virtual u_int32_t find(const RecordView& text) const;
+
+	/**
+	 * @param code  a code given out by code()
+	 * @returns     the string, good for as long as the dictionary is open
+	 * @throws      DbRelationError for a code that was never given out
+	 */
+	virtual RecordView text(u_int32_t code) const;
+
+	/**
+	 * @returns  number of distinct strings
+	 */
+	virtual u_int32_t size() const {return (u_int32_t)texts.size();}
+
+protected:
+	std::string path;
+	std::ofstream log;                                     // the side file, open for appending
+	std::vector<u_int32_t> columns;
+	std::deque<std::string> texts;                         // by code (a deque so they never move)
+	std::unordered_map<std::string, u_int32_t> codes;
+	mutable std::string probe;                             // find()'s key, reused to save allocating
+};